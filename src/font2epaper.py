@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+
+# badge_secsea © 2025 by Hack In Provence is licensed under
+# Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+# To view a copy of this license,
+# visit https://creativecommons.org/licenses/by-nc-sa/4.0/
+
+"""
+Small script to rasterize a font to a C-source glyph atlas, to be drawn by the text library (see text.h).
+"""
+
+import argparse
+import os
+import sys
+
+try:
+    from PIL import Image, ImageDraw, ImageFont, features
+except ImportError:
+    print("This script requires the PIL library")
+    sys.exit(1)
+
+
+# ASCII, and the accents that we need in French
+DEFAULT_CHARS = ''.join(chr(c) for c in range(32, 127)) + 'àâäçéèêëîïôöùûüÀÂÇÉÈÊÔÙ°€'
+
+
+def pack(levels, w, h, bit):
+    """Packs bit of the levels of a w*h glyph, 8 pixels per byte along X, MSB first (same as image2epaper.py)."""
+    w8 = (w+7)//8
+    buf = bytearray(w8*h)
+    for j in range(h):
+        for i in range(w):
+            if (levels[j*w+i] >> bit) & 1:
+                buf[j*w8 + i//8] |= 1 << (7-(i%8))
+    return buf
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Convert fonts using PIL to C source')
+    parser.add_argument('font', help='path to the TrueType/OpenType font')
+    parser.add_argument('--size', '-s', type=int, default=12, help='size of the font, in pixels')
+    parser.add_argument('--bits', type=int, choices=(1, 2), default=1,
+                        help='1 bit glyphs (drawn in any color) or 2 bits glyphs (antialiased with the 4 grays)')
+    parser.add_argument('--chars', '-c', default=DEFAULT_CHARS, help='characters to put in the atlas')
+    parser.add_argument('--name', '-n', default=None, help='name of the font in C, defaults to the font file name, size and bits')
+    parser.add_argument('--output', '-o', nargs='?', default=None, help='output to this instead of stdout')
+    args = parser.parse_args()
+
+    eprint = lambda *args, **kwargs: print(*args, file=sys.stderr, **kwargs)
+    if args.font == args.output:
+        eprint('output should not be the same file as input')  # Avoids overwrites
+        sys.exit(1)
+
+    font_name = args.name
+    if font_name is None:
+        font_name,_ = os.path.splitext(os.path.basename(args.font))
+        font_name = f'{font_name}_{args.size}_{args.bits}b'
+    font_name = ''.join(c if c.isalnum() else '_' for c in font_name).lower()
+    if font_name[0].isnumeric():
+        font_name = '_'+font_name
+    eprint('font name will be', font_name)
+
+    header_name = f'_{font_name.upper()}_H'
+
+    # The basic layout only knows the old kern table, most fonts have their kerning in GPOS that needs raqm
+    if features.check('raqm'):
+        font = ImageFont.truetype(args.font, args.size, layout_engine=ImageFont.Layout.RAQM)
+    else:
+        eprint('WARNING: PIL has no raqm support, the kerning pairs of the GPOS table will be missing')
+        font = ImageFont.truetype(args.font, args.size)
+    ascent, descent = font.getmetrics()
+    chars = sorted(set(args.chars))
+    if any(ord(c) > 0xFFFF for c in chars):
+        eprint('only characters of the Basic Multilingual Plane are supported')
+        sys.exit(1)
+    if '?' not in chars:
+        chars.append('?')  # Drawn for the missing characters
+        chars.sort()
+
+    # Rasterize each glyph in its bounding box, the coordinates are from the pen (left of the top of the line)
+    glyphs = []
+    planes = [bytearray(), bytearray(), bytearray()]  # lsb, msb, mask
+    for c in chars:
+        x0, y0, x1, y1 = font.getbbox(c, anchor='la')
+        w, h = max(0, x1-x0), max(0, y1-y0)
+        if not (w and h):
+            w = h = 0  # Blank glyph, e.g. the space
+        advance = round(font.getlength(c))
+        img = Image.new('L', (max(1, w), max(1, h)), 0)
+        ImageDraw.Draw(img).text((-x0, -y0), c, font=font, fill=255, anchor='la')
+        coverage = img.tobytes()
+
+        if args.bits == 1:
+            levels = [1 if v >= 128 else 0 for v in coverage]
+        else:
+            levels = [(v*3 + 127)//255 for v in coverage]  # 0 (paper) to 3 (ink)
+
+        offset = len(planes[2])
+        if w and h:
+            planes[2].extend(pack([1 if l else 0 for l in levels], w, h, 0))
+            if args.bits == 2:
+                # The planes are the colors of black ink: 3 (white) - level
+                colors = [3-l for l in levels]
+                planes[0].extend(pack(colors, w, h, 0))
+                planes[1].extend(pack(colors, w, h, 1))
+        if offset > 0xFFFF:
+            eprint('atlas is too big, reduce the font size or the characters')
+            sys.exit(1)
+        glyphs.append((ord(c), offset, w, h, x0, y0, advance))
+
+    # Kerning is what the layout of a pair adds to the sum of the advances
+    kerning = []
+    for a in chars:
+        for b in chars:
+            adjust = round(font.getlength(a+b) - font.getlength(a) - font.getlength(b))
+            if adjust:
+                kerning.append((ord(a), ord(b), max(-128, min(127, adjust))))
+    kerning.sort()
+
+    # Open destination on last minute to avoid overwrites
+    if args.output is None:
+        dest = sys.stdout
+    else:
+        dest = open(args.output, 'w')  # Yes, we don't close it, such rebels!
+        eprint('write to file', args.output)
+    fprint = lambda *args, **kwargs: print(*args, file=dest, **kwargs)
+
+    fprint(rf'''
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* WARNING: THIS FILE WAS GENERATED BY {parser.prog} */
+
+#ifndef {header_name}
+#define {header_name}
+
+#include "text.h"
+
+/* {parser.prog} rasterized {os.path.basename(args.font)} at {args.size}px with {args.bits} bit(s) per pixel:
+ * {len(glyphs)} glyphs, {len(planes[2])*(1 if args.bits == 1 else 3)} bytes of atlas, {len(kerning)} kerning pairs */
+'''.strip())
+
+    def fprint_buffer(name, data):
+        fprint(f'const uint8_t {name}[] = \\')
+        for j in range(0, len(data), 16):
+            line = ''.join(f'\\x{v:02X}' for v in data[j: j+16])
+            fprint(f'    "{line}" \\')
+        fprint(';')
+
+    fprint()
+    if args.bits == 2:
+        fprint_buffer(f'{font_name}_lsb', planes[0])
+        fprint_buffer(f'{font_name}_msb', planes[1])
+    fprint_buffer(f'{font_name}_mask', planes[2])
+
+    fprint()
+    fprint(f'const text_glyph_t {font_name}_glyphs[] = {{')
+    for cp, offset, w, h, x0, y0, advance in glyphs:
+        fprint(f'    {{0x{cp:04X}, {offset}, {w}, {h}, {x0}, {y0}, {advance}}},')
+    fprint('};')
+
+    fprint()
+    fprint(f'const text_kern_t {font_name}_kerning[] = {{')
+    for a, b, adjust in kerning:
+        fprint(f'    {{0x{a:04X}, 0x{b:04X}, {adjust}}},')
+    if not kerning:
+        fprint('    {0, 0, 0},')  # No empty arrays in C
+    fprint('};')
+
+    lsb, msb = (f'{font_name}_lsb', f'{font_name}_msb') if args.bits == 2 else ('NULL', 'NULL')
+    fprint()
+    fprint(f'const text_font_t {font_name} = {{')
+    fprint(f'    {lsb}, {msb}, {font_name}_mask,')
+    fprint(f'    {font_name}_glyphs, {len(glyphs)},')
+    fprint(f'    {font_name}_kerning, {len(kerning)},')
+    fprint(f'    {ascent+descent}, {args.bits},')
+    fprint('};')
+
+    fprint(f'\n#endif /* {header_name} */')
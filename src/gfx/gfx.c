@@ -0,0 +1,428 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <string.h>
+
+#include "badge_defs.h"
+#include "gfx.h"
+
+
+/* The planes are big-endian bit streams (MSB first) and the RP2040 is little-endian:
+ * masks are computed on the stream, then swapped to be applied to the words in memory (REV instruction). */
+#define BE(x) __builtin_bswap32(x)
+
+#define swap_int(a, b) { int _o = a; a = b; b = _o; }
+
+
+/* Sets (or clears) bits [b0,b1[ of the plane, 32 bits at a time */
+STATIC void span(uint8_t *plane, uint32_t b0, uint32_t b1, bool set) {
+    uint32_t *w = (uint32_t *)plane + (b0 >> 5);
+    uint32_t *last = (uint32_t *)plane + ((b1-1) >> 5);
+    uint32_t m0 = BE(0xFFFFFFFFu >> (b0 & 31));
+    uint32_t m1 = BE(0xFFFFFFFFu << (31 - ((b1-1) & 31)));
+
+    if (w == last)
+        m0 &= m1;
+    else {
+        /* Partial first word, full words, the partial last word is done with the single word case */
+        *w = set ? (*w | m0) : (*w & ~m0);
+        ++w;
+        uint32_t full = set ? 0xFFFFFFFFu : 0;
+        while(w < last)
+            *w++ = full;
+        m0 = m1;
+    }
+    *w = set ? (*w | m0) : (*w & ~m0);
+}
+
+/* Fills [x0,x1[ x [y0,y1[ (already clipped and not empty) on both planes */
+STATIC void fill_clipped(const gfx_planes_t *dst, int x0, int y0, int x1, int y1, uint8_t color) {
+    uint8_t *planes[2] = {dst->lsb, dst->msb};
+    uint32_t row_bits = dst->stride*8;
+
+    for(size_t i=0; i<2; ++i) {
+        if (! planes[i])
+            continue;
+        bool set = (color >> i) & 1;
+        if (x0 == 0 && (uint32_t)x1 == row_bits) {
+            /* Whole rows are a single span */
+            span(planes[i], y0*row_bits, y1*row_bits, set);
+        } else {
+            for(int y=y0; y<y1; ++y)
+                span(planes[i], y*row_bits + x0, y*row_bits + x1, set);
+        }
+    }
+}
+
+/* Clips [x0,x1[ x [y0,y1[ to the planes, returns false if nothing is left */
+STATIC bool clip(const gfx_planes_t *dst, int *x0, int *y0, int *x1, int *y1) {
+    if (*x0 < 0)
+        *x0 = 0;
+    if (*y0 < 0)
+        *y0 = 0;
+    if (*x1 > dst->width)
+        *x1 = dst->width;
+    if (*y1 > dst->height)
+        *y1 = dst->height;
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+
+void gfx_fill(const gfx_planes_t *dst, uint8_t color) {
+    size_t len = (size_t)dst->stride * dst->height;
+    memset(dst->lsb, (color & 1) ? 0xFF : 0x00, len);
+    if (dst->msb)
+        memset(dst->msb, (color & 2) ? 0xFF : 0x00, len);
+}
+
+
+void gfx_pixel(const gfx_planes_t *dst, int x, int y, uint8_t color) {
+    if (x < 0 || y < 0 || x >= dst->width || y >= dst->height)
+        return;
+    size_t i = y*dst->stride + x/8;
+    uint8_t m = 0x80 >> (x & 7);
+    dst->lsb[i] = (color & 1) ? (dst->lsb[i] | m) : (dst->lsb[i] & ~m);
+    if (dst->msb)
+        dst->msb[i] = (color & 2) ? (dst->msb[i] | m) : (dst->msb[i] & ~m);
+}
+
+
+void gfx_fill_rect(const gfx_planes_t *dst, int x, int y, int w, int h, uint8_t color) {
+    int x1 = x+w, y1 = y+h;
+    if (clip(dst, &x, &y, &x1, &y1))
+        fill_clipped(dst, x, y, x1, y1, color);
+}
+
+
+void gfx_hline(const gfx_planes_t *dst, int x, int y, int w, uint8_t color) {
+    gfx_fill_rect(dst, x, y, w, 1, color);
+}
+
+
+void gfx_vline(const gfx_planes_t *dst, int x, int y, int h, uint8_t color) {
+    int x1 = x+1, y1 = y+h;
+    if (! clip(dst, &x, &y, &x1, &y1))
+        return;
+
+    /* A single bit per row, no need for spans */
+    uint8_t m = 0x80 >> (x & 7);
+    uint8_t *planes[2] = {dst->lsb, dst->msb};
+    for(size_t i=0; i<2; ++i) {
+        if (! planes[i])
+            continue;
+        uint8_t *p = planes[i] + y*dst->stride + x/8;
+        if ((color >> i) & 1)
+            for(int j=y; j<y1; ++j, p+=dst->stride)
+                *p |= m;
+        else
+            for(int j=y; j<y1; ++j, p+=dst->stride)
+                *p &= ~m;
+    }
+}
+
+
+void gfx_line(const gfx_planes_t *dst, int x0, int y0, int x1, int y1, uint8_t color) {
+    /* Use the faster functions when possible */
+    if (y0 == y1) {
+        if (x0 > x1)
+            swap_int(x0, x1);
+        gfx_hline(dst, x0, y0, x1-x0+1, color);
+        return;
+    }
+    if (x0 == x1) {
+        if (y0 > y1)
+            swap_int(y0, y1);
+        gfx_vline(dst, x0, y0, y1-y0+1, color);
+        return;
+    }
+
+    int dx = x1 > x0 ? x1-x0 : x0-x1, sx = x0 < x1 ? 1 : -1;
+    int dy = y1 > y0 ? y0-y1 : y1-y0, sy = y0 < y1 ? 1 : -1;
+    int err = dx+dy;
+    while(true) {
+        gfx_pixel(dst, x0, y0, color);
+        if (x0 == x1 && y0 == y1)
+            break;
+        int e2 = 2*err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+
+void gfx_circle(const gfx_planes_t *dst, int cx, int cy, int r, uint8_t color) {
+    /* Midpoint circle, 8 octants at a time */
+    int x = r, y = 0, err = 1-r;
+    while(x >= y) {
+        gfx_pixel(dst, cx+x, cy+y, color);
+        gfx_pixel(dst, cx-x, cy+y, color);
+        gfx_pixel(dst, cx+x, cy-y, color);
+        gfx_pixel(dst, cx-x, cy-y, color);
+        gfx_pixel(dst, cx+y, cy+x, color);
+        gfx_pixel(dst, cx-y, cy+x, color);
+        gfx_pixel(dst, cx+y, cy-x, color);
+        gfx_pixel(dst, cx-y, cy-x, color);
+        ++y;
+        if (err < 0)
+            err += 2*y+1;
+        else {
+            --x;
+            err += 2*(y-x)+1;
+        }
+    }
+}
+
+
+void gfx_fill_circle(const gfx_planes_t *dst, int cx, int cy, int r, uint8_t color) {
+    /* One span per row, the half width only decreases when going away from the center.
+     * The +r gives the same rounding as the midpoint circle. */
+    int x = r;
+    for(int y=0; y<=r; ++y) {
+        while(x*x + y*y > r*r + r)
+            --x;
+        gfx_hline(dst, cx-x, cy+y, 2*x+1, color);
+        if (y)
+            gfx_hline(dst, cx-x, cy-y, 2*x+1, color);
+    }
+}
+
+
+/* Big-endian 32 bits read of a source row, the bytes after the end of the row are read as 0 */
+static inline uint32_t load_be32(const uint8_t *p, int avail) {
+    if (avail >= 4)
+        return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    uint32_t v = 0;
+    for(int i=0; i<4; ++i)
+        v = (v << 8) | (i < avail ? p[i] : 0);
+    return v;
+}
+
+/* Reads a source row 32 bits at a time, and shifts it to align it on the destination words */
+typedef struct {
+    const uint8_t *p;  /* Next word to read */
+    int avail;         /* Bytes left in the row */
+    uint32_t prev;     /* Previous word */
+} row_stream_t;
+
+static inline void stream_init(row_stream_t *st, const uint8_t *row, int avail, bool preload) {
+    st->p = row;
+    st->avail = avail;
+    st->prev = 0;
+    if (preload) {
+        st->prev = load_be32(st->p, st->avail);
+        st->p += 4;
+        st->avail -= 4;
+    }
+}
+
+/* Funnel shift: the 32 bits starting at bit sh of the (prev, next) pair */
+static inline uint32_t stream_next(row_stream_t *st, unsigned sh) {
+    uint32_t next = load_be32(st->p, st->avail);
+    uint32_t v = sh ? (st->prev << sh) | (next >> (32-sh)) : st->prev;
+    st->prev = next;
+    st->p += 4;
+    st->avail -= 4;
+    return v;
+}
+
+
+/* Copies src at (x,y), the planes are read from srcs, or filled with the bits of color where srcs[i] is NULL */
+STATIC void blit(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src, const uint8_t *srcs[2], uint8_t color) {
+    int x1 = x+src->width, y1 = y+src->height;
+    int sx = x, sy = y;  /* Position of the source, before clipping */
+    if (! clip(dst, &x, &y, &x1, &y1))
+        return;
+
+    uint8_t *planes[2] = {dst->lsb, dst->msb};
+    uint32_t fills[2] = {(color & 1) ? 0xFFFFFFFFu : 0, (color & 2) ? 0xFFFFFFFFu : 0};
+    uint32_t row_bits = dst->stride*8;
+
+    /* The clipped source starts at bit so of its rows, which is byte sb + bit sr.
+     * Source words are read from byte sb, and the destination words start at bit off:
+     * destination word k is made from the source bits [32k-off+sr, 32k-off+sr+32[ of these words */
+    int so = x-sx, sb = so/8, sr = so%8;
+    int n = x1-x;  /* Bits per row */
+    int row_avail = (src->width+7)/8 - sb;
+
+    for(int j=y; j<y1; ++j) {
+        uint32_t d0 = j*row_bits + x;
+        unsigned off = d0 & 31;
+        int nw = (off + n + 31) >> 5;
+        int delta = sr - (int)off;
+        /* When delta < 0, the first word only has bits of the first source word: start with prev = 0 */
+        unsigned sh = delta >= 0 ? delta : 32+delta;
+        bool preload = delta >= 0;
+
+        size_t srow = (j-sy)*src->stride + sb;
+        row_stream_t st[2] = {0}, mst = {0};
+        for(size_t i=0; i<2; ++i)
+            if (planes[i] && srcs[i])
+                stream_init(&st[i], srcs[i] + srow, row_avail, preload);
+        if (src->mask)
+            stream_init(&mst, src->mask + srow, row_avail, preload);
+
+        uint32_t *w[2] = {NULL, NULL};
+        for(size_t i=0; i<2; ++i)
+            if (planes[i])
+                w[i] = (uint32_t *)planes[i] + (d0 >> 5);
+
+        for(int k=0; k<nw; ++k) {
+            /* Edge masks on the first and last words */
+            uint32_t m = 0xFFFFFFFFu;
+            if (k == 0)
+                m >>= off;
+            if (k == nw-1)
+                m &= 0xFFFFFFFFu << (31 - ((off+n-1) & 31));
+            if (src->mask)
+                m &= stream_next(&mst, sh);
+            m = BE(m);
+
+            for(size_t i=0; i<2; ++i) {
+                if (! planes[i])
+                    continue;
+                uint32_t v = srcs[i] ? BE(stream_next(&st[i], sh)) : fills[i];
+                *w[i] = (*w[i] & ~m) | (v & m);
+                ++w[i];
+            }
+        }
+    }
+}
+
+
+void gfx_blit(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src) {
+    const uint8_t *srcs[2] = {src->lsb, src->msb ? src->msb : src->lsb};  /* Black and white is either 00 or 11 */
+    blit(dst, x, y, src, srcs, 0);
+}
+
+
+void gfx_stencil(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src, uint8_t color) {
+    if (! src->mask)
+        return;
+    const uint8_t *srcs[2] = {NULL, NULL};
+    blit(dst, x, y, src, srcs, color);
+}
+
+
+/* Transposes the 8x8 bit matrix a (a[i] is row i, MSB first) to b: b[c] is column c, row 0 in its MSB.
+ * 32 bits at a time, with the swaps of 1x1, 2x2 then 4x4 blocks (Hacker's Delight, transpose8rS32) */
+STATIC void transpose8(const uint8_t a[8], uint8_t b[8]) {
+    uint32_t x = ((uint32_t)a[0] << 24) | (a[1] << 16) | (a[2] << 8) | a[3];
+    uint32_t y = ((uint32_t)a[4] << 24) | (a[5] << 16) | (a[6] << 8) | a[7];
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    b[0] = x >> 24;
+    b[1] = x >> 16;
+    b[2] = x >> 8;
+    b[3] = x;
+    b[4] = y >> 24;
+    b[5] = y >> 16;
+    b[6] = y >> 8;
+    b[7] = y;
+}
+
+/* The ARMv6-M has no RBIT */
+static inline uint8_t reverse8(uint8_t v) {
+    v = (v >> 4) | (v << 4);
+    v = ((v >> 2) & 0x33) | ((v & 0x33) << 2);
+    return ((v >> 1) & 0x55) | ((v & 0x55) << 1);
+}
+
+
+/* Quarter turn of a plane of sw x sh pixels, clockwise or counterclockwise, by blocks of 8x8 pixels:
+ * the 8 source rows of a destination byte column are transposed 8 columns at a time */
+STATIC void quarter_turn(uint8_t *dst, size_t dstride, const uint8_t *src, size_t sstride, int sw, int sh, bool cw) {
+    uint8_t a[8], b[8];
+    for(int bx=0; 8*bx<sh; ++bx) {
+        /* Clockwise, destination column x is source row sh-1-x, else source row x. Rows after sh are 0. */
+        const uint8_t *rows[8];
+        for(int i=0; i<8; ++i) {
+            int x = 8*bx+i;
+            rows[i] = x < sh ? src + (cw ? sh-1-x : x)*sstride : NULL;
+        }
+        for(int sx=0; sx<sw/8; ++sx) {
+            for(int i=0; i<8; ++i)
+                a[i] = rows[i] ? rows[i][sx] : 0;
+            transpose8(a, b);
+            /* Clockwise, destination row y is source column y, else source column sw-1-y */
+            for(int c=0; c<8; ++c) {
+                int y = cw ? 8*sx+c : sw-1 - (8*sx+c);
+                dst[y*dstride + bx] = b[c];
+            }
+        }
+    }
+}
+
+
+/* Mirror of a plane of w x h pixels. Rows ya and yb=h-1-ya (or ya) are done together, 2 bytes at a time from
+ * both ends (or the same byte), so that it also works in place */
+STATIC void mirror_plane(uint8_t *dst, size_t dstride, const uint8_t *src, size_t sstride, int w, int h,
+                         bool flip_x, bool flip_y) {
+    int n = w/8;
+    for(int ya=0; ya<h; ++ya) {
+        int yb = flip_y ? h-1-ya : ya;
+        if (yb < ya)
+            break;
+        const uint8_t *sa = src + ya*sstride, *sb = src + yb*sstride;
+        uint8_t *da = dst + ya*dstride, *db = dst + yb*dstride;
+        for(int i=0; i<n; ++i) {
+            int j = flip_x ? n-1-i : i;
+            if (j < i)
+                break;
+            uint8_t ai = sa[i], aj = sa[j], bi = sb[i], bj = sb[j];
+            if (flip_x) {
+                ai = reverse8(ai);
+                aj = reverse8(aj);
+                bi = reverse8(bi);
+                bj = reverse8(bj);
+            }
+            da[i] = bj;
+            da[j] = bi;
+            db[i] = aj;
+            db[j] = ai;
+        }
+    }
+}
+
+
+void gfx_rotate(const gfx_planes_t *dst, const gfx_image_t *src, gfx_rotation_t rotation) {
+    if (rotation == GFX_ROTATE_0 || rotation == GFX_ROTATE_180) {
+        gfx_mirror(dst, src, rotation == GFX_ROTATE_180, rotation == GFX_ROTATE_180);
+        return;
+    }
+    uint8_t *planes[2] = {dst->lsb, dst->msb};
+    const uint8_t *srcs[2] = {src->lsb, src->msb ? src->msb : src->lsb};  /* Black and white is either 00 or 11 */
+    for(size_t i=0; i<2; ++i)
+        if (planes[i])
+            quarter_turn(planes[i], dst->stride, srcs[i], src->stride, src->width, src->height,
+                         rotation == GFX_ROTATE_90);
+}
+
+
+void gfx_mirror(const gfx_planes_t *dst, const gfx_image_t *src, bool flip_x, bool flip_y) {
+    uint8_t *planes[2] = {dst->lsb, dst->msb};
+    const uint8_t *srcs[2] = {src->lsb, src->msb ? src->msb : src->lsb};
+    for(size_t i=0; i<2; ++i)
+        if (planes[i])
+            mirror_plane(planes[i], dst->stride, srcs[i], src->stride, src->width, src->height, flip_x, flip_y);
+}
@@ -0,0 +1,128 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file gfx.h
+ *
+ * \brief Graphics API: draw in packed bitplanes, the image format of the screen library.
+ *
+ * Images are 1 or 2 bitplanes, packed 8 pixels per byte along X, the MSB of a byte being the leftmost pixel
+ * (see image2epaper.py). The planes are the ones given to screen_show_image_4g() or screen_push_rams():
+ * - the lsb plane goes to the B/W RAM,
+ * - the msb plane goes to the RED RAM, and is NULL for black and white images.
+ * Colors are 0 (black) to 3 (white), black and white images only use bit 0 of the colors.
+ *
+ * The drawing functions do not work pixel by pixel when they can avoid it.
+ * A row of pixels is a contiguous span of bits in the plane, so spans are filled with 32 bits masks
+ * (the plane is seen as a big-endian bit stream, which is byte swapped to the little-endian words of the RP2040).
+ * Hence the planes must be aligned on 4 bytes and their size rounded to 4 bytes, see \ref GFX_PLANE_SIZE.
+ *
+ * Everything is clipped to the destination planes, coordinates can be negative or outside.
+ *
+ * This library does not depend on the pico SDK, so that it can be tested on other platforms.
+ *
+ * Text is drawn by the text library (text.h), with gfx_blit() and gfx_stencil().
+ * */
+
+#ifndef _GFX_H
+#define _GFX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of a plane buffer of \p w * \p h pixels, in bytes, rounded up for the 32 bits accesses */
+#define GFX_PLANE_SIZE(w, h) (((((w)+7)/8 * (h)) + 3) & ~3)
+
+/** \brief Destination bitplanes. */
+typedef struct {
+    uint8_t *lsb;     /**< Plane of the lowest bit of the colors (B/W RAM) */
+    uint8_t *msb;     /**< Plane of the highest bit of the colors (RED RAM), NULL in black and white */
+    uint16_t width;   /**< In pixels */
+    uint16_t height;  /**< In pixels */
+    uint16_t stride;  /**< Bytes between two rows, at least (width+7)/8 */
+} gfx_planes_t;
+
+/** Destination planes for a fullscreen image (\p msb can be NULL) */
+#define GFX_SCREEN_PLANES(lsb, msb) ((gfx_planes_t){(lsb), (msb), 200, 200, 200/8})
+
+/** \brief Source image, as generated by image2epaper.py. */
+typedef struct {
+    const uint8_t *lsb;
+    const uint8_t *msb;   /**< NULL for black and white images (then the pixels are either 00 or 11) */
+    const uint8_t *mask;  /**< NULL for opaque images, else a plane of the same size where 1 is a pixel to draw */
+    uint16_t width;
+    uint16_t height;
+    uint16_t stride;
+} gfx_image_t;
+
+/** Source image for a black and white image generated by image2epaper.py, named \p name */
+#define GFX_IMAGE_BW(name) ((gfx_image_t){name, NULL, NULL, name##_width*8, name##_height, name##_width})
+/** Source image for a 4 grays image generated by image2epaper.py, named \p name */
+#define GFX_IMAGE_4G(name) ((gfx_image_t){name##_lsb, name##_msb, NULL, name##_width*8, name##_height, name##_width})
+
+
+/** \brief Fill the planes with a color. */
+void gfx_fill(const gfx_planes_t *dst, uint8_t color);
+
+/** \brief Set a single pixel. */
+void gfx_pixel(const gfx_planes_t *dst, int x, int y, uint8_t color);
+
+/** \brief Fill the rectangle [x,x+w[ x [y,y+h[. */
+void gfx_fill_rect(const gfx_planes_t *dst, int x, int y, int w, int h, uint8_t color);
+
+/** \brief Draw the horizontal line [x,x+w[ on row y. */
+void gfx_hline(const gfx_planes_t *dst, int x, int y, int w, uint8_t color);
+
+/** \brief Draw the vertical line [y,y+h[ on column x. */
+void gfx_vline(const gfx_planes_t *dst, int x, int y, int h, uint8_t color);
+
+/** \brief Draw a line from (x0,y0) to (x1,y1), both included (Bresenham). */
+void gfx_line(const gfx_planes_t *dst, int x0, int y0, int x1, int y1, uint8_t color);
+
+/** \brief Draw the outline of a circle centered on (cx,cy). */
+void gfx_circle(const gfx_planes_t *dst, int cx, int cy, int r, uint8_t color);
+
+/** \brief Fill a circle centered on (cx,cy). */
+void gfx_fill_circle(const gfx_planes_t *dst, int cx, int cy, int r, uint8_t color);
+
+/** \brief Copy an image, only where its mask is 1 (or everywhere without mask).
+ *
+ * The image can be placed at any X: its rows are shifted 32 bits at a time to the destination words
+ * (funnel shifts between consecutive source words), with masks on the first and last words of each row
+ * to keep the surrounding pixels. Black and white images are drawn as black (00) and white (11) on 4 grays planes.
+ * */
+void gfx_blit(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src);
+
+/** \brief Draw a color where the mask of an image is 1, the lsb and msb planes of the image are not used.
+ *
+ * Same as \ref gfx_blit with a uniform image, e.g. to draw 1 bit glyphs in any color. */
+void gfx_stencil(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src, uint8_t color);
+
+
+/** \brief Clockwise rotations of \ref gfx_rotate. */
+typedef enum {
+    GFX_ROTATE_0 = 0,
+    GFX_ROTATE_90 = 1,
+    GFX_ROTATE_180 = 2,
+    GFX_ROTATE_270 = 3,
+} gfx_rotation_t;
+
+/** \brief Copy an image rotated clockwise, e.g. to show an asset in landscape, or upside down.
+ *
+ * The quarter turns transpose blocks of 8x8 pixels (8 bytes of 8 source rows make 8 bytes of 8 destination rows),
+ * 32 bits at a time. The half turn is \ref gfx_mirror on both axes.
+ *
+ * The width of the image must be a multiple of 8 (as generated by image2epaper.py), and the destination planes must
+ * have its size (width and height swapped for the quarter turns). The mask of the image is not used.
+ * The quarter turns cannot be done in place. When the height is not a multiple of 8 in a quarter turn,
+ * the bits after the new width are cleared. */
+void gfx_rotate(const gfx_planes_t *dst, const gfx_image_t *src, gfx_rotation_t rotation);
+
+/** \brief Copy an image mirrored left to right (\p flip_x) and/or top to bottom (\p flip_y).
+ *
+ * Same constraints as \ref gfx_rotate, but it can be done in place (the destination planes are the image ones). */
+void gfx_mirror(const gfx_planes_t *dst, const gfx_image_t *src, bool flip_x, bool flip_y);
+
+#endif /* _GFX_H */
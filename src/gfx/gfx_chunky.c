@@ -0,0 +1,139 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include "badge_defs.h"
+#include "gfx_chunky.h"
+
+
+/* The chunky buffers are read as little-endian words (pixel 0 in the low byte),
+ * the 2 bits buffers are big-endian bit streams like the planes, hence swapped (REV instruction) */
+#define BE(x) __builtin_bswap32(x)
+
+
+/* Byte i of entry n is bit 3-i of n: the 4 pixels of a nibble of a plane, leftmost pixel first */
+STATIC const uint32_t spread[16] = {
+    0x00000000, 0x01000000, 0x00010000, 0x01010000,
+    0x00000100, 0x01000100, 0x00010100, 0x01010100,
+    0x00000001, 0x01000001, 0x00010001, 0x01010001,
+    0x00000101, 0x01000101, 0x00010101, 0x01010101,
+};
+
+
+/* Gathers bit 0 of the 8 bytes of a then b (pixels 0 to 7) in a byte, pixel 0 in the MSB.
+ * The bits are at 0, 8, 16, 24 (b) and 4, 12, 20, 28 (a), the multiplication adds them shifted by 27, 18, 9 and 0:
+ * bits 31 to 24 of the product are the 8 bits in order, and no other term falls there, so there is no carry. */
+static inline uint8_t gather8(uint32_t a, uint32_t b) {
+    return (((b & 0x01010101) | ((a & 0x01010101) << 4)) * 0x08040201) >> 24;
+}
+
+/* Moves the odd bits of x to its 16 high bits, and the even bits to its 16 low bits, in order
+ * (Hacker's Delight, unshuffle): bits m0 l0 m1 l1 ... m15 l15 become m0 ... m15 l0 ... l15 */
+static inline uint32_t unshuffle(uint32_t x) {
+    uint32_t t;
+    t = (x ^ (x >> 1)) & 0x22222222;
+    x = x ^ t ^ (t << 1);
+    t = (x ^ (x >> 2)) & 0x0C0C0C0C;
+    x = x ^ t ^ (t << 2);
+    t = (x ^ (x >> 4)) & 0x00F000F0;
+    x = x ^ t ^ (t << 4);
+    t = (x ^ (x >> 8)) & 0x0000FF00;
+    return x ^ t ^ (t << 8);
+}
+
+/* Inverse of unshuffle */
+static inline uint32_t shuffle(uint32_t x) {
+    uint32_t t;
+    t = (x ^ (x >> 8)) & 0x0000FF00;
+    x = x ^ t ^ (t << 8);
+    t = (x ^ (x >> 4)) & 0x00F000F0;
+    x = x ^ t ^ (t << 4);
+    t = (x ^ (x >> 2)) & 0x0C0C0C0C;
+    x = x ^ t ^ (t << 2);
+    t = (x ^ (x >> 1)) & 0x22222222;
+    return x ^ t ^ (t << 1);
+}
+
+
+void gfx_chunky8_to_planes(const gfx_planes_t *dst, const uint8_t *src, size_t stride) {
+    int n = dst->width/8;
+    for(int y=0; y<dst->height; ++y) {
+        const uint32_t *p = (const uint32_t *)(src + y*stride);
+        uint8_t *lsb = dst->lsb + y*dst->stride;
+        if (dst->msb) {
+            uint8_t *msb = dst->msb + y*dst->stride;
+            for(int k=0; k<n; ++k, p+=2) {
+                lsb[k] = gather8(p[0], p[1]);
+                msb[k] = gather8(p[0] >> 1, p[1] >> 1);
+            }
+        } else {
+            for(int k=0; k<n; ++k, p+=2)
+                lsb[k] = gather8(p[0], p[1]);
+        }
+    }
+}
+
+
+void gfx_chunky2_to_planes(const gfx_planes_t *dst, const uint8_t *src, size_t stride) {
+    int n = dst->width/16;
+    for(int y=0; y<dst->height; ++y) {
+        const uint32_t *p = (const uint32_t *)(src + y*stride);
+        uint8_t *lsb = dst->lsb + y*dst->stride;
+        uint8_t *msb = dst->msb ? dst->msb + y*dst->stride : NULL;
+        uint32_t x;
+        /* 16 pixels per word, then the last 8 pixels in the high half of the next word */
+        for(int k=0; k<n; ++k) {
+            x = unshuffle(BE(p[k]));
+            lsb[2*k] = x >> 8;
+            lsb[2*k+1] = x;
+            if (msb) {
+                msb[2*k] = x >> 24;
+                msb[2*k+1] = x >> 16;
+            }
+        }
+        if (dst->width & 8) {
+            x = unshuffle(BE(p[n]) & 0xFFFF0000);
+            lsb[2*n] = x >> 8;
+            if (msb)
+                msb[2*n] = x >> 24;
+        }
+    }
+}
+
+
+void gfx_planes_to_chunky8(uint8_t *dst, size_t stride, const gfx_image_t *src) {
+    int n = src->width/8;
+    for(int y=0; y<src->height; ++y) {
+        uint32_t *p = (uint32_t *)(dst + y*stride);
+        const uint8_t *lsb = src->lsb + y*src->stride;
+        const uint8_t *msb = src->msb ? src->msb + y*src->stride : lsb;
+        for(int k=0; k<n; ++k, p+=2) {
+            uint8_t l = lsb[k], m = msb[k];
+            p[0] = spread[l >> 4] | (spread[m >> 4] << 1);
+            p[1] = spread[l & 15] | (spread[m & 15] << 1);
+        }
+    }
+}
+
+
+void gfx_planes_to_chunky2(uint8_t *dst, size_t stride, const gfx_image_t *src) {
+    int n = src->width/16;
+    for(int y=0; y<src->height; ++y) {
+        uint8_t *row = dst + y*stride;
+        uint32_t *p = (uint32_t *)row;
+        const uint8_t *lsb = src->lsb + y*src->stride;
+        const uint8_t *msb = src->msb ? src->msb + y*src->stride : lsb;
+        for(int k=0; k<n; ++k) {
+            uint32_t x = ((uint32_t)msb[2*k] << 24) | (msb[2*k+1] << 16) | (lsb[2*k] << 8) | lsb[2*k+1];
+            p[k] = BE(shuffle(x));
+        }
+        /* The last 8 pixels are a half word */
+        if (src->width & 8) {
+            uint32_t x = shuffle(((uint32_t)msb[2*n] << 24) | (lsb[2*n] << 8));
+            row[4*n] = x >> 24;
+            row[4*n+1] = x >> 16;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file gfx_chunky.h
+ *
+ * \brief Chunky conversions API: between the planes of the screen and buffers that hold the colors of the pixels.
+ *
+ * The planes split the 2 bits of the colors (see gfx.h), as image2epaper.py does on the host.
+ * Code that computes colors pixel by pixel (cellular automata, games, images received in 2 bits per pixel, ...)
+ * is easier to write with one color per pixel, these functions convert these "chunky" buffers to the planes and back:
+ * - 8 bits per pixel: a byte per pixel, the color in its 2 low bits (the other bits are ignored, and 0 when written),
+ * - 2 bits per pixel: 4 pixels per byte, the leftmost pixel in the 2 high bits (as the planes, MSB first).
+ *
+ * The chunky buffers are read and written 32 bits at a time: they must be aligned on 4 bytes, and their stride must
+ * be a multiple of 4. The width of the planes must be a multiple of 8 (as generated by image2epaper.py).
+ * Black and white planes (msb is NULL) ignore bit 1 of the colors, and are converted to colors 0 and 3.
+ *
+ * The kernels have no branch in their loops and work 8 or 16 pixels at a time (the Cortex-M0+ has a single cycle
+ * multiplier and byte reversal, but no bit field instructions):
+ * - 8 bits to planes: the bits of 8 pixels are gathered with a multiplication (bits 0, 8, 16, 24 of two words),
+ * - 2 bits to planes and back: the bits of 16 pixels are unshuffled (or shuffled) in a 32 bits word,
+ * - planes to 8 bits: a table spreads 4 bits to the 4 bytes of a word.
+ *
+ * Throughput, in bytes of the chunky buffer per cycle, for a 200x200 image in 4 grays:
+ * - on a x86 host (gfx_chunky_bench.c in tests/emu, 21 to 37x faster than pixel by pixel): 1.4 to 2.5 for 8 bits,
+ *   0.3 to 0.6 for 2 bits, depending on the host,
+ * - on the badge, estimated from the instruction count of the loops on the Cortex-M0+ (about 30 cycles for 8 bytes of
+ *   8 bits, 50 cycles for a word of 2 bits): ~0.25 for 8 bits, ~0.08 for 2 bits, i.e. ~1.3ms and ~1ms per image
+ *   at 125MHz. These are not measured yet: test_bench() in tests/gfx.c reports the real figures.
+ * */
+
+#ifndef _GFX_CHUNKY_H
+#define _GFX_CHUNKY_H
+
+#include "gfx.h"
+
+/** \brief Convert a buffer of 8 bits per pixel, of the size of \p dst, to its planes.
+ *
+ * \param stride    Bytes between two rows of \p src. */
+void gfx_chunky8_to_planes(const gfx_planes_t *dst, const uint8_t *src, size_t stride);
+
+/** \brief Convert a buffer of 2 bits per pixel, of the size of \p dst, to its planes. */
+void gfx_chunky2_to_planes(const gfx_planes_t *dst, const uint8_t *src, size_t stride);
+
+/** \brief Convert the planes of an image to a buffer of 8 bits per pixel. The mask of the image is not used. */
+void gfx_planes_to_chunky8(uint8_t *dst, size_t stride, const gfx_image_t *src);
+
+/** \brief Convert the planes of an image to a buffer of 2 bits per pixel. The mask of the image is not used. */
+void gfx_planes_to_chunky2(uint8_t *dst, size_t stride, const gfx_image_t *src);
+
+#endif /* _GFX_CHUNKY_H */
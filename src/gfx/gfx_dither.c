@@ -0,0 +1,128 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <string.h>
+
+#include "badge_defs.h"
+#include "gfx_dither.h"
+
+
+/* 4x4 Bayer matrix, as thresholds between 0 and 255: (2*b+1)*8 */
+STATIC const uint8_t bayer[4][4] = {
+    {  8, 136,  40, 168},
+    {200,  72, 232, 104},
+    { 56, 184,  24, 152},
+    {248, 120, 216,  88},
+};
+
+
+/* Writes the last byte of the row (partial when the width is not a multiple of 8), and clears the bytes after it */
+STATIC void end_row(uint8_t *row, size_t stride, int width, unsigned bits) {
+    int x = width;
+    if (x & 7) {
+        row[x >> 3] = bits << (8 - (x & 7));
+        x += 8;
+    }
+    if ((size_t)(x >> 3) < stride)
+        memset(row + (x >> 3), 0, stride - (x >> 3));
+}
+
+
+/* The colors are 0 to 3 in 4 grays, (3*v + t) >> 8 with a threshold t, or 0 and 1 in black and white, (v + t) >> 8 */
+STATIC void ordered_row(const gfx_planes_t *dst, int y, const uint8_t *gray) {
+    const uint8_t *t = bayer[y & 3];
+    uint8_t *lsb = dst->lsb + y*dst->stride;
+    unsigned l = 0, m = 0;
+
+    if (dst->msb) {
+        uint8_t *msb = dst->msb + y*dst->stride;
+        for(int x=0; x<dst->width; ++x) {
+            unsigned c = (3*gray[x] + t[x & 3]) >> 8;
+            l = (l << 1) | (c & 1);
+            m = (m << 1) | (c >> 1);
+            if ((x & 7) == 7) {
+                lsb[x >> 3] = l;
+                msb[x >> 3] = m;
+            }
+        }
+        end_row(msb, dst->stride, dst->width, m);
+    } else {
+        for(int x=0; x<dst->width; ++x) {
+            l = (l << 1) | ((gray[x] + t[x & 3]) >> 8);
+            if ((x & 7) == 7)
+                lsb[x >> 3] = l;
+        }
+    }
+    end_row(lsb, dst->stride, dst->width, l);
+}
+
+
+/* Sierra Lite: the error q of a pixel goes for q/2 to the right, q/4 below left and q/4 below.
+ * err[x+1] holds the error given to pixel x by the previous row, and is replaced by the error for the next row
+ * once read, so that a single row is kept. */
+STATIC void diffusion_row(gfx_dither_t *d, const uint8_t *gray) {
+    const gfx_planes_t *dst = &d->dst;
+    int16_t *err = d->err;
+    uint8_t *lsb = dst->lsb + d->y*dst->stride;
+    uint8_t *msb = dst->msb ? dst->msb + d->y*dst->stride : NULL;
+    unsigned l = 0, m = 0;
+    int right = 0, below = 0;  /* Errors for the next pixel, and for the pixel below it (partial) */
+
+    for(int x=0; x<dst->width; ++x) {
+        int v = gray[x] + right + err[x+1];
+        v = v < 0 ? 0 : v > 255 ? 255 : v;
+        unsigned c;
+        int q;
+        if (msb) {
+            c = (3*v + 128) >> 8;  /* Nearest of 0, 85, 170, 255 */
+            q = v - 85*(int)c;
+            m = (m << 1) | (c >> 1);
+        } else {
+            c = v >> 7;
+            q = c ? v - 255 : v;
+        }
+        l = (l << 1) | (c & 1);
+        if ((x & 7) == 7) {
+            lsb[x >> 3] = l;
+            if (msb)
+                msb[x >> 3] = m;
+        }
+
+        int q4 = q >> 2;
+        err[x] = below + q4;  /* Pixel x-1 of the next row is complete */
+        below = q4;
+        right = q - 2*q4;
+    }
+    err[dst->width] = below;
+
+    end_row(lsb, dst->stride, dst->width, l);
+    if (msb)
+        end_row(msb, dst->stride, dst->width, m);
+}
+
+
+void gfx_dither_begin(gfx_dither_t *d, const gfx_planes_t *dst, gfx_dither_method_t method) {
+    d->dst = *dst;
+    /* The error row is limited, wider planes are dithered with the Bayer matrix */
+    d->method = dst->width > GFX_DITHER_MAX_WIDTH ? GFX_DITHER_ORDERED : method;
+    d->y = 0;
+    memset(d->err, 0, sizeof(d->err));
+}
+
+void gfx_dither_rows(gfx_dither_t *d, const uint8_t *gray, size_t stride, int rows) {
+    for(int j=0; j<rows && d->y < d->dst.height; ++j, ++d->y, gray += stride) {
+        if (d->method == GFX_DITHER_DIFFUSION)
+            diffusion_row(d, gray);
+        else
+            ordered_row(&d->dst, d->y, gray);
+    }
+}
+
+void gfx_dither(const gfx_planes_t *dst, const uint8_t *gray, size_t stride, gfx_dither_method_t method) {
+    gfx_dither_t d;
+    gfx_dither_begin(&d, dst, method);
+    gfx_dither_rows(&d, gray, stride, dst->height);
+}
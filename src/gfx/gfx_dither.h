@@ -0,0 +1,64 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file gfx_dither.h
+ *
+ * \brief Dithering API: convert 8 bits grayscale images to the planes of the screen, on the badge.
+ *
+ * image2epaper.py converts the images at build time. These functions convert the images made at run time
+ * (charts, QR codes, received images, ...) to 4 grays planes (screen_show_image_4g()), or to a black and white plane
+ * when the msb plane of the destination is NULL.
+ *
+ * Grayscale pixels are 1 byte, 0 is black and 255 is white. The image has the size of the destination planes,
+ * and is given whole (\ref gfx_dither) or a few rows at a time (\ref gfx_dither_begin then \ref gfx_dither_rows),
+ * e.g. while it is received or generated, so that it is never stored entirely.
+ *
+ * Two methods:
+ * - ordered dithering with a 4x4 Bayer matrix: each pixel is compared to a threshold that depends on its position,
+ *   which gives regular patterns and does not change the pixels around a change (good for animations),
+ * - error diffusion with the Sierra Lite filter: the quantization error of each pixel is given to its neighbours
+ *   (1/2 right, 1/4 below and 1/4 below left), which gives finer gradients and details.
+ *
+ * Both only use integer additions and shifts (the Cortex-M0+ has no FPU), with a fixed cost per pixel,
+ * and the 8 pixels of a byte are packed in registers before being written. See test_bench() in tests/gfx.c for timings.
+ * */
+
+#ifndef _GFX_DITHER_H
+#define _GFX_DITHER_H
+
+#include "gfx.h"
+
+/** Maximum width of the destination planes for the error diffusion, wider planes use the ordered dithering */
+#define GFX_DITHER_MAX_WIDTH 256
+
+typedef enum {
+    GFX_DITHER_ORDERED,    /**< 4x4 Bayer matrix */
+    GFX_DITHER_DIFFUSION,  /**< Sierra Lite error diffusion */
+} gfx_dither_method_t;
+
+/** \brief State of a conversion given a few rows at a time. */
+typedef struct {
+    gfx_planes_t dst;
+    gfx_dither_method_t method;
+    int y;  /**< Next row of the destination */
+    int16_t err[GFX_DITHER_MAX_WIDTH+1];  /**< Errors given to the next row by the diffusion, err[x+1] for pixel x */
+} gfx_dither_t;
+
+/** \brief Start a conversion to \p dst.
+ *
+ * The bits after the width of the planes on each row are cleared. */
+void gfx_dither_begin(gfx_dither_t *d, const gfx_planes_t *dst, gfx_dither_method_t method);
+
+/** \brief Convert the next rows of the image.
+ *
+ * \param gray      First pixel of the rows, dst->width pixels per row.
+ * \param stride    Bytes between two rows of \p gray.
+ * \param rows      Number of rows, the rows after the height of the planes are ignored. */
+void gfx_dither_rows(gfx_dither_t *d, const uint8_t *gray, size_t stride, int rows);
+
+/** \brief Convert a whole image of dst->width x dst->height pixels. */
+void gfx_dither(const gfx_planes_t *dst, const uint8_t *gray, size_t stride, gfx_dither_method_t method);
+
+#endif /* _GFX_DITHER_H */
@@ -20,10 +20,81 @@ except ImportError:
     sys.exit(1)
 
 
+# Compressed planes (see screen_push_rams_z()): a header [method, length & 0xFF, length >> 8] then the data.
+# The method is chosen per plane, the smallest wins.
+Z_RAW, Z_RLE, Z_LZ = 0, 1, 2
+LZ_WINDOW = 256  # Bytes of history of the decoder, matches are at most this far
+LZ_MIN, LZ_MAX = 3, 258
+
+
+def rle(data):
+    """Run length: c < 128 is followed by c+1 literal bytes, c >= 128 is followed by a byte repeated c-125 times."""
+    out = bytearray()
+    lits = bytearray()
+    def flush_lits():
+        for k in range(0, len(lits), 128):
+            chunk = lits[k:k+128]
+            out.append(len(chunk)-1)
+            out.extend(chunk)
+        lits.clear()
+    i = 0
+    while i < len(data):
+        n = 1
+        while i+n < len(data) and n < 130 and data[i+n] == data[i]:
+            n += 1
+        if n >= 3:
+            flush_lits()
+            out.extend((n+125, data[i]))
+        else:
+            lits.extend(data[i:i+n])
+        i += n
+    flush_lits()
+    return out
+
+
+def lz(data):
+    """LZSS: a flag byte tells, LSB first, whether the next 8 items are a literal byte (1)
+    or a match (0) of 2 bytes: distance-1 and length-LZ_MIN."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        flags_pos = len(out)
+        out.append(0)
+        for bit in range(8):
+            if i >= len(data):
+                break
+            # Greedy longest match in the window
+            best_len, best_dist = 0, 0
+            for j in range(max(0, i-LZ_WINDOW), i):
+                if data[j] != data[i]:
+                    continue
+                n = 1
+                while n < LZ_MAX and i+n < len(data) and data[j+n] == data[i+n]:
+                    n += 1
+                if n > best_len:
+                    best_len, best_dist = n, i-j
+            if best_len >= LZ_MIN:
+                out.extend((best_dist-1, best_len-LZ_MIN))
+                i += best_len
+            else:
+                out[flags_pos] |= 1 << bit
+                out.append(data[i])
+                i += 1
+    return out
+
+
+def compress(data):
+    """Returns the smallest stream among raw, run length and LZSS, with its header."""
+    candidates = [(Z_RAW, bytes(data)), (Z_RLE, rle(data)), (Z_LZ, lz(data))]
+    method, payload = min(candidates, key=lambda c: len(c[1]))
+    return bytes((method, len(data) & 0xFF, len(data) >> 8)) + payload
+
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description='Convert images using PIL to C source')
     parser.add_argument('image', help='path to source image')
     parser.add_argument('--output', '-o', nargs='?', default=None, help='output to this instead of stdout')
+    parser.add_argument('--compress', '-z', action='store_true', help='output compressed planes, named with a _z suffix, to use with screen_push_rams_z()')
     parser.add_argument('--back-color', '-b', nargs='?', type=str, default='11', help='fill color if the image\'s width is not divisible by 8')
     args = parser.parse_args()
 
@@ -44,7 +115,7 @@ if __name__ == "__main__":
         buffer_name = '_'+buffer_name
     eprint('buffer name will be', buffer_name)
 
-    header_name = f'_{buffer_name.upper()}_H'
+    header_name = f'_{buffer_name.upper()}{"_Z" if args.compress else ""}_H'
 
     img = Image.open(args.image)
     if img.palette is None or len(img.palette.colors) not in (2, 4):
@@ -103,31 +174,39 @@ if __name__ == "__main__":
 #include <stddef.h>
 
 /* This is the width of the generated buffer, not the width of the image */
+#ifndef {buffer_name}_width
 #define {buffer_name}_width {w8}
 #define {buffer_name}_height {height}
+#endif
 '''.strip())
 
+    # Buffers are aligned so that the libraries can process them 32 bits at a time
+    def fprint_buffer(name, data):
+        fprint(f'const uint8_t {name}[] __attribute__((aligned(4))) = \\')
+        for j in range(0, len(data), 16):
+            line = ''.join(f'\\x{v:02X}' for v in data[j: j+16])
+            fprint(f'    "{line}" \\')
+        fprint(';')
+
+    # Compressed planes are named with a _z suffix, so that both headers can be included
+    if args.compress:
+        planes = [''] if len(pal.colors) == 2 else ['_lsb', '_msb']
+        fprint()
+        fprint(f'/* {parser.prog} transformed {args.image} in {len(planes)} compressed plane(s) */')
+        for k,suffix in enumerate(planes):
+            z = compress(bufs[k])
+            eprint(f'plane {buffer_name}{suffix}: {len(bufs[k])} -> {len(z)} bytes (method {z[0]})')
+            fprint(f'#define {buffer_name}{suffix}_z_size {len(z)}')
+            fprint_buffer(f'{buffer_name}{suffix}_z', z)
     # Only output the LSB plane when we have 2 colors
-    if len(pal.colors) == 2:
+    elif len(pal.colors) == 2:
         fprint()
         fprint(f'/* {parser.prog} transformed {args.image} in 1 plane */')
-        fprint(f'const uint8_t {buffer_name}[] = \\')
-        for j in range(0, w8*height, 16):
-            line = ''.join(f'\\x{v:02X}' for v in bufs[0][j: j+16])
-            fprint(f'    "{line}" \\')
-        fprint(';')
+        fprint_buffer(buffer_name, bufs[0])
     else:
         fprint()
         fprint(f'/* {parser.prog} transformed {args.image} in 2 planes */')
-        fprint(f'const uint8_t {buffer_name}_lsb[] = \\')
-        for j in range(0, w8*height, 16):
-            line = ''.join(f'\\x{v:02X}' for v in bufs[0][j: j+16])
-            fprint(f'    "{line}" \\')
-        fprint(';')
-        fprint(f'const uint8_t {buffer_name}_msb[] = \\')
-        for j in range(0, w8*height, 16):
-            line = ''.join(f'\\x{v:02X}' for v in bufs[1][j: j+16])
-            fprint(f'    "{line}" \\')
-        fprint(';')
+        fprint_buffer(f'{buffer_name}_lsb', bufs[0])
+        fprint_buffer(f'{buffer_name}_msb', bufs[1])
 
     fprint(f'\n#endif /* {header_name} */')
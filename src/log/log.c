@@ -49,5 +49,6 @@ void log_printf(log_level lev, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
     vprintf(fmt, args);
-    puts(NULL);
+    va_end(args);
+    putchar('\n');
 }
@@ -4,11 +4,109 @@
  * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
 
 
+#include <string.h>
+
+#include "hardware/dma.h"
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
 #include "hardware/spi.h"
+#include "hardware/sync.h"
 #include "pico/binary_info.h"
 
+#include "badge_defs.h"
 #include "radio.h"
+#include "radio_config.h"
+
+
+/* Values of the GDO pins of the receiver and the transmitter (IOCFGx) */
+#define GDO_RX_FIFO_THR 0x00  /* Asserts when the RX FIFO is at or above the threshold */
+#define GDO_TX_FIFO_THR 0x02  /* Asserts when the TX FIFO is at or above the threshold */
+#define GDO_SYNC_WORD 0x06    /* Asserts on the sync word, deasserts at the end of the packet */
+
+/* Registers and their fields */
+#define FIFO_SIZE 64
+#define RXBYTES_OVERFLOW 0x80
+#define RXBYTES_MASK 0x7F
+#define TXBYTES_UNDERFLOW 0x80
+#define TXBYTES_MASK 0x7F
+#define LQI_CRC_OK 0x80
+#define MCSM1_RXOFF_RX 0x0C
+#define MCSM1_TXOFF_MASK 0x03
+#define MCSM1_TXOFF_FSTXON 0x01
+#define PKTCTRL0_LENGTH_MASK 0x03
+#define PKTCTRL0_LENGTH_FIXED 0x00
+#define PKTCTRL0_LENGTH_VARIABLE 0x01
+#define PKTCTRL0_LENGTH_INFINITE 0x02
+
+/* Receiver (see radio_rx_start): the interrupts fill the slot of the ring at rx_head, the application reads the one
+ * at rx_tail. Both are free running indices, each written by a single side. */
+STATIC radio_packet_t rx_ring[RADIO_RX_RING_SIZE];
+STATIC volatile uint32_t rx_head = 0;
+STATIC volatile uint32_t rx_tail = 0;
+STATIC radio_packet_t rx_discard;  /* Receives the packets while the ring is full */
+STATIC radio_packet_t *rx_pkt = NULL;  /* Packet being received, NULL between packets */
+STATIC size_t rx_pos = 0;  /* Bytes of rx_pkt received, the length byte and the 2 status bytes included */
+STATIC radio_rx_stats_t rx_stats;
+STATIC volatile bool rx_running = false;
+
+/* Transmitter (see radio_tx_send): the application queues the frames at tx_head, the interrupts send the one
+ * at tx_tail */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    radio_callback_t done;
+} tx_frame_t;
+STATIC tx_frame_t tx_queue[RADIO_TX_QUEUE_SIZE];
+STATIC volatile uint32_t tx_head = 0;
+STATIC volatile uint32_t tx_tail = 0;
+STATIC size_t tx_written = 0;  /* Bytes of the frame written in the FIFO */
+STATIC bool tx_infinite = false;  /* The frame is in infinite length mode, not switched to fixed length yet */
+/* Registers restored when the queue is empty */
+STATIC uint8_t tx_iocfg0, tx_iocfg2, tx_pktctrl0, tx_pktlen, tx_mcsm1;
+STATIC bool tx_resume_rx = false;  /* The receiver was running, it resumes when the queue is empty */
+STATIC radio_tx_stats_t tx_stats;
+STATIC volatile bool tx_running = false;
+
+
+/* SPI transport.
+ *
+ * Every transaction pulls CSn down, clocks its bytes, then releases CSn. The single accesses (a command strobe, or a
+ * register and its value) run at single_hz, the longer ones at burst_hz (see RADIO_SPI_SINGLE_HZ).
+ * The blocking transactions of DMA_MIN_LEN bytes or more, and all the asynchronous ones, are clocked by two DMA
+ * channels: one feeds the SPI TX FIFO, the other drains the RX FIFO, so that the end of the RX channel is the end of
+ * the transaction. The shorter ones use the SPI FIFO, as setting up the DMA would take longer.
+ *
+ * The asynchronous transactions (radio_send_async) are queued at spi_head and run one after the other from the
+ * DMA_IRQ_0 handler. A blocking transaction first ends the one on the bus (sync_active keeps the handler out of the
+ * way), then gives the bus back to the queue: the callbacks are only called from the handler, which is raised again
+ * when the blocking transaction is done. */
+#define DMA_MIN_LEN 8
+
+typedef struct {
+    const uint8_t *data;
+    uint8_t *response;
+    size_t len;
+    radio_callback_t done;
+} spi_xfer_t;
+STATIC spi_xfer_t spi_queue[RADIO_SPI_QUEUE_SIZE];
+STATIC volatile uint32_t spi_head = 0;
+STATIC volatile uint32_t spi_tail = 0;
+STATIC volatile bool spi_active = false;  /* The transaction at spi_tail is on the bus */
+STATIC volatile bool sync_active = false;  /* A blocking transaction owns the bus */
+STATIC radio_callback_t spi_done = NULL;  /* Of the last asynchronous transaction, not called yet */
+
+STATIC int spi_tx_dma = -1, spi_rx_dma = -1;
+STATIC const uint8_t spi_zero = 0;  /* Sent by the reads */
+STATIC uint8_t spi_sink;  /* Receives what the writes do not keep */
+STATIC uint32_t single_hz = RADIO_SPI_SINGLE_HZ;
+STATIC uint32_t burst_hz = RADIO_SPI_BURST_HZ;
+STATIC uint32_t spi_hz = 0;  /* Currently set */
+
+STATIC bool gdo_irq_added = false;
+
+STATIC void spi_irq(void);
+STATIC void gdo_irq(void);
+STATIC void add_gdo_irq(void);
 
 
 void radio_init(void) {
@@ -18,7 +116,7 @@ void radio_init(void) {
     bi_decl_if_func_used(bi_1pin_with_name(BADGE_RADIO_GDO2, "CC1101 GDO2"));
 
     // Init SPI
-    spi_init(spi1, 1000*1000);  /* Should go up to 10MHz */
+    spi_init(spi1, single_hz);
     gpio_set_function(BADGE_SPI1_TX_MOSI_RADIO_SI, GPIO_FUNC_SPI);
     gpio_set_function(BADGE_SPI1_RX_MISO_RADIO_SO, GPIO_FUNC_SPI);
     gpio_set_function(BADGE_SPI1_SCK_RADIO, GPIO_FUNC_SPI);
@@ -32,6 +130,16 @@ void radio_init(void) {
     gpio_set_dir(BADGE_SPI1_CSn_RADIO, GPIO_OUT);
     gpio_init(BADGE_RADIO_GDO0);
     gpio_init(BADGE_RADIO_GDO2);
+
+    // Init the DMA of the transactions (configured by each transaction), the end of the RX channel ends them
+    if (spi_rx_dma < 0) {
+        spi_tx_dma = dma_claim_unused_channel(true);
+        spi_rx_dma = dma_claim_unused_channel(true);
+        dma_channel_set_irq0_enabled(spi_rx_dma, true);
+        irq_add_shared_handler(DMA_IRQ_0, spi_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+    }
+    spi_hz = single_hz;
 }
 
 
@@ -46,28 +154,463 @@ void radio_boot(void) {
 }
 
 
-/** \brief SPI read/write pulling CSn down for the whole transaction, \p response can be NULL
- *
- * We chose to block until the \p len bytes are written, as the communication is fast (~1MHz)
- *
- * TODO: static or not? */
-void radio_send(const uint8_t *data, uint8_t *response, size_t len) {
+STATIC void set_clock(size_t len) {
+    uint32_t hz = len <= 2 ? single_hz : burst_hz;
+    if (hz != spi_hz) {
+        spi_set_baudrate(spi1, hz);
+        spi_hz = hz;
+    }
+}
+
+/* Starts clocking len bytes from data (zeros when NULL) to response (dropped when NULL), CSn is already low */
+STATIC void dma_start(const uint8_t *data, uint8_t *response, size_t len) {
+    dma_channel_config c = dma_channel_get_default_config(spi_rx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(spi1, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, response != NULL);
+    dma_channel_configure(spi_rx_dma, &c, response ? response : &spi_sink, &spi_get_hw(spi1)->dr, len, false);
+
+    c = dma_channel_get_default_config(spi_tx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(spi1, true));
+    channel_config_set_read_increment(&c, data != NULL);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(spi_tx_dma, &c, &spi_get_hw(spi1)->dr, data ? data : &spi_zero, len, false);
+
+    /* Both at once, the RX channel must not miss the first byte */
+    dma_start_channel_mask((1u << spi_rx_dma) | (1u << spi_tx_dma));
+}
+
+/* Clocks len bytes, CSn is already low, returns when they are all received */
+STATIC void clock_bytes(const uint8_t *data, uint8_t *response, size_t len) {
+    if (len < DMA_MIN_LEN) {
+        if (data && response)
+            spi_write_read_blocking(spi1, data, response, len);
+        else if (data)
+            spi_write_blocking(spi1, data, len);
+        else
+            spi_read_blocking(spi1, 0x00, response, len);
+        return;
+    }
+    dma_start(data, response, len);
+    while(dma_channel_is_busy(spi_rx_dma))
+        tight_loop_contents();
+}
+
+
+/* Starts the next asynchronous transaction, if the bus is free */
+STATIC void spi_next(void) {
+    if (spi_active || sync_active || spi_head == spi_tail)
+        return;
+    const spi_xfer_t *x = &spi_queue[spi_tail % RADIO_SPI_QUEUE_SIZE];
+    set_clock(x->len);
+    spi_active = true;
     gpio_put(BADGE_SPI1_CSn_RADIO, 0);
-    if (response)
-        spi_write_read_blocking(spi1, data, response, len);
-    else
-        spi_write_blocking(spi1, data, len);
+    dma_start(x->data, x->response, x->len);
+}
+
+/* The asynchronous transaction is clocked: release the bus, its callback is called by the handler */
+STATIC void spi_end(void) {
     gpio_put(BADGE_SPI1_CSn_RADIO, 1);
+    spi_done = spi_queue[spi_tail % RADIO_SPI_QUEUE_SIZE].done;
+    spi_tail = spi_tail + 1;
+    spi_active = false;
 }
 
-/** \brief Helper to burst read registers
- * TODO: static or not ?*/
-void radio_burst_read(uint8_t reg, uint8_t *response, size_t len) {
+/* DMA_IRQ_0 handler, shared with other libraries. Also raised by sync_end. */
+STATIC void spi_irq(void) {
+    if (dma_channel_get_irq0_status(spi_rx_dma))
+        dma_channel_acknowledge_irq0(spi_rx_dma);
+    if (sync_active)
+        return;  /* Its own transfer, or an interrupted blocking transaction which ends the asynchronous one */
+
+    if (spi_active && ! dma_channel_is_busy(spi_rx_dma))
+        spi_end();
+    radio_callback_t done = spi_done;
+    spi_done = NULL;
+    spi_next();
+    if (done)
+        done();
+}
+
+/* Takes the bus for a blocking transaction: waits for the asynchronous one to be clocked, and ends it.
+ * Blocking transactions do not nest: the GDO interrupt is masked during the ones of the application (see lock) */
+STATIC void sync_begin(void) {
+    hard_assert(! sync_active);
+    sync_active = true;
+    __compiler_memory_barrier();
+    if (spi_active) {
+        while(dma_channel_is_busy(spi_rx_dma))
+            tight_loop_contents();
+        spi_end();
+    }
+}
+
+/* Gives the bus back to the queue, the handler calls the pending callback and starts the next transaction */
+STATIC void sync_end(void) {
+    sync_active = false;
+    __compiler_memory_barrier();
+    if (spi_done || spi_head != spi_tail)
+        irq_set_pending(DMA_IRQ_0);
+}
+
+
+STATIC void transfer(const uint8_t *data, uint8_t *response, size_t len) {
+    radio_config_track(data[0], data+1, len-1);
+    sync_begin();
+    set_clock(len);
+    gpio_put(BADGE_SPI1_CSn_RADIO, 0);
+    clock_bytes(data, response, len);
+    gpio_put(BADGE_SPI1_CSn_RADIO, 1);
+    sync_end();
+}
+
+STATIC void burst_read(uint8_t reg, uint8_t *response, size_t len) {
     uint8_t cmd = CC1101_BURST(CC1101_READ(reg));
+    sync_begin();
+    set_clock(1+len);
+    gpio_put(BADGE_SPI1_CSn_RADIO, 0);
+    spi_write_blocking(spi1, &cmd, 1);
+    clock_bytes(NULL, response, len);
+    gpio_put(BADGE_SPI1_CSn_RADIO, 1);
+    sync_end();
+}
+
+STATIC void burst_write(uint8_t reg, const uint8_t *data, size_t len) {
+    uint8_t cmd = CC1101_BURST(reg);
+    radio_config_track(cmd, data, len);
+    sync_begin();
+    set_clock(1+len);
     gpio_put(BADGE_SPI1_CSn_RADIO, 0);
     spi_write_blocking(spi1, &cmd, 1);
-    spi_read_blocking(spi1, 0x00, response, len);
+    clock_bytes(data, NULL, len);
     gpio_put(BADGE_SPI1_CSn_RADIO, 1);
+    sync_end();
+}
+
+
+/* The transfers of the application are not interleaved with the ones of the receiver and transmitter interrupts.
+ * The interrupt is always masked in the NVIC, as a callback may start the transmitter meanwhile: the GPIO edges stay
+ * latched and are handled afterwards. The locks nest (a callback of the DMA interrupt may take one in between),
+ * only the outermost unlock enables the interrupt again. */
+STATIC volatile uint8_t locks = 0;
+
+STATIC bool lock(void) {
+    bool enabled = irq_is_enabled(IO_IRQ_BANK0);
+    irq_set_enabled(IO_IRQ_BANK0, false);
+    ++locks;
+    return enabled;
+}
+
+STATIC void unlock(bool enabled) {
+    if (--locks == 0 && (enabled || rx_running || tx_running))
+        irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void radio_send(const uint8_t *data, uint8_t *response, size_t len) {
+    bool enabled = lock();
+    transfer(data, response, len);
+    unlock(enabled);
+}
+
+void radio_burst_read(uint8_t reg, uint8_t *response, size_t len) {
+    bool enabled = lock();
+    burst_read(reg, response, len);
+    unlock(enabled);
+}
+
+
+bool radio_send_async(const uint8_t *data, uint8_t *response, size_t len, radio_callback_t done) {
+    if (len == 0)
+        return false;
+
+    /* Also from the callbacks, in the interrupt */
+    uint32_t save = save_and_disable_interrupts();
+    bool queued = spi_head - spi_tail < RADIO_SPI_QUEUE_SIZE;
+    if (queued) {
+        spi_xfer_t *x = &spi_queue[spi_head % RADIO_SPI_QUEUE_SIZE];
+        x->data = data;
+        x->response = response;
+        x->len = len;
+        x->done = done;
+        spi_head = spi_head + 1;
+        radio_config_track(data[0], data+1, len-1);
+        spi_next();
+    }
+    restore_interrupts(save);
+
+    return queued;
+}
+
+
+bool radio_spi_busy(void) {
+    return spi_head != spi_tail || spi_done;
+}
+
+
+void radio_set_spi_clocks(uint32_t single, uint32_t burst) {
+    sync_begin();
+    single_hz = single;
+    burst_hz = burst;
+    spi_hz = 0;
+    sync_end();
+}
+
+
+STATIC void strobe(uint8_t cmd) {
+    transfer(&cmd, NULL, 1);
+}
+
+STATIC void write_reg(uint8_t reg, uint8_t value) {
+    uint8_t cmd[2] = {reg, value};
+    transfer(cmd, NULL, 2);
+}
+
+STATIC uint8_t read_reg(uint8_t reg) {
+    uint8_t cmd[2] = {CC1101_READ(reg), 0}, resp[2];
+    transfer(cmd, resp, 2);
+    return resp[1];
+}
+
+/* RXBYTES and TXBYTES may be wrong when read while they change, they are read until two reads agree (CC1101 errata) */
+STATIC uint8_t fifo_bytes(uint8_t reg) {
+    uint8_t n, prev;
+    burst_read(reg, &n, 1);
+    do {
+        prev = n;
+        burst_read(reg, &n, 1);
+    } while(n != prev);
+    return n;
+}
+
+
+/* Start of a packet, in the ring or discarded when the ring is full */
+STATIC void rx_begin(void) {
+    rx_pkt = rx_head - rx_tail < RADIO_RX_RING_SIZE ? &rx_ring[rx_head % RADIO_RX_RING_SIZE] : &rx_discard;
+    rx_pos = 0;
+}
+
+/* The bytes of the FIFO are: the length, the data, the RSSI, then the LQI with the CRC_OK bit */
+STATIC void rx_put(const uint8_t *buf, size_t n) {
+    for(size_t i=0; i<n; ++i, ++rx_pos) {
+        if (rx_pos == 0)
+            rx_pkt->len = buf[i];
+        else if (rx_pos <= rx_pkt->len)
+            rx_pkt->data[rx_pos-1] = buf[i];
+        else if (rx_pos == rx_pkt->len+1u)
+            rx_pkt->rssi = (int8_t)buf[i]/2 - RADIO_RSSI_OFFSET;
+        else if (rx_pos == rx_pkt->len+2u) {
+            rx_pkt->lqi = buf[i] & ~LQI_CRC_OK;
+            rx_pkt->crc_ok = buf[i] & LQI_CRC_OK;
+        }
+    }
+}
+
+/* Reads n bytes of the RX FIFO, 64 at most by burst */
+STATIC void rx_drain(size_t n) {
+    uint8_t buf[64];
+    if (! rx_pkt)
+        rx_begin();  /* The edge of the sync word was missed */
+    while(n) {
+        size_t len = n < sizeof(buf) ? n : sizeof(buf);
+        burst_read(CC1101_RXFIFO, buf, len);
+        rx_put(buf, len);
+        n -= len;
+    }
+}
+
+/* The packet is lost: flush the FIFO (valid in RXFIFO_OVERFLOW) and receive again */
+STATIC void rx_restart(void) {
+    ++rx_stats.overflows;
+    rx_pkt = NULL;
+    strobe(CC1101_SIDLE);
+    strobe(CC1101_SFRX);
+    strobe(CC1101_SRX);
+}
+
+/* End of the packet: the rest of the FIFO is the end of this packet */
+STATIC void rx_end(void) {
+    uint8_t n = fifo_bytes(CC1101_RXBYTES);
+    if (n & RXBYTES_OVERFLOW) {
+        rx_restart();
+        return;
+    }
+    rx_drain(n & RXBYTES_MASK);
+
+    if (rx_pos == 0) {
+        /* Nothing received, e.g. the packet was flushed by the CRC autoflush */
+    } else if (rx_pos != rx_pkt->len+3u) {
+        ++rx_stats.overflows;
+    } else if (rx_pkt == &rx_discard) {
+        ++rx_stats.dropped;
+    } else {
+        ++rx_stats.packets;
+        if (! rx_pkt->crc_ok)
+            ++rx_stats.crc_errors;
+        __dmb();  /* The packet is written before it is published */
+        rx_head = rx_head + 1;
+    }
+    rx_pkt = NULL;
+}
+
+/* Edges of GDO0 and GDO2 while receiving, in the order they happen in a packet */
+STATIC void rx_irq(void) {
+    uint32_t gdo0 = gpio_get_irq_event_mask(BADGE_RADIO_GDO0);
+    uint32_t gdo2 = gpio_get_irq_event_mask(BADGE_RADIO_GDO2);
+
+    if (gdo0 & GPIO_IRQ_EDGE_RISE) {
+        gpio_acknowledge_irq(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_RISE);
+        rx_begin();
+    }
+    if (gdo2 & GPIO_IRQ_EDGE_RISE) {
+        gpio_acknowledge_irq(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_RISE);
+        /* Leave a byte in the FIFO until the end of the packet */
+        uint8_t n = fifo_bytes(CC1101_RXBYTES);
+        if (n & RXBYTES_OVERFLOW)
+            rx_restart();
+        else if ((n & RXBYTES_MASK) > 1)
+            rx_drain((n & RXBYTES_MASK) - 1);
+    }
+    if (gdo0 & GPIO_IRQ_EDGE_FALL) {
+        gpio_acknowledge_irq(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_FALL);
+        if (rx_pkt)
+            rx_end();
+    }
+}
+
+
+/* From IDLE: the GDO pins and the state after a packet of the receiver, then RX */
+STATIC void rx_enter(void) {
+    write_reg(CC1101_IOCFG0, GDO_SYNC_WORD);
+    write_reg(CC1101_IOCFG2, GDO_RX_FIFO_THR);
+    write_reg(CC1101_MCSM1, read_reg(CC1101_MCSM1) | MCSM1_RXOFF_RX);
+    strobe(CC1101_SFRX);
+
+    rx_pkt = NULL;
+    add_gdo_irq();
+    gpio_set_irq_enabled(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+    gpio_set_irq_enabled(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_RISE, true);
+
+    rx_running = true;
+    strobe(CC1101_SRX);
+}
+
+
+/* Writes the next bytes of the frame in the free space of the TX FIFO */
+STATIC void tx_fill(void) {
+    const tx_frame_t *f = &tx_queue[tx_tail % RADIO_TX_QUEUE_SIZE];
+    size_t space = FIFO_SIZE - (fifo_bytes(CC1101_TXBYTES) & TXBYTES_MASK);
+    size_t len = f->len - tx_written < space ? f->len - tx_written : space;
+    if (len) {
+        burst_write(CC1101_TXFIFO, f->data + tx_written, len);
+        tx_written += len;
+    }
+
+    /* At most 64 written bytes are still in the FIFO: when less than 256 bytes are left to send for sure,
+     * the packet ends at the next multiple of 256 bytes plus PKTLEN */
+    if (tx_infinite && tx_written + 256 - FIFO_SIZE > f->len) {
+        write_reg(CC1101_PKTCTRL0, (tx_pktctrl0 & ~PKTCTRL0_LENGTH_MASK) | PKTCTRL0_LENGTH_FIXED);
+        tx_infinite = false;
+    }
+}
+
+/* Starts sending the frame at tx_tail, from IDLE or FSTXON */
+STATIC void tx_begin(void) {
+    const tx_frame_t *f = &tx_queue[tx_tail % RADIO_TX_QUEUE_SIZE];
+    tx_written = 0;
+    tx_infinite = f->len > RADIO_PACKET_MAX_LEN;
+    if (tx_infinite) {
+        write_reg(CC1101_PKTLEN, f->len & 0xFF);
+        write_reg(CC1101_PKTCTRL0, (tx_pktctrl0 & ~PKTCTRL0_LENGTH_MASK) | PKTCTRL0_LENGTH_INFINITE);
+    } else {
+        uint8_t len = f->len;
+        write_reg(CC1101_PKTCTRL0, (tx_pktctrl0 & ~PKTCTRL0_LENGTH_MASK) | PKTCTRL0_LENGTH_VARIABLE);
+        burst_write(CC1101_TXFIFO, &len, 1);
+    }
+    tx_fill();
+    strobe(CC1101_STX);
+}
+
+/* The queue is empty: restore the configuration, and the receiver */
+STATIC void tx_finish(void) {
+    strobe(CC1101_SIDLE);
+    write_reg(CC1101_IOCFG0, tx_iocfg0);
+    write_reg(CC1101_IOCFG2, tx_iocfg2);
+    write_reg(CC1101_PKTCTRL0, tx_pktctrl0);
+    write_reg(CC1101_PKTLEN, tx_pktlen);
+    write_reg(CC1101_MCSM1, tx_mcsm1);
+    gpio_set_irq_enabled(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_FALL, false);
+    tx_running = false;
+
+    if (tx_resume_rx) {
+        rx_enter();
+    } else {
+        /* GDO0 may carry anything now, e.g. the data in asynchronous serial mode */
+        gpio_set_irq_enabled(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
+    }
+}
+
+/* End of the packet: the next frame, if any */
+STATIC void tx_end(void) {
+    const tx_frame_t *f = &tx_queue[tx_tail % RADIO_TX_QUEUE_SIZE];
+    if ((fifo_bytes(CC1101_TXBYTES) & TXBYTES_UNDERFLOW) || tx_written < f->len) {
+        ++tx_stats.underflows;
+        strobe(CC1101_SFTX);  /* Valid in TXFIFO_UNDERFLOW, then IDLE */
+    } else {
+        ++tx_stats.frames;
+        tx_stats.bytes += f->len;
+    }
+
+    radio_callback_t done = f->done;
+    tx_tail = tx_tail + 1;
+    if (tx_head != tx_tail)
+        tx_begin();
+    else
+        tx_finish();
+    if (done)
+        done();
+}
+
+/* Edges of GDO0 and GDO2 while sending */
+STATIC void tx_irq(void) {
+    uint32_t gdo0 = gpio_get_irq_event_mask(BADGE_RADIO_GDO0);
+    uint32_t gdo2 = gpio_get_irq_event_mask(BADGE_RADIO_GDO2);
+
+    if (gdo0 & GPIO_IRQ_EDGE_RISE)
+        gpio_acknowledge_irq(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_RISE);  /* Sync word sent */
+    if (gdo2 & GPIO_IRQ_EDGE_FALL) {
+        gpio_acknowledge_irq(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_FALL);
+        tx_fill();
+    }
+    if (gdo0 & GPIO_IRQ_EDGE_FALL) {
+        gpio_acknowledge_irq(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_FALL);
+        tx_end();
+    }
+}
+
+/* Raw GPIO handler, shared with the other GPIOs */
+STATIC void gdo_irq(void) {
+    if (tx_running)
+        tx_irq();
+    else if (rx_running)
+        rx_irq();
+
+    /* The edges that the engine now running does not handle (e.g. latched while it stopped) are acknowledged,
+     * otherwise the raw handler would be called again forever */
+    uint32_t gdo0 = tx_running || rx_running ? GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL : 0;
+    uint32_t gdo2 = tx_running ? GPIO_IRQ_EDGE_FALL : rx_running ? GPIO_IRQ_EDGE_RISE : 0;
+    gpio_acknowledge_irq(BADGE_RADIO_GDO0, gpio_get_irq_event_mask(BADGE_RADIO_GDO0) & ~gdo0);
+    gpio_acknowledge_irq(BADGE_RADIO_GDO2, gpio_get_irq_event_mask(BADGE_RADIO_GDO2) & ~gdo2);
+}
+
+STATIC void add_gdo_irq(void) {
+    gpio_set_dir(BADGE_RADIO_GDO0, GPIO_IN);
+    gpio_set_dir(BADGE_RADIO_GDO2, GPIO_IN);
+    if (! gdo_irq_added) {
+        gpio_add_raw_irq_handler_masked((1u << BADGE_RADIO_GDO0) | (1u << BADGE_RADIO_GDO2), gdo_irq);
+        gdo_irq_added = true;
+    }
 }
 
 
@@ -88,3 +631,125 @@ void radio_set_frequency(uint32_t freq_hz) {
 }
 
 
+
+void radio_rx_start(void) {
+    /* tx_finish reads tx_resume_rx from the interrupt once the transmitter is done */
+    bool enabled = lock();
+    if (! rx_running && ! tx_resume_rx) {
+        memset(&rx_stats, 0, sizeof(rx_stats));
+        if (tx_running) {
+            /* Started by tx_finish when the queue is empty */
+            tx_resume_rx = true;
+        } else {
+            strobe(CC1101_SIDLE);
+            rx_enter();
+        }
+    }
+    unlock(enabled);
+}
+
+
+void radio_rx_stop(void) {
+    tx_resume_rx = false;
+    if (! rx_running)
+        return;
+
+    gpio_set_irq_enabled(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
+    gpio_set_irq_enabled(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_RISE, false);
+    rx_running = false;
+    rx_pkt = NULL;
+    strobe(CC1101_SIDLE);
+    strobe(CC1101_SFRX);
+}
+
+
+bool radio_rx_get(radio_packet_t *pkt) {
+    uint32_t tail = rx_tail;
+    if (rx_head == tail)
+        return false;
+    __dmb();  /* The packet is read after it was published */
+    const radio_packet_t *slot = &rx_ring[tail % RADIO_RX_RING_SIZE];
+    pkt->len = slot->len;
+    memcpy(pkt->data, slot->data, slot->len);
+    pkt->rssi = slot->rssi;
+    pkt->lqi = slot->lqi;
+    pkt->crc_ok = slot->crc_ok;
+    __dmb();  /* The slot is read before it is given back */
+    rx_tail = tail + 1;
+    return true;
+}
+
+
+size_t radio_rx_available(void) {
+    return rx_head - rx_tail;
+}
+
+
+radio_rx_stats_t radio_rx_stats(void) {
+    bool enabled = lock();
+    radio_rx_stats_t stats = rx_stats;
+    unlock(enabled);
+    return stats;
+}
+
+
+/* Called with the GPIO interrupts masked */
+STATIC void tx_start(void) {
+    tx_resume_rx = rx_running;
+    rx_running = false;
+    rx_pkt = NULL;
+    strobe(CC1101_SIDLE);
+
+    tx_iocfg0 = read_reg(CC1101_IOCFG0);
+    tx_iocfg2 = read_reg(CC1101_IOCFG2);
+    tx_pktctrl0 = read_reg(CC1101_PKTCTRL0);
+    tx_pktlen = read_reg(CC1101_PKTLEN);
+    tx_mcsm1 = read_reg(CC1101_MCSM1);
+    write_reg(CC1101_IOCFG0, GDO_SYNC_WORD);
+    write_reg(CC1101_IOCFG2, GDO_TX_FIFO_THR);
+    write_reg(CC1101_MCSM1, (tx_mcsm1 & ~MCSM1_TXOFF_MASK) | MCSM1_TXOFF_FSTXON);
+    strobe(CC1101_SFTX);
+
+    add_gdo_irq();
+    gpio_set_irq_enabled(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_RISE, false);
+    gpio_set_irq_enabled(BADGE_RADIO_GDO0, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+    gpio_set_irq_enabled(BADGE_RADIO_GDO2, GPIO_IRQ_EDGE_FALL, true);
+
+    tx_running = true;
+    tx_begin();
+}
+
+
+bool radio_tx_send(const uint8_t *data, size_t len, radio_callback_t done) {
+    if (len == 0 || len > 0xFFFF)
+        return false;
+
+    /* Also from the callbacks, in the interrupt */
+    bool enabled = lock();
+    bool queued = tx_head - tx_tail < RADIO_TX_QUEUE_SIZE;
+    if (queued) {
+        tx_frame_t *f = &tx_queue[tx_head % RADIO_TX_QUEUE_SIZE];
+        f->data = data;
+        f->len = len;
+        f->done = done;
+        tx_head = tx_head + 1;
+        if (! tx_running)
+            tx_start();
+    }
+    unlock(enabled);
+
+    return queued;
+}
+
+
+bool radio_tx_busy(void) {
+    return tx_running;
+}
+
+
+radio_tx_stats_t radio_tx_stats(void) {
+    bool enabled = lock();
+    radio_tx_stats_t stats = tx_stats;
+    unlock(enabled);
+    return stats;
+}
@@ -10,7 +10,6 @@
  * TODO:
  * - homogeneize static functions and their names with other libs (send is send in screen but radio_send here),
  * - decide whether print_status and its could be macros could be useful for others (e.g. debug),
- * - decide radio_burst_read,
  * - provide a state_then_wait or accessors to change states,
  * - lock on a messaging protocol and provide methods for that.
  * */
@@ -18,6 +17,10 @@
 #ifndef _RADIO_H
 #define _RADIO_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "badge_pinout.h"
 
 // Redefine pins while we test on Pico W because some pins are not exposed (23 for GD0 and 24,25 for SPI1)
@@ -39,6 +42,60 @@ void radio_init(void);
 /** \brief Boot the radio module (or wake from deep sleep) */
 void radio_boot(void);
 
+
+/* SPI transport.
+ *
+ * The CC1101 accepts single accesses (a command strobe, or a register and its value) up to 9MHz, and burst accesses
+ * up to 6.5MHz, without delays between the bytes (datasheet, table 22). The 10MHz of the single accesses need
+ * 100ns between the address and the data, which the SPI peripheral does not insert: the transport stays below.
+ * The transactions of 1 and 2 bytes run at the single clock, the longer ones at the burst clock
+ * (the SPI divides 125MHz by an even number: 8.9MHz and 6.25MHz).
+ *
+ * radio_send() and radio_burst_read() block until the transaction is clocked, the longer transactions are clocked
+ * by the DMA. radio_send_async() queues transactions that the DMA runs in the background, one after the other,
+ * and calls back at the end of each. The blocking transactions (including the ones of the receiver and the
+ * transmitter interrupts) wait for the asynchronous one on the bus, if any, and then take the bus.
+ * See bench_spi() in tests/radio.c for the latencies. */
+
+/** Clock of the single accesses, in Hz */
+#define RADIO_SPI_SINGLE_HZ 9000000
+
+/** Clock of the burst accesses, in Hz */
+#define RADIO_SPI_BURST_HZ 6500000
+
+/** Number of asynchronous transactions waiting to be clocked */
+#define RADIO_SPI_QUEUE_SIZE 4
+
+/** \brief Callback of the transport, of the transmitter, ...
+ *
+ * Called from an interrupt handler: keep it short, but you can queue other transactions or frames from there. */
+typedef void (*radio_callback_t)(void);
+
+/** \brief SPI read/write pulling CSn down for the whole transaction, \p response can be NULL.
+ *
+ * Blocks until the \p len bytes are clocked. */
+void radio_send(const uint8_t *data, uint8_t *response, size_t len);
+
+/** \brief Burst read \p len registers (or bytes of the RX FIFO) from \p reg. */
+void radio_burst_read(uint8_t reg, uint8_t *response, size_t len);
+
+/** \brief Queue a transaction, does not block.
+ *
+ * \param data      Is not copied: it must not change until the transaction is clocked.
+ * \param response  Receives the \p len bytes clocked in, can be NULL.
+ * \param done      Called when the transaction is clocked, can be NULL.
+ * \return false if the queue is full. */
+bool radio_send_async(const uint8_t *data, uint8_t *response, size_t len, radio_callback_t done);
+
+/** \brief Whether asynchronous transactions are queued, or their callbacks not called yet. */
+bool radio_spi_busy(void);
+
+/** \brief Change the clocks of the single and of the burst accesses, e.g. for benchmarks.
+ *
+ * Above RADIO_SPI_SINGLE_HZ and RADIO_SPI_BURST_HZ, the CC1101 may not read or answer correctly. */
+void radio_set_spi_clocks(uint32_t single_hz, uint32_t burst_hz);
+
+
 /** \brief Sets the frequency (in Hz) of the transmission
  *
  * Must be < 1.6GHz.
@@ -46,6 +103,106 @@ void radio_boot(void);
 void radio_set_frequency(uint32_t freq_hz);
 
 
+/* Packet receiver.
+ *
+ * The receiver works with a packet mode configuration in variable length (the first byte after the sync word
+ * is the length) with the status bytes appended (PKTCTRL1.APPEND_STATUS, the default), e.g. conf_gfsk999 in
+ * tests/radio.c. It is driven by the edges of the GDO pins, which radio_rx_start() configures:
+ * - GDO0 rises when the sync word is received and falls at the end of the packet (or when it is lost),
+ * - GDO2 rises when the RX FIFO reaches the threshold of FIFOTHR, so that packets longer than the 64 bytes
+ *   of the FIFO are drained while they are received.
+ * The interrupts read the FIFO with burst reads into a ring of packets, which the application reads without blocking
+ * with radio_rx_get(). The RX FIFO is never emptied while receiving (see the CC1101 errata).
+ *
+ * radio_send() and radio_burst_read() mask the GPIO interrupts during their transfers, so that they do not interleave
+ * with the ones of the interrupts, even when a callback starts the receiver or the transmitter meanwhile. */
+
+/** Maximum length of a packet, the length byte is 8 bits */
+#define RADIO_PACKET_MAX_LEN 255
+
+/** Number of received packets that wait to be read with \ref radio_rx_get */
+#define RADIO_RX_RING_SIZE 8
+
+/** RSSI offset of the CC1101 around 433MHz (datasheet, table 31), in dB */
+#define RADIO_RSSI_OFFSET 74
+
+/** \brief A received packet. */
+typedef struct {
+    uint8_t len;
+    uint8_t data[RADIO_PACKET_MAX_LEN];
+    int16_t rssi;   /**< Signal strength during the packet, in dBm */
+    uint8_t lqi;    /**< Link quality indicator, the lower the better */
+    bool crc_ok;
+} radio_packet_t;
+
+/** \brief Counters of the receiver, since \ref radio_rx_start. */
+typedef struct {
+    uint32_t packets;     /**< Put in the ring, with a good or a bad CRC */
+    uint32_t crc_errors;  /**< Packets of the ring with a bad CRC */
+    uint32_t dropped;     /**< Received while the ring was full, lost */
+    uint32_t overflows;   /**< RX FIFO overflows and truncated packets, lost */
+} radio_rx_stats_t;
+
+/** \brief Start receiving packets, in the current configuration.
+ *
+ * Sets GDO0 and GDO2 (IOCFG0 and IOCFG2), stays in RX after a packet (MCSM1.RXOFF_MODE), flushes the RX FIFO
+ * and goes to RX. */
+void radio_rx_start(void);
+
+/** \brief Stop receiving, go to IDLE. The packets of the ring can still be read. */
+void radio_rx_stop(void);
+
+/** \brief Get the oldest received packet, does not block.
+ *
+ * \return false if there is no packet. */
+bool radio_rx_get(radio_packet_t *pkt);
+
+/** \brief Number of packets waiting in the ring. */
+size_t radio_rx_available(void);
+
+/** \brief Counters of the receiver. */
+radio_rx_stats_t radio_rx_stats(void);
+
+
+/* Packet transmitter.
+ *
+ * Frames are queued with radio_tx_send() and sent one after the other, in the frequency and modulation of the
+ * current configuration. The TX FIFO is refilled while the packet is sent, from the edges of the GDO pins:
+ * - GDO2 falls when the TX FIFO goes below the threshold of FIFOTHR (33 bytes with conf_gfsk999),
+ * - GDO0 falls at the end of the packet, then the next frame is sent.
+ * Between the frames of the queue, the synthesizer stays on (MCSM1.TXOFF_MODE is FSTXON), so that there is
+ * no calibration. The configuration is restored when the queue is empty, and the receiver resumes if it was running.
+ *
+ * Frames of up to 255 bytes are sent in variable length mode: the length byte is sent first, as tx_chat_flipper()
+ * in tests/radio.c does. Longer frames are sent without the length byte in infinite length mode, which is switched
+ * to fixed length (PKTLEN is the length modulo 256) before the last 256 bytes (see TI DN500):
+ * the receiver must know their length. */
+
+/** Number of frames waiting to be sent */
+#define RADIO_TX_QUEUE_SIZE 8
+
+/** \brief Counters of the transmitter. */
+typedef struct {
+    uint32_t frames;      /**< Sent */
+    uint32_t bytes;       /**< Of the frames sent, without the length bytes */
+    uint32_t underflows;  /**< Frames interrupted because the TX FIFO was not refilled in time */
+} radio_tx_stats_t;
+
+/** \brief Queue a frame, and start sending if nothing is being sent.
+ *
+ * \param data  Is not copied: it must not change until the frame is sent.
+ * \param len   Between 1 and 65535 bytes.
+ * \param done  Called when the frame is sent (or lost in an underflow), can be NULL.
+ * \return false if the queue is full. */
+bool radio_tx_send(const uint8_t *data, size_t len, radio_callback_t done);
+
+/** \brief Whether frames are being sent. */
+bool radio_tx_busy(void);
+
+/** \brief Counters of the transmitter. */
+radio_tx_stats_t radio_tx_stats(void);
+
+
 #ifndef CC1101_fXOSC
 /** \brief Define the CC1101 cristal frequency, which we can calibrate with radio_calibrate.c and .py */
 #define CC1101_fXOSC 26000000
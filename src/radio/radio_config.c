@@ -0,0 +1,283 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "badge_defs.h"
+#include "radio.h"
+#include "radio_config.h"
+
+
+#define BIT(reg) ((uint64_t)1 << (reg))
+#define ALL_REGS (BIT(RADIO_CONFIG_REGS) - 1)
+#define ALL_PATABLE ((1u << RADIO_PATABLE_LEN) - 1)
+/* Written by the calibration of the frequency synthesizer */
+#define CALIBRATED (BIT(CC1101_FSCAL3) | BIT(CC1101_FSCAL2) | BIT(CC1101_FSCAL1))
+/* For test only, must not be written */
+#define NOT_WRITTEN (BIT(CC1101_FSTEST) | BIT(CC1101_AGCTEST))
+/* Lost in SLEEP (datasheet, section 29.3), with the PATABLE except its first byte */
+#define LOST_IN_SLEEP (BIT(CC1101_FSTEST) | BIT(CC1101_PTEST) | BIT(CC1101_AGCTEST) | BIT(CC1101_TEST2) \
+                       | BIT(CC1101_TEST1) | BIT(CC1101_TEST0))
+
+#define MCSM0_FS_AUTOCAL_MASK 0x30
+#define MARCSTATE_MASK 0x1F
+#define MARCSTATE_IDLE 0x01
+
+/* Reset values (datasheet, table 43) */
+STATIC const radio_config_t reset_config = {
+    .regs = {
+        0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04,  /* IOCFG2 to PKTCTRL1 */
+        0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,  /* PKTCTRL0 to FREQ0 */
+        0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30,  /* MDMCFG4 to MCSM1 */
+        0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,  /* MCSM0 to WOREVT0 */
+        0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41,  /* WORCTRL to RCCTRL1 */
+        0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B,        /* RCCTRL0 to TEST0 */
+    },
+    .patable = {0xC6, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/* The last values written to the chip, for the registers (and the bytes of the PATABLE) marked as known */
+STATIC radio_config_t shadow;
+STATIC uint64_t shadow_known = 0;
+STATIC uint8_t patable_known = 0;
+
+
+void radio_config_defaults(radio_config_t *cfg) {
+    *cfg = reset_config;
+}
+
+
+bool radio_config_compile(radio_config_t *cfg, const uint8_t *pairs, size_t len) {
+    bool ok = len % 2 == 0;
+    size_t pa = 0;
+    for(size_t i=0; i+1<len; i+=2) {
+        if (pairs[i] < RADIO_CONFIG_REGS)
+            cfg->regs[pairs[i]] = pairs[i+1];
+        else if (pairs[i] == CC1101_PATABLE)
+            cfg->patable[pa++ % RADIO_PATABLE_LEN] = pairs[i+1];
+        else
+            ok = false;
+    }
+    return ok;
+}
+
+
+void radio_config_set_frequency(radio_config_t *cfg, uint32_t freq_hz) {
+    /* setting = freq_hz * 2**16/fXOSC, the upper 22 bits */
+    uint64_t setting = ((uint64_t)freq_hz << 16) / CC1101_fXOSC;
+    setting &= 0x003FFFFF;
+    cfg->regs[CC1101_FREQ2] = setting >> 16;
+    cfg->regs[CC1101_FREQ1] = setting >> 8;
+    cfg->regs[CC1101_FREQ0] = setting;
+}
+
+
+/* Whether the register must be written to get its value in cfg */
+STATIC bool differs(const radio_config_t *cfg, int reg) {
+    if (NOT_WRITTEN & BIT(reg))
+        return false;
+    return ! (shadow_known & BIT(reg)) || shadow.regs[reg] != cfg->regs[reg];
+}
+
+/* Whether a burst can write the register again with the value of the shadow */
+STATIC bool rewritable(int reg) {
+    return (shadow_known & BIT(reg)) && ! ((CALIBRATED | NOT_WRITTEN) & BIT(reg));
+}
+
+size_t radio_config_apply(const radio_config_t *cfg) {
+    uint8_t pairs[2*RADIO_CONFIG_REGS], burst[1+RADIO_CONFIG_REGS];
+    size_t npairs = 0, sent = 0;
+
+    int reg = 0;
+    while(reg < RADIO_CONFIG_REGS) {
+        if (! differs(cfg, reg)) {
+            ++reg;
+            continue;
+        }
+
+        /* The run ends after the last register to write that follows at most RADIO_CONFIG_MAX_GAP others */
+        int end = reg+1;
+        for(int k=end; k<RADIO_CONFIG_REGS && k-end<=RADIO_CONFIG_MAX_GAP; ++k) {
+            if (differs(cfg, k))
+                end = k+1;
+            else if (! rewritable(k))
+                break;
+        }
+
+        if (end - reg == 1) {
+            pairs[npairs++] = reg;
+            pairs[npairs++] = cfg->regs[reg];
+        } else {
+            burst[0] = CC1101_BURST(reg);
+            memcpy(burst+1, cfg->regs+reg, end-reg);
+            radio_send(burst, NULL, 1+end-reg);
+            sent += 1+end-reg;
+        }
+        reg = end;
+    }
+    if (npairs) {
+        radio_send(pairs, NULL, npairs);
+        sent += npairs;
+    }
+
+    if (patable_known != ALL_PATABLE || memcmp(shadow.patable, cfg->patable, RADIO_PATABLE_LEN) != 0) {
+        burst[0] = CC1101_BURST(CC1101_PATABLE);
+        memcpy(burst+1, cfg->patable, RADIO_PATABLE_LEN);
+        radio_send(burst, NULL, 1+RADIO_PATABLE_LEN);
+        sent += 1+RADIO_PATABLE_LEN;
+    }
+
+    return sent;
+}
+
+
+uint8_t radio_config_get(uint8_t reg) {
+    if (reg >= RADIO_CONFIG_REGS)
+        return 0;
+    if ((shadow_known & BIT(reg)) && ! (CALIBRATED & BIT(reg)))
+        return shadow.regs[reg];
+
+    uint8_t cmd[2] = {CC1101_READ(reg), 0}, resp[2];
+    radio_send(cmd, resp, 2);
+    if (! (shadow_known & BIT(reg))) {
+        shadow.regs[reg] = resp[1];
+        shadow_known |= BIT(reg);
+    }
+    return resp[1];
+}
+
+
+void radio_config_read(radio_config_t *cfg) {
+    if (shadow_known != ALL_REGS || patable_known != ALL_PATABLE)
+        radio_config_sync();
+    *cfg = shadow;
+    radio_burst_read(CC1101_FSCAL3, cfg->regs + CC1101_FSCAL3, 3);
+}
+
+
+void radio_config_sync(void) {
+    radio_burst_read(CC1101_IOCFG2, shadow.regs, RADIO_CONFIG_REGS);
+    radio_burst_read(CC1101_PATABLE, shadow.patable, RADIO_PATABLE_LEN);
+    shadow_known = ALL_REGS;
+    patable_known = ALL_PATABLE;
+}
+
+
+void radio_config_invalidate(void) {
+    shadow_known = 0;
+    patable_known = 0;
+}
+
+
+bool radio_preset_init(radio_preset_t *preset, const char *name, const uint8_t *pairs, size_t len, uint32_t freq_hz) {
+    memset(preset, 0, sizeof(*preset));
+    preset->name = name;
+    radio_config_defaults(&preset->config);
+    bool ok = radio_config_compile(&preset->config, pairs, len);
+    radio_config_set_frequency(&preset->config, freq_hz);
+    return ok;
+}
+
+
+/* Sends a strobe, and waits for the chip to be in IDLE */
+STATIC bool strobe_then_idle(uint8_t cmd) {
+    radio_send(&cmd, NULL, 1);
+    uint32_t t0 = time_us_32();
+    uint8_t state;
+    do {
+        radio_burst_read(CC1101_MARCSTATE, &state, 1);
+        if ((state & MARCSTATE_MASK) == MARCSTATE_IDLE)
+            return true;
+    } while(time_us_32() - t0 < RADIO_PRESET_TIMEOUT_US);
+    return false;
+}
+
+bool radio_preset_switch(radio_preset_t *preset) {
+    static const uint8_t flush[] = {CC1101_SFRX, CC1101_SFTX};
+    uint32_t t0 = time_us_32();
+
+    bool ok = strobe_then_idle(CC1101_SIDLE);
+    radio_send(flush, NULL, sizeof(flush));
+    size_t sent = 1 + sizeof(flush);
+
+    /* The chip calibrates without its own values: the calibrated registers are written again */
+    radio_config_t cfg = preset->config;
+    cfg.regs[CC1101_MCSM0] &= ~MCSM0_FS_AUTOCAL_MASK;
+    if (preset->calibrated)
+        memcpy(cfg.regs + CC1101_FSCAL3, preset->fscal, sizeof(preset->fscal));
+    shadow_known &= ~CALIBRATED;
+    sent += radio_config_apply(&cfg);
+
+    preset->switch_calibrated = ! preset->calibrated;
+    if (! preset->calibrated) {
+        ok &= strobe_then_idle(CC1101_SCAL);
+        radio_burst_read(CC1101_FSCAL3, preset->fscal, sizeof(preset->fscal));
+        memcpy(shadow.regs + CC1101_FSCAL3, preset->fscal, sizeof(preset->fscal));
+        preset->calibrated = ok;
+        ++sent;
+    }
+
+    preset->switch_us = time_us_32() - t0;
+    preset->switch_bytes = sent;
+    ++preset->switches;
+    return ok;
+}
+
+
+void radio_preset_recalibrate(radio_preset_t *preset) {
+    preset->calibrated = false;
+}
+
+
+/* Register writes from reg (or the PATABLE from pa) */
+STATIC void track_writes(uint8_t reg, const uint8_t *data, size_t len, size_t *pa) {
+    if (reg == CC1101_PATABLE) {
+        for(size_t i=0; i<len; ++i, ++*pa) {
+            shadow.patable[*pa % RADIO_PATABLE_LEN] = data[i];
+            patable_known |= 1u << (*pa % RADIO_PATABLE_LEN);
+        }
+        return;
+    }
+    for(size_t i=0; i<len && reg+i<RADIO_CONFIG_REGS; ++i) {
+        shadow.regs[reg+i] = data[i];
+        shadow_known |= BIT(reg+i);
+    }
+}
+
+void radio_config_track(uint8_t header, const uint8_t *data, size_t len) {
+    size_t i = 0, pa = 0;  /* The PATABLE index restarts with each transaction */
+    for(;;) {
+        uint8_t reg = header & 0x3F;
+        bool burst = header & 0x40, read = header & 0x80;
+        if (! burst && reg >= CC1101_SRES && reg < CC1101_PATABLE) {
+            /* Command strobe, the read bit only changes the FIFO of the status byte */
+            if (reg == CC1101_SRES) {
+                shadow = reset_config;
+                shadow_known = ALL_REGS;
+                patable_known = ALL_PATABLE;
+            } else if (reg == CC1101_SPWD) {
+                shadow_known &= ~LOST_IN_SLEEP;
+                patable_known &= 1u;
+            }
+        } else if (burst) {
+            /* Until the end of the transaction */
+            if (! read)
+                track_writes(reg, data+i, len-i, &pa);
+            return;
+        } else {
+            if (! read && i < len)
+                track_writes(reg, data+i, 1, &pa);
+            ++i;
+        }
+        if (i >= len)
+            return;
+        header = data[i++];
+    }
+}
@@ -0,0 +1,138 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file radio_config.h
+ *
+ * \brief Radio configuration API: a shadow of the CC1101 configuration registers, and presets compiled against it.
+ *
+ * The presets (conf_am270_async, conf_gfsk999 in tests/radio.c) are address/value pairs sent in a single transaction.
+ * They only set what differs from the reset values, so that switching from one to the other leaves the registers of
+ * the first one that the second one does not set, and reading the configuration back reads all the registers.
+ *
+ * A preset is compiled once into a full configuration (\ref radio_config_t): the reset values, then the pairs.
+ * \ref radio_config_apply then compares it to the shadow, the last values written to the chip, and only writes the
+ * registers that differ:
+ * - runs of contiguous registers are written in burst accesses, a run continues over up to RADIO_CONFIG_MAX_GAP
+ *   unchanged registers, which costs less than the header of another burst,
+ * - the isolated registers are written as address/value pairs in a single transaction.
+ *
+ * The shadow follows every write of the transport (radio_send(), the receiver, the transmitter, ...): radio.c passes
+ * the transactions to \ref radio_config_track, which decodes the register writes, the PATABLE, SRES and SPWD
+ * (the test registers and the PATABLE but its first byte are lost in SLEEP, they are written again by the next apply).
+ * A register is unknown until it is written, reset or read: the first apply writes everything
+ * (or call \ref radio_config_sync to read the chip first).
+ *
+ * The reads are served from the shadow, except the results of the frequency synthesizer calibration
+ * (FSCAL3 to FSCAL1, changed by the chip), which are read from the chip.
+ * FSTEST and AGCTEST are never written (datasheet: for test only, do not write).
+ *
+ * Apply the configurations in IDLE, with the receiver and the transmitter stopped (radio_rx_stop()).
+ *
+ * The presets (\ref radio_preset_t) switch from a configuration to another without a reset (SRES): a switch was
+ * the reset, the whole preset again, then a calibration at each RX or TX (~720µs). \ref radio_preset_switch:
+ * - goes to IDLE (SIDLE then MARCSTATE) and flushes the FIFOs, as the reset did,
+ * - applies the compiled configuration of the preset, only the registers which differ are written,
+ * - the first switch to a preset calibrates the frequency synthesizer (SCAL) and keeps FSCAL3 to FSCAL1,
+ *   the next ones write them back (datasheet, section 28.2). The automatic calibration (MCSM0.FS_AUTOCAL)
+ *   is disabled, so that going to RX or TX does not calibrate again.
+ * The calibration is valid for the frequency of the preset: after radio_set_frequency(), or a large change of
+ * temperature or supply, call \ref radio_preset_recalibrate.
+ * The time of each switch is recorded in the preset.
+ * */
+
+#ifndef _RADIO_CONFIG_H
+#define _RADIO_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "radio.h"
+
+/** Number of configuration registers, IOCFG2 (0x00) to TEST0 (0x2E) */
+#define RADIO_CONFIG_REGS 0x2F
+
+/** Number of bytes of the PATABLE */
+#define RADIO_PATABLE_LEN 8
+
+/** Unchanged registers that a burst writes again rather than starting another burst */
+#define RADIO_CONFIG_MAX_GAP 2
+
+/** \brief A full configuration: all the configuration registers, and the PATABLE. */
+typedef struct {
+    uint8_t regs[RADIO_CONFIG_REGS];
+    uint8_t patable[RADIO_PATABLE_LEN];
+} radio_config_t;
+
+/** \brief Initialize a configuration with the reset values of the CC1101. */
+void radio_config_defaults(radio_config_t *cfg);
+
+/** \brief Compile a preset of address/value pairs on top of a configuration, e.g. after radio_config_defaults().
+ *
+ * The pairs with the CC1101_PATABLE address fill the PATABLE, from its first byte.
+ *
+ * \return false if an address is not a configuration register or the PATABLE (the pair is ignored). */
+bool radio_config_compile(radio_config_t *cfg, const uint8_t *pairs, size_t len);
+
+/** \brief Set FREQ2, FREQ1 and FREQ0 of a configuration, as radio_set_frequency() does. */
+void radio_config_set_frequency(radio_config_t *cfg, uint32_t freq_hz);
+
+/** \brief Write the registers of \p cfg which differ from the shadow.
+ *
+ * \return The number of bytes sent, headers included, 0 if nothing changed. */
+size_t radio_config_apply(const radio_config_t *cfg);
+
+/** \brief Value of a configuration register, from the shadow (FSCAL3 to FSCAL1 from the chip). */
+uint8_t radio_config_get(uint8_t reg);
+
+/** \brief Copy the current configuration, from the shadow (FSCAL3 to FSCAL1 from the chip). */
+void radio_config_read(radio_config_t *cfg);
+
+/** \brief Read all the configuration registers and the PATABLE from the chip into the shadow.
+ *
+ * E.g. after a reset of the RP2040 alone, when the chip kept an unknown configuration. */
+void radio_config_sync(void);
+
+/** \brief Forget the shadow, all the registers are unknown. */
+void radio_config_invalidate(void);
+
+
+/** Timeout of the state changes of a switch (IDLE, calibration), in µs */
+#define RADIO_PRESET_TIMEOUT_US 5000
+
+/** \brief A named configuration, and the calibration of the frequency synthesizer for it. */
+typedef struct {
+    const char *name;
+    radio_config_t config;
+    bool calibrated;        /**< fscal is valid */
+    uint8_t fscal[3];       /**< FSCAL3, FSCAL2 and FSCAL1 after the calibration */
+    uint32_t switch_us;     /**< Duration of the last switch to this preset */
+    size_t switch_bytes;    /**< Bytes written by the last switch, headers and strobes included */
+    bool switch_calibrated; /**< The last switch calibrated the synthesizer */
+    uint32_t switches;      /**< Number of switches to this preset */
+} radio_preset_t;
+
+/** \brief Compile a preset of address/value pairs on top of the reset values, at \p freq_hz.
+ *
+ * \return false if an address is not a configuration register or the PATABLE (see radio_config_compile()). */
+bool radio_preset_init(radio_preset_t *preset, const char *name, const uint8_t *pairs, size_t len, uint32_t freq_hz);
+
+/** \brief Switch to a preset: IDLE, the registers which differ, and the calibration (see above).
+ *
+ * The receiver and the transmitter must be stopped. The chip stays in IDLE.
+ *
+ * \return false if the chip did not reach IDLE or end the calibration in time. */
+bool radio_preset_switch(radio_preset_t *preset);
+
+/** \brief Calibrate again at the next switch to the preset. */
+void radio_preset_recalibrate(radio_preset_t *preset);
+
+
+/** \brief Follow a transaction of the transport: \p header then the \p len bytes that follow it.
+ *
+ * Called by radio.c for every transaction it sends, not meant for the applications. */
+void radio_config_track(uint8_t header, const uint8_t *data, size_t len);
+
+#endif /* _RADIO_CONFIG_H */
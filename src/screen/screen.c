@@ -8,28 +8,175 @@
 // certain versions of GCC and newlib which causes omission of PRIu64
 #include <sys/types.h>
 #include <inttypes.h>
+#include <string.h>
 
+#include "hardware/dma.h"
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
 #include "hardware/spi.h"
+#include "hardware/sync.h"
 #include "pico/binary_info.h"
 #include "pico/time.h"
 
+#include "badge_defs.h"
 #include "badge_pinout.h"
 #include "log.h"
 #include "screen.h"
 
 
-/* Internal (for now) state description to handle boot sequence */
+/* Internal (for now) state description to handle boot sequence.
+ * The boot is driven by one-shot alarms for the fixed delays, then by the falling edges of BUSY (see busy_irq) */
 typedef enum {
     STATE_UNINIT = 0,
     STATE_SLEEP = 1, /* Or boot */
-    STATE_HWRESET = 2,  /* Hardware reset ongoing */
-    STATE_SWRESET = 3,  /* Software reset ongoing */
-    STATE_SETUP = 4,  /* Does a BUSY operation */
-    STATE_READY = 5,  /* You can send commands (if not busy) */
+    STATE_HWRESET = 2,  /* Hardware reset ongoing, RST is low */
+    STATE_HWRESET_BUSY = 3,  /* RST released, waits for BUSY to be low */
+    STATE_SWRESET = 4,  /* Software reset ongoing */
+    STATE_SETUP = 5,  /* Does a BUSY operation */
+    STATE_READY = 6,  /* You can send commands (if not busy) */
 } state_t;
-STATIC state_t state = STATE_UNINIT;
+STATIC volatile state_t state = STATE_UNINIT;
 STATIC absolute_time_t state_ts = 0;  /* Last time the state changed */
+STATIC int64_t state_us[STATE_READY];  /* How long each state of the last boot lasted, logged by screen_boot */
+STATIC bool waking = false;  /* Next boot wakes up from deep sleep: powered, only the registers were reset */
+STATIC bool boot_wake = false;  /* The last boot was a wake up */
+STATIC bool boot_logged = false;
+STATIC alarm_id_t boot_aid = 0;  /* Alarm of the SLEEP and HWRESET delays, 0 when not set */
+
+/* Completion callbacks (see screen_set_callbacks) */
+STATIC screen_callback_t ready_cb = NULL;
+STATIC screen_callback_t refresh_cb = NULL;
+STATIC volatile bool refreshing = false;  /* A refresh was activated, BUSY falls at its end */
+STATIC bool busy_irq_added = false;
+
+/* The GPIO and DMA interrupts only advance the states: the callbacks and the queued commands are deferred
+ * to a spare IRQ at the lowest priority (see task_irq_handler) */
+STATIC int task_irq = -1;
+STATIC volatile bool ready_pending = false;
+STATIC volatile bool refresh_pending = false;
+STATIC volatile screen_callback_t push_done_pending = NULL;
+
+/* Asynchronous push of the RAM banks (see screen_push_rams_async) */
+STATIC int push_dma = -1;  /* DMA channel that feeds the SPI TX FIFO */
+STATIC const uint8_t *push_planes[2] = {NULL, NULL};  /* LSB then MSB plane, NULL when already sent or not used */
+STATIC size_t push_len = 0;
+STATIC volatile bool push_ongoing = false;
+STATIC screen_callback_t push_done = NULL;
+
+/* Rolling frame (see screen_show_image_diff): the previous image, valid while the RAM banks were not touched otherwise.
+ * With SCREEN_DIFF_READBACK, the previous image is read back from the B/W bank instead of kept here. */
+#if ! SCREEN_DIFF_READBACK
+STATIC uint8_t diff_prev[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+#endif
+STATIC bool diff_valid = false;
+STATIC uint8_t diff_rows[2] = {0, SCREEN_HEIGHT};  /* Rows changed by the previous diff, last excluded */
+STATIC uint8_t fast_period = SCREEN_FAST_FULL_PERIOD;  /* Fast updates between two full refreshes, 0 for never */
+STATIC uint8_t fast_updates = 0;  /* Since the last full refresh */
+
+/* Waveform settings resident in the controller (see screen_push_ws): a copy, as the callers may change their table */
+#define WS_SIZE 159
+#define WS_UPLOAD_BYTES (1+153 + 2+2+4+2)  /* 0x32 and the LUT, then EOPT, VGH, VSH1/VSH2/VSL, VCOM */
+#define WS_UPLOAD_COMMANDS 5
+STATIC uint8_t ws_resident[WS_SIZE];
+STATIC bool ws_valid = false;  /* Reset, deep sleep and the OTP loads (0x22 0xB1) replace the LUT */
+STATIC screen_ws_stats_t ws_stats = {0};
+
+/* Temperature compensation of the full refresh LUTs: the particles move faster when warm,
+ * so the clearing group (group 1, repeated 3 times in the reference tables) needs less repeats */
+#define WS_CLEAR_RP (5*12 + 7*1 + 6)  /* RP[1] */
+STATIC const struct {
+    int8_t min_temp;  /* °C, first band that matches */
+    uint8_t repeats;  /* RP: the group is done repeats+1 times */
+} ws_bands[] = {
+    {  28, 0},  /* Hot */
+    {  15, 1},  /* Room temperature */
+    {   5, 2},  /* The reference tables */
+    {-128, 4},  /* Cold */
+};
+/* Start of the current window in the RAM (set by do_set_image_position): the counters go down from there */
+STATIC uint8_t ram_x1 = SCREEN_WIDTH/8 - 1;
+STATIC uint8_t ram_y1 = SCREEN_HEIGHT - 1;
+
+STATIC int8_t temperature = 20;  /* °C, read at the end of the boot */
+STATIC int16_t temp_raw = 20*16;  /* Same, as read from the sensor (1/16 °C), to write it back when waking up */
+STATIC absolute_time_t temp_ts = 0;  /* When it was measured, 0 for never */
+STATIC bool temp_measuring = false;  /* The setup measures it, instead of writing temp_raw */
+#define TEMP_MAX_AGE_US (10*60*1000000ll)  /* Measured again when waking up after that */
+STATIC uint8_t ws_compensated[WS_SIZE];
+
+/* Command queue: the public functions submit commands, which are run right away when the screen is free,
+ * or queued and run by screen_task() when it is not busy anymore */
+typedef enum {
+    OP_BORDER,
+    OP_CLEAR,
+    OP_DEEP_SLEEP,
+    OP_POSITION,
+    OP_SHOW_BW,
+    OP_SHOW_4G,
+    OP_SHOW_Z,
+    OP_SHOW_DIFF,
+    OP_SHOW_FAST,
+    OP_PUSH_RAMS,
+    OP_PUSH_WINDOW,
+    OP_PUSH_Z,
+    OP_PUSH_ASYNC,
+    OP_SHOW_RAMS,
+    OP_SHOW_RAMS_FAST,
+    OP_PUSH_WS,
+} op_t;
+typedef struct {
+    op_t op;
+    union {
+        uint8_t color;           /* OP_BORDER */
+        bool bit;                /* OP_CLEAR */
+        uint8_t window[4];       /* OP_POSITION */
+        struct {                 /* Images, planes and LUTs (in lsb) */
+            const uint8_t *lsb;
+            const uint8_t *msb;
+            size_t len;          /* Of the planes, or of the rows of OP_PUSH_WINDOW */
+            size_t stride;
+            size_t rows;
+            screen_callback_t done;
+        };
+    };
+} command_t;
+STATIC command_t queue[SCREEN_QUEUE_SIZE];
+STATIC volatile size_t queue_len = 0;
+STATIC volatile bool running = false;  /* A command is being sent, calls from interrupts must be queued */
+
+STATIC void submit(const command_t *cmd);
+STATIC void busy_irq(void);
+STATIC void task_irq_handler(void);
+STATIC void do_push_rams(const uint8_t *lsb, const uint8_t *msb, size_t len);
+STATIC void do_push_rams_window(const uint8_t *lsb, const uint8_t *msb, size_t stride, size_t row_len, size_t rows);
+STATIC size_t do_push_rams_z(const uint8_t *lsb_z, const uint8_t *msb_z);
+STATIC void do_show_rams(void);
+STATIC void do_show_rams_fast(void);
+STATIC void do_push_ws(const uint8_t *luts);
+STATIC void set_bypass(bool use_lsb, bool use_msb);
+STATIC void read_bank(uint8_t bank, size_t j0, size_t rows, size_t row_len, uint8_t *dst, size_t stride, uint32_t *sum);
+
+/* Decompression of the planes (screen_push_rams_z): twice the LZ window,
+ * a half is sent while the other is kept as history for the matches */
+#define Z_RING_SIZE 512
+STATIC uint8_t z_ring[Z_RING_SIZE] __attribute__((aligned(4)));
+
+
+#define SPI_WRITE_HZ (20*1000*1000)  /* Should go up to 20 MHz in write, but 2.5 in read */
+#define SPI_READ_HZ (2500*1000)
+
+
+/* Sends a command byte (D/C low) */
+STATIC void write_command(uint8_t cmd) {
+    gpio_put(BADGE_SCREEN_DC, 0);  /* Low for commands, high for data */
+    spi_write_blocking(spi0, &cmd, 1);
+    gpio_put(BADGE_SCREEN_DC, 1);
+}
+
+/* Sends the data of the last command (D/C high) */
+STATIC void write_data(const uint8_t *buf, size_t len) {
+    spi_write_blocking(spi0, buf, len);
+}
 
 
 /* Send data on the SPI but don't wait for BUSY to be LOW */
@@ -37,12 +184,65 @@ STATIC void send(const uint8_t *cmd, size_t len) {
     if(! cmd || len == 0)
         return;
 
-    gpio_put(BADGE_SCREEN_DC, 0);  /* Low for commands, high for data */
-    spi_write_blocking(spi0, cmd, 1);
-    gpio_put(BADGE_SCREEN_DC, 1);
+    write_command(cmd[0]);
     if(len > 1) {
-        spi_write_blocking(spi0, (cmd+1), len-1);
+        write_data(cmd+1, len-1);
+    }
+}
+
+
+/* Sends a command then reads its answer, the SPI reads are slower */
+STATIC void receive(uint8_t cmd, uint8_t *dst, size_t len) {
+    write_command(cmd);
+    /* TX and RX are both wired to DIN: TX is disconnected while the SSD1681 drives it,
+     * otherwise it would drive the zeros clocked out by spi_read_blocking() */
+    spi_set_baudrate(spi0, SPI_READ_HZ);
+    gpio_set_function(BADGE_SPI0_TX_MOSI_SCREEN, GPIO_FUNC_NULL);
+    spi_read_blocking(spi0, 0, dst, len);
+    gpio_set_function(BADGE_SPI0_TX_MOSI_SCREEN, GPIO_FUNC_SPI);
+    spi_set_baudrate(spi0, SPI_WRITE_HZ);
+}
+
+
+/* Ends the asynchronous push, called by the DMA interrupt.
+ * The callback and the commands queued behind the push run from task_irq. */
+STATIC void push_end(void) {
+    push_done_pending = push_done;
+    push_ongoing = false;
+    irq_set_pending(task_irq);
+}
+
+
+/* Starts the DMA for the next plane to push, or ends the asynchronous push.
+ * Called by screen_push_rams_async, then by the DMA interrupt. */
+STATIC void push_next_plane(void) {
+    /* The DMA is done when the last byte is in the TX FIFO, but D/C must not change before it is shifted out */
+    while(spi_is_busy(spi0))
+        tight_loop_contents();
+
+    for(size_t i=0; i<2; ++i) {
+        if(! push_planes[i])
+            continue;
+        const uint8_t *plane = push_planes[i];
+        push_planes[i] = NULL;
+
+        /* The command byte is short enough to be sent by the CPU */
+        write_command(i == 0 ? SSD1681_RAM0_WRITE : SSD1681_RAM1_WRITE);
+        dma_channel_transfer_from_buffer_now(push_dma, plane, push_len);
+        return;
     }
+
+    /* Both planes are sent */
+    push_end();
+}
+
+
+/* DMA_IRQ_0 handler, shared with other libraries */
+STATIC void push_irq(void) {
+    if(! dma_channel_get_irq0_status(push_dma))
+        return;
+    dma_channel_acknowledge_irq0(push_dma);
+    push_next_plane();
 }
 
 
@@ -54,14 +254,42 @@ void screen_init(void) {
     bi_decl_if_func_used(bi_1pin_with_name(BADGE_SCREEN_RST, "e-Paper RST"));
 
     // Init SPI
-    spi_init(spi0, 20*1000*1000);  /* Should go up to 20 MHz in write, but 2.5 in read */
+    spi_init(spi0, SPI_WRITE_HZ);
     gpio_set_function(BADGE_SPI0_TX_MOSI_SCREEN, GPIO_FUNC_SPI);
     gpio_set_function(BADGE_SPI0_RX_MISO, GPIO_FUNC_SPI);
     gpio_set_function(BADGE_SPI0_SCK_SCREEN, GPIO_FUNC_SPI);
     gpio_set_function(BADGE_SPI0_CSn, GPIO_FUNC_SPI);
 
+    // Init the DMA that pushes the planes: byte per byte from memory to the SPI, paced by the SPI TX DREQ
+    if (push_dma < 0) {
+        push_dma = dma_claim_unused_channel(true);
+        irq_add_shared_handler(DMA_IRQ_0, push_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    }
+    dma_channel_config c = dma_channel_get_default_config(push_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, spi_get_dreq(spi0, true));
+    dma_channel_configure(push_dma, &c, &spi_get_hw(spi0)->dr, NULL, 0, false);
+    dma_channel_set_irq0_enabled(push_dma, true);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // The callbacks and the queue run below the other interrupts
+    if (task_irq < 0) {
+        task_irq = user_irq_claim_unused(true);
+        irq_set_exclusive_handler(task_irq, task_irq_handler);
+        irq_set_priority(task_irq, PICO_LOWEST_IRQ_PRIORITY);
+    }
+    irq_set_enabled(task_irq, true);
+
     // Init other pins
     gpio_init(BADGE_SCREEN_BUSY);
+    if (! busy_irq_added) {
+        gpio_add_raw_irq_handler(BADGE_SCREEN_BUSY, busy_irq);
+        busy_irq_added = true;
+    }
+    gpio_set_irq_enabled(BADGE_SCREEN_BUSY, GPIO_IRQ_EDGE_FALL, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
     gpio_init(BADGE_SCREEN_DC);
     gpio_put(BADGE_SCREEN_DC, 1);
     gpio_set_dir(BADGE_SCREEN_DC, GPIO_OUT);
@@ -69,8 +297,20 @@ void screen_init(void) {
     gpio_put(BADGE_SCREEN_RST, 1);  /* High = running */
     gpio_set_dir(BADGE_SCREEN_RST, GPIO_OUT);
 
+    if (boot_aid)
+        cancel_alarm(boot_aid);
+    boot_aid = 0;
+    refreshing = false;
+    ready_pending = false;
+    refresh_pending = false;
+    push_done_pending = NULL;
+    ws_valid = false;
+    waking = false;  /* The screen may have just been powered */
+    temp_ts = 0;
     state = STATE_SLEEP;
     state_ts = get_absolute_time();
+    diff_valid = false;
+    queue_len = 0;
     log_info("screen init ok");
 }
 
@@ -98,7 +338,17 @@ STATIC void setup(void) {
     send("\x18\x80", 2);
 
     /* Load internal Waveform Settings for display mode 1 using temp */
-    send("\x22\xB1", 2);
+    ws_valid = false;  /* Replaces the LUT that was pushed before the reset */
+    temp_measuring = ! boot_wake || temp_ts == 0
+                     || absolute_time_diff_us(temp_ts, get_absolute_time()) > TEMP_MAX_AGE_US;
+    if (temp_measuring)
+        send("\x22\xB1", 2);
+    else {
+        /* When waking up, the temperature has not changed much since the last measure: write it, and skip the sensor */
+        uint32_t buf = SSD1681_TEMP_WRITE | ((temp_raw >> 4) & 0xFF) << 8 | (temp_raw & 0xF) << 20;
+        send((const uint8_t *)&buf, 3);
+        send("\x22\x91", 2);
+    }
     send("\x20", 1);
 
     /* Can we display something without customized LUT ? Yes. */
@@ -107,90 +357,197 @@ STATIC void setup(void) {
 }
 
 
-bool screen_boot(void) {
-    if (state == STATE_UNINIT)
-        return false;
-    if (state >= STATE_READY)
-        return true;
+/* Reads the temperature that the sensor measured for the last 0x22 with 0x20 (see setup) */
+STATIC void read_temperature(void) {
+    uint8_t buf[2];
+    receive(SSD1681_TEMP_READ, buf, 2);
+    temp_raw = (int16_t)((buf[0] << 8) | buf[1]) >> 4;  /* 12 bits signed, in 1/16 °C */
+    temp_ts = get_absolute_time();
+    int16_t t = temp_raw / 16;
+    temperature = t < -128 ? -128 : t > 127 ? 127 : t;
+}
 
+/* Copies the full refresh LUT with the repeats of its clearing group for the current temperature */
+STATIC const uint8_t *compensate(const uint8_t *ws) {
+    size_t band = 0;
+    while(temperature < ws_bands[band].min_temp)
+        ++band;
+    memcpy(ws_compensated, ws, WS_SIZE);
+    ws_compensated[WS_CLEAR_RP] = ws_bands[band].repeats;
+    return ws_compensated;
+}
+
+int8_t screen_temperature(void) {
+    return temperature;
+}
+
+
+/* Leaves the current state of the boot, for the next one */
+STATIC void enter(state_t next) {
     absolute_time_t now = get_absolute_time();
+    if (state < STATE_READY)
+        state_us[state] = absolute_time_diff_us(state_ts, now);
+    state = next;
+    state_ts = now;
+}
+
+
+/* The hardware reset is done: a software reset on cold boots, directly the setup when waking up */
+STATIC void after_hwreset(void) {
+    if (boot_wake) {
+        /* The hardware reset already set the registers to their defaults, as the software reset would do */
+        enter(STATE_SETUP);
+        setup();
+    } else {
+        /* Now send a command to the screen and wait for busy to be low */
+        enter(STATE_SWRESET);
+        send("\x12", 1);
+    }
+}
+
 
+/* One-shot alarm of the fixed delays of the boot, from the timer interrupt */
+STATIC int64_t boot_alarm(alarm_id_t id, void *user_data) {
     switch(state) {
-    case STATE_SLEEP: /* or boot */
-        /* Boot procedure has various lengths, but after VCI, we should leave 10ms */
-        if (absolute_time_diff_us(state_ts, now) >= 10000) {
-            /* Starts HW RESET by pulling its pin down */
-            gpio_put(BADGE_SCREEN_RST, 0);
-            log_info("boot: SLEEP lasted %" PRIu64 "µs", absolute_time_diff_us(state_ts, now));
-            state = STATE_HWRESET;
-            state_ts = get_absolute_time();
-        }
-        break;
+    case STATE_SLEEP:
+        /* Starts HW RESET by pulling its pin down.
+         * It is not specified how long we should pull RST down, but the Arduino project does it for 5ms */
+        gpio_put(BADGE_SCREEN_RST, 0);
+        enter(STATE_HWRESET);
+        return -5000;
     case STATE_HWRESET:
-        /* It is not specify how long we should pull RST down, but the Arduino project does it for 5ms */
-        if (absolute_time_diff_us(state_ts, now) >= 5000) {
-            gpio_put(BADGE_SCREEN_RST, 1);
-            /* Also wait for BUSY, but it is not specified whether the busy pin is high in this time.
-             * Tests showed that BUSY is high for 1.2ms on cold boot */
-            if (! gpio_get(BADGE_SCREEN_BUSY)) {
-                /* Now send a command to the screen and wait for busy to be low */
-                send("\x12", 1);
-                log_info("boot: HWRESET lasted %" PRIu64 "µs", absolute_time_diff_us(state_ts, now));
-                state = STATE_SWRESET;
-                state_ts = get_absolute_time();
-            }
-        }
+        gpio_put(BADGE_SCREEN_RST, 1);
+        boot_aid = 0;
+        /* Also wait for BUSY, but it is not specified whether the busy pin is high in this time.
+         * Tests showed that BUSY is high for 1.2ms on cold boot */
+        if (gpio_get(BADGE_SCREEN_BUSY))
+            enter(STATE_HWRESET_BUSY);
+        else
+            after_hwreset();
+        return 0;
+    default:
+        boot_aid = 0;
+        return 0;
+    }
+}
+
+
+/* Falling edge of BUSY: the next step of the boot, or the end of an operation.
+ * Raw GPIO handler, shared with the other GPIOs (e.g. the radio): the callbacks and the queue are left to task_irq */
+STATIC void busy_irq(void) {
+    if (! (gpio_get_irq_event_mask(BADGE_SCREEN_BUSY) & GPIO_IRQ_EDGE_FALL))
+        return;
+    gpio_acknowledge_irq(BADGE_SCREEN_BUSY, GPIO_IRQ_EDGE_FALL);
+
+    switch(state) {
+    case STATE_HWRESET_BUSY:
+        after_hwreset();
         break;
     case STATE_SWRESET:
-        /* SWRESET is sent, now wait for busy to be low */
-        if (gpio_get(BADGE_SCREEN_BUSY) == 0) {
-            log_info("boot: SWRESET lasted %" PRIu64 "µs", absolute_time_diff_us(state_ts, now));
-            state = STATE_SETUP;
-            state_ts = get_absolute_time();
-            setup();
-        }
+        enter(STATE_SETUP);
+        setup();
         break;
     case STATE_SETUP:
-        /* Wait for setup: load LUT with temperature reading */
-        if (gpio_get(BADGE_SCREEN_BUSY) == 0) {
-            log_info("boot: SETUP lasted %" PRIu64 "µs, now ready", absolute_time_diff_us(state_ts, now));
-            state = STATE_READY;
-            state_ts = get_absolute_time();
+        /* Setup loaded the LUT with the temperature reading */
+        if (temp_measuring)
+            read_temperature();
+        enter(STATE_READY);
+        ready_pending = true;
+        irq_set_pending(task_irq);
+        break;
+    case STATE_READY:
+        if (refreshing) {
+            refreshing = false;
+            refresh_pending = true;
         }
+        irq_set_pending(task_irq);
         break;
     default:
-        /* We are lost. TODO Should we panic? */
+        /* SLEEP and HWRESET are timed, BUSY does not tell anything */
         break;
     }
+}
+
+
+bool screen_boot(void) {
+    if (state == STATE_UNINIT)
+        return false;
 
-    return state >= STATE_READY;
+    if (state == STATE_READY) {
+        if (! boot_logged) {
+            /* Logged from here, the steps were done in interrupts */
+            log_info("%s: SLEEP %" PRIu64 "µs, HWRESET %" PRIu64 "µs + %" PRIu64 "µs, SWRESET %" PRIu64 "µs, "
+                     "SETUP %" PRIu64 "µs, now ready", boot_wake ? "wake up" : "boot", state_us[STATE_SLEEP],
+                     state_us[STATE_HWRESET], state_us[STATE_HWRESET_BUSY], state_us[STATE_SWRESET],
+                     state_us[STATE_SETUP]);
+            boot_logged = true;
+        }
+        return true;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    if (state == STATE_SLEEP && ! boot_aid) {
+        /* Boot procedure has various lengths, but after VCI, we should leave 10ms.
+         * When waking up from deep sleep, VCI did not change.
+         * The alarm may fire right away, from this call */
+        int64_t left = waking ? 0 : 10000 - absolute_time_diff_us(state_ts, get_absolute_time());
+        boot_wake = waking;
+        memset(state_us, 0, sizeof(state_us));
+        boot_logged = false;
+        boot_aid = add_alarm_in_us(left > 0 ? left : 0, boot_alarm, NULL, true);
+    }
+    restore_interrupts(irq);
+
+    return false;
 }
 
 
-bool screen_busy(void) {
-    return (state < STATE_READY) || gpio_get(BADGE_SCREEN_BUSY);
+screen_boot_timings_t screen_boot_timings(void) {
+    screen_boot_timings_t t = {
+        .sleep_us = state_us[STATE_SLEEP],
+        .hwreset_us = state_us[STATE_HWRESET],
+        .hwreset_busy_us = state_us[STATE_HWRESET_BUSY],
+        .swreset_us = state_us[STATE_SWRESET],
+        .setup_us = state_us[STATE_SETUP],
+        .wake = boot_wake,
+    };
+    t.total_us = t.sleep_us + t.hwreset_us + t.hwreset_busy_us + t.swreset_us + t.setup_us;
+    return t;
 }
 
 
-void screen_border(uint8_t color) {
-    if (screen_busy()) {
-        log_warning("screen_border() called but screen is busy");
-        return;
-    }
+void screen_set_callbacks(screen_callback_t ready, screen_callback_t refresh_done) {
+    ready_cb = ready;
+    refresh_cb = refresh_done;
+}
 
+
+/* Whether the controller can receive commands, regardless of the queue.
+ * BUSY rises a little after the activation (0x20): refreshing covers the refresh until busy_irq sees BUSY fall */
+STATIC bool controller_busy(void) {
+    return (state < STATE_READY) || push_ongoing || refreshing || gpio_get(BADGE_SCREEN_BUSY);
+}
+
+
+bool screen_busy(void) {
+    screen_task();
+    return controller_busy() || queue_len > 0;
+}
+
+
+STATIC void do_border(uint8_t color) {
     /* Put the command in a 2 bytes int
      * bit 2 = follow LUT, bit 1-0 = LUTx */
     uint16_t cmd = 0x3C | ((4 | (color & 3)) << 8);
     send((uint8_t *)&cmd, 2);  /* Don't pass pointers to local variables when the callee may borrow them... */
 }
 
+void screen_border(uint8_t color) {
+    submit(&(command_t){.op = OP_BORDER, .color = color});
+}
 
-void screen_clear(bool bit) {
-    if (screen_busy()) {
-        log_warning("screen_clear() called but screen is busy");
-        return;
-    }
 
+STATIC void do_clear(bool bit) {
     /* RAM bypass configuration. 4 bits per RAM bank. LSB for black and white, MSB for red bank.
      * RRRR WWWW
      *  ^    ^ bypass RAM when 1 (read 0)
@@ -203,48 +560,54 @@ void screen_clear(bool bit) {
     // DD,FF -> white
     uint16_t cmd = 0x21 | ((0x44 | (bit ? 0x11 : 0x00)) << 8);
     send((const uint8_t *)&cmd, 2);
+    diff_valid = false;  /* The RAM is not shown anymore */
 
     send("\x22\xC7", 2);
+    refreshing = true;
     send("\x20", 1);
-
 }
 
+void screen_clear(bool bit) {
+    submit(&(command_t){.op = OP_CLEAR, .bit = bit});
+}
 
-void screen_deep_sleep(void) {
-    if (screen_busy()) {
-        log_warning("screen_deep_sleep() called but screen is busy");
-        return;
-    }
 
+STATIC void do_deep_sleep(void) {
     /* After that, the screen keeps the BADGE_SCREEN_BUSY pin high until hard reset */
     send("\x10\x01", 2);  /* 0x01 or 0x03... */
-    state = STATE_SLEEP;
-    state_ts = get_absolute_time();
-    log_info("screen put asleep");
+    enter(STATE_SLEEP);
+    waking = true;  /* Still powered: the next boot only needs the hardware reset and the setup */
+    refreshing = false;  /* BUSY stays high, the refresh callback would never come */
+    ws_valid = false;  /* The LUT is loaded again by the boot */
+    diff_valid = false;  /* We don't know what is left in RAM after the hardware reset */
 }
 
+void screen_deep_sleep(void) {
+    submit(&(command_t){.op = OP_DEEP_SLEEP});
+}
 
-size_t screen_set_image_position(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1) {
-    if (screen_busy()) {
-        log_warning("screen_set_image_position() called but screen is busy");
-        return -1;
-    }
 
+/* Converts a window in pixels to the RAM addresses of the screen: X in bytes, last column and row included */
+STATIC void bound_window(uint8_t *x0, uint8_t *y0, uint8_t *x1, uint8_t *y1) {
     /* Swap min/max if needed */
     uint8_t o;
-    if(x0 > x1) {
-        o = x1; x1 = x0; x0 = o;
+    if(*x0 > *x1) {
+        o = *x1; *x1 = *x0; *x0 = o;
     }
-    if(y0 > y1) {
-        o = y1; y1 = y0; y0 = o;
+    if(*y0 > *y1) {
+        o = *y1; *y1 = *y0; *y0 = o;
     }
 
     /* Bind values to [0..200] */
     /* x1,y1 include the last line/column, but the screen commands excludes them */
-    x0 = x0 >= 200 ? 25 : x0/8;
-    x1 = x1 >= 200 ? 24 : (x1%8 == 0 ? x1/8-1 : x1/8-1);
-    y0 = y0 >= 200 ? 200 : y0;
-    y1 = y1 >= 200 ? 199 : y1-1;
+    *x0 = *x0 >= 200 ? 25 : *x0/8;
+    *x1 = *x1 >= 200 ? 24 : (*x1%8 == 0 ? *x1/8-1 : *x1/8-1);
+    *y0 = *y0 >= 200 ? 200 : *y0;
+    *y1 = *y1 >= 200 ? 199 : *y1-1;
+}
+
+STATIC void do_set_image_position(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1) {
+    bound_window(&x0, &y0, &x1, &y1);
 
     uint64_t cmd;
     /* Set RAM-X start/end (give end first because we give data in reverse order, see setup) */
@@ -260,96 +623,505 @@ size_t screen_set_image_position(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
     send((uint8_t *)&cmd, 2);
     cmd = 0x4F | (y1 << 8);  /* Again y1 is on 2 bytes but we use only the first */
     send((uint8_t *)&cmd, 3);
+    ram_x1 = x1;
+    ram_y1 = y1;
+}
+
+/* Sets the RAM counters to the first byte of the row j of the current window */
+STATIC void set_ram_row(size_t j) {
+    uint32_t cmd = 0x4E | (ram_x1 << 8);
+    send((uint8_t *)&cmd, 2);
+    cmd = 0x4F | ((ram_y1 - j) << 8);
+    send((uint8_t *)&cmd, 3);
+}
 
+size_t screen_set_image_position(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1) {
+    submit(&(command_t){.op = OP_POSITION, .window = {x0, y0, x1, y1}});
+    bound_window(&x0, &y0, &x1, &y1);
     return (y1-y0+1)*(x1-x0+1);
 }
 
 
+STATIC void do_show_image_bw(const uint8_t *img) {
+    /* Automatic function that does the manual commands */
+    do_set_image_position(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    do_push_ws(compensate(screen_ws_1681_bw));
+    do_push_rams(img, NULL, (SCREEN_WIDTH*SCREEN_HEIGHT)/8);
+    do_show_rams();
+}
+
 void screen_show_image_bw(const uint8_t *img) {
-    if (screen_busy()) {
-        log_warning("screen_show_image_bw() called but screen is busy");
-        return;
-    }
+    submit(&(command_t){.op = OP_SHOW_BW, .lsb = img});
+}
+
 
+STATIC void do_show_image_4g(const uint8_t *lsb, const uint8_t *msb) {
     /* Automatic function that does the manual commands */
-    screen_clear_image_position();
-    screen_push_ws(screen_ws_1681_bw);
-    screen_push_rams(img, NULL, (SCREEN_WIDTH*SCREEN_HEIGHT)/8);
-    screen_show_rams();
+    do_set_image_position(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    do_push_ws(compensate(screen_ws_1681_4grays));
+    do_push_rams(lsb, msb, (SCREEN_WIDTH*SCREEN_HEIGHT)/8);
+    do_show_rams();
 }
 
-
 void screen_show_image_4g(const uint8_t *lsb, const uint8_t *msb) {
-    if (screen_busy()) {
-        log_warning("screen_show_image_4g() called but screen is busy");
-        return;
-    }
+    submit(&(command_t){.op = OP_SHOW_4G, .lsb = lsb, .msb = msb});
+}
 
-    /* Automatic function that does the manual commands */
-    screen_clear_image_position();
-    screen_push_ws(screen_ws_1681_4grays);
-    screen_push_rams(lsb, msb, (SCREEN_WIDTH*SCREEN_HEIGHT)/8);
-    screen_show_rams();
+
+STATIC void do_show_image_z(const uint8_t *lsb_z, const uint8_t *msb_z) {
+    do_set_image_position(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    do_push_ws(compensate(msb_z ? screen_ws_1681_4grays : screen_ws_1681_bw));
+    do_push_rams_z(lsb_z, msb_z);
+    do_show_rams();
 }
 
+void screen_show_image_z(const uint8_t *lsb_z, const uint8_t *msb_z) {
+    submit(&(command_t){.op = OP_SHOW_Z, .lsb = lsb_z, .msb = msb_z});
+}
 
-void screen_push_rams(const uint8_t *lsb, const uint8_t *msb, size_t len) {
-    if (screen_busy()) {
-        log_warning("screen_push_rams() called but screen is busy");
-        return;
+
+/* Finds the first and last rows (last excluded) where the planes differ, comparing 32 bits at a time.
+ * Returns false when the planes are the same. */
+STATIC bool find_changed_rows(const uint8_t *a, const uint8_t *b, uint8_t *first, uint8_t *last) {
+    size_t i0, i1;  /* First and last different bytes */
+    if (((uintptr_t)a & 3) == 0 && ((uintptr_t)b & 3) == 0) {
+        const uint32_t *wa = (const uint32_t *)a, *wb = (const uint32_t *)b;
+        const size_t n = SCREEN_PLANE_SIZE/4;
+        size_t w0 = 0, w1 = n;
+        while(w0 < n && wa[w0] == wb[w0])
+            ++w0;
+        if (w0 == n)
+            return false;
+        while(wa[w1-1] == wb[w1-1])
+            --w1;
+        i0 = 4*w0;
+        i1 = 4*w1 - 1;
+    } else {
+        /* Unaligned images (not generated by image2epaper.py?) */
+        i0 = 0;
+        i1 = SCREEN_PLANE_SIZE;
+        while(i0 < i1 && a[i0] == b[i0])
+            ++i0;
+        if (i0 == i1)
+            return false;
+        while(a[i1-1] == b[i1-1])
+            --i1;
+        --i1;
+    }
+    *first = i0 / (SCREEN_WIDTH/8);
+    *last = i1 / (SCREEN_WIDTH/8) + 1;
+    return true;
+}
+
+
+#if SCREEN_DIFF_READBACK
+/* Same as below, but the previous image is the one in the B/W bank: it is read back row by row (~20ms),
+ * and the rows to update are copied to the RED bank before the new ones are written to the B/W bank (ping-pong) */
+STATIC bool show_changes(const uint8_t *img, const uint8_t *ws, bool fast) {
+    if (! diff_valid) {
+        do_show_image_bw(img);
+        diff_rows[0] = 0;  /* RED RAM was bypassed: it must be written entirely next time */
+        diff_rows[1] = SCREEN_HEIGHT;
+        diff_valid = true;
+        return true;
+    }
+
+    uint8_t prev[SCREEN_WIDTH/8];
+    int first = -1, last = 0;
+    do_set_image_position(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    set_bypass(true, true);
+    for(size_t j=0; j<SCREEN_HEIGHT; ++j) {
+        const uint8_t *row = img + j*SCREEN_WIDTH/8;
+        read_bank(0, j, 1, SCREEN_WIDTH/8, prev, 0, NULL);
+        bool changed = memcmp(prev, row, SCREEN_WIDTH/8) != 0;
+        if (changed) {
+            if (first < 0)
+                first = j;
+            last = j+1;
+        }
+        /* The RED bank is the previous image except on the rows that changed with the previous diff */
+        if (changed || (j >= diff_rows[0] && j < diff_rows[1])) {
+            set_ram_row(j);
+            write_command(SSD1681_RAM1_WRITE);
+            write_data(prev, SCREEN_WIDTH/8);
+        }
+        if (changed) {
+            set_ram_row(j);
+            write_command(SSD1681_RAM0_WRITE);
+            write_data(row, SCREEN_WIDTH/8);
+        }
     }
+    set_ram_row(0);
+
+    /* The RED bank was made equal to the B/W bank on the rows of the previous diff: nothing to show there */
+    diff_rows[0] = first < 0 ? 0 : first;
+    diff_rows[1] = last;
+    diff_valid = true;  /* set_bypass cleared it */
+    if (first < 0)
+        return false;
+
+    do_push_ws(ws);
+    if (fast)
+        do_show_rams_fast();
+    else
+        do_show_rams();
+    return true;
+}
+#else
+/* Shows the changes since the previous image of the rolling frame with the waveform settings \p ws,
+ * in display mode 2 when \p fast. Returns false when nothing changed. */
+STATIC bool show_changes(const uint8_t *img, const uint8_t *ws, bool fast) {
+    /* Nothing to compare to: start the rolling frame with a full refresh */
+    if (! diff_valid) {
+        do_show_image_bw(img);
+        memcpy(diff_prev, img, SCREEN_PLANE_SIZE);
+        diff_rows[0] = 0;  /* RED RAM was bypassed: it must be pushed entirely next time */
+        diff_rows[1] = SCREEN_HEIGHT;
+        diff_valid = true;
+        return true;
+    }
+
+    uint8_t first, last;
+    if (! find_changed_rows(diff_prev, img, &first, &last))
+        return false;
+
+    /* The RED RAM is the previous image except on the rows that changed with the previous diff,
+     * so push the rows that change now and the ones that changed before */
+    uint8_t y0 = first < diff_rows[0] ? first : diff_rows[0];
+    uint8_t y1 = last > diff_rows[1] ? last : diff_rows[1];
+    size_t offset = y0*SCREEN_WIDTH/8;
+
+    /* Image (0,0) is at the end of the RAM (see screen_fb_window) */
+    do_set_image_position(0, SCREEN_HEIGHT-y1, SCREEN_WIDTH, SCREEN_HEIGHT-y0);
+    do_push_ws(ws);
+    /* New image in B/W, previous in RED: the diff LUTs move the pixels 01 and 10 */
+    do_push_rams_window(img+offset, diff_prev+offset, SCREEN_WIDTH/8, SCREEN_WIDTH/8, y1-y0);
+    if (fast)
+        do_show_rams_fast();
+    else
+        do_show_rams();
+
+    memcpy(diff_prev+offset, img+offset, (y1-y0)*SCREEN_WIDTH/8);
+    diff_rows[0] = first;
+    diff_rows[1] = last;
+    diff_valid = true;
+    return true;
+}
+#endif
+
+STATIC void do_show_image_diff(const uint8_t *img) {
+    show_changes(img, screen_ws_1681_diff, false);
+}
+
+void screen_show_image_diff(const uint8_t *img) {
+    submit(&(command_t){.op = OP_SHOW_DIFF, .lsb = img});
+}
+
+
+STATIC void do_show_image_fast(const uint8_t *img) {
+    /* The short phases leave some ghosting, which builds up: clear it with a full refresh from time to time */
+    bool full = ! diff_valid || (fast_period && fast_updates >= fast_period);
+    if (full)
+        diff_valid = false;
+    if (show_changes(img, screen_ws_1681_fast, true))
+        fast_updates = full ? 0 : fast_updates+1;
+}
+
+void screen_show_image_fast(const uint8_t *img) {
+    submit(&(command_t){.op = OP_SHOW_FAST, .lsb = img});
+}
 
-    /* Configure RAM bypass to use only the pushed planes */
+void screen_set_fast_full_period(uint8_t period) {
+    fast_period = period;
+}
+
+
+/* Display update control 1 (0x21) that bypasses the banks not pushed */
+STATIC uint16_t bypass_command(bool use_lsb, bool use_msb) {
     uint16_t cmd = 0x21;
-    if(! lsb)
+    if(! use_lsb)
         cmd |= (0x05 << 8);  /* Bypass B/W bank */
-    if(! msb)
+    if(! use_msb)
         cmd |= (0x50 << 8);  /* Bypass RED bank */
+    return cmd;
+}
+
+/* Configure RAM bypass to use only the pushed planes, called before each RAM write */
+STATIC void set_bypass(bool use_lsb, bool use_msb) {
+    diff_valid = false;  /* The RAM will not be what the rolling frame expects */
+
+    uint16_t cmd = bypass_command(use_lsb, use_msb);
     send((uint8_t *)&cmd, 2);  /* Don't pass pointers to local variables when the callee may borrow them... */
+}
+
+
+STATIC void do_push_rams(const uint8_t *lsb, const uint8_t *msb, size_t len) {
+    set_bypass(lsb != NULL, msb != NULL);
 
     /* Push the image */
     if(lsb) {
-        gpio_put(BADGE_SCREEN_DC, 0);  /* Low for commands, high for data */
-        spi_write_blocking(spi0, "\x24", 1);  /* B/W RAM */
-        gpio_put(BADGE_SCREEN_DC, 1);
-        spi_write_blocking(spi0, lsb, len);
+        write_command(SSD1681_RAM0_WRITE);  /* B/W RAM */
+        write_data(lsb, len);
     }
 
     if(msb) {
-        gpio_put(BADGE_SCREEN_DC, 0);
-        spi_write_blocking(spi0, "\x26", 1);  /* RED RAM */
-        gpio_put(BADGE_SCREEN_DC, 1);
-        spi_write_blocking(spi0, msb, len);
+        write_command(SSD1681_RAM1_WRITE);  /* RED RAM */
+        write_data(msb, len);
+    }
+}
+
+void screen_push_rams(const uint8_t *lsb, const uint8_t *msb, size_t len) {
+    submit(&(command_t){.op = OP_PUSH_RAMS, .lsb = lsb, .msb = msb, .len = len});
+}
+
+
+STATIC void do_push_rams_window(const uint8_t *lsb, const uint8_t *msb, size_t stride, size_t row_len, size_t rows) {
+    set_bypass(lsb != NULL, msb != NULL);
+
+    /* Same as screen_push_rams, but row by row */
+    const uint8_t *planes[2] = {lsb, msb};
+    for(size_t i=0; i<2; ++i) {
+        if(! planes[i])
+            continue;
+        write_command(i == 0 ? SSD1681_RAM0_WRITE : SSD1681_RAM1_WRITE);
+        for(size_t j=0; j<rows; ++j)
+            write_data(planes[i] + j*stride, row_len);
     }
 }
 
+void screen_push_rams_window(const uint8_t *lsb, const uint8_t *msb, size_t stride, size_t row_len, size_t rows) {
+    submit(&(command_t){.op = OP_PUSH_WINDOW, .lsb = lsb, .msb = msb, .len = row_len, .stride = stride, .rows = rows});
+}
 
-void screen_show_rams(void) {
-    if (screen_busy()) {
-        log_warning("screen_show_rams() called but screen is busy");
-        return;
+
+/* Sends decompressed bytes to the RAM bank selected by the last command */
+STATIC void z_flush(const uint8_t *buf, size_t len) {
+    write_data(buf, len);
+}
+
+/* Puts a byte in the ring and flushes each half when it is full, returns the new output length */
+static inline size_t z_put(size_t out, uint8_t b, void (*flush)(const uint8_t *, size_t)) {
+    z_ring[out & (Z_RING_SIZE-1)] = b;
+    ++out;
+    if ((out & (Z_RING_SIZE/2-1)) == 0)
+        flush(z_ring + ((out-Z_RING_SIZE/2) & (Z_RING_SIZE-1)), Z_RING_SIZE/2);
+    return out;
+}
+
+/* Decompresses a plane (see screen_z_method_t) and gives it to flush by chunks, returns its length or 0 if invalid */
+STATIC size_t z_unpack(const uint8_t *z, void (*flush)(const uint8_t *, size_t)) {
+    size_t len = z[1] | (z[2] << 8);
+    const uint8_t *p = z+3;
+    size_t out = 0;
+
+    switch(z[0]) {
+        case SCREEN_Z_RAW:
+            flush(p, len);
+            return len;
+        case SCREEN_Z_RLE:
+            while(out < len) {
+                uint8_t c = *p++;
+                if (c < 128) {
+                    for(size_t i=0; i<=c; ++i)
+                        out = z_put(out, *p++, flush);
+                } else {
+                    uint8_t b = *p++;
+                    for(size_t i=0; i<c-125u; ++i)
+                        out = z_put(out, b, flush);
+                }
+            }
+            break;
+        case SCREEN_Z_LZ:
+            while(out < len) {
+                uint8_t flags = *p++;
+                for(size_t bit=0; bit<8 && out<len; ++bit) {
+                    if (flags & (1 << bit)) {
+                        out = z_put(out, *p++, flush);
+                    } else {
+                        size_t dist = p[0]+1, n = p[1]+3;
+                        p += 2;
+                        /* Byte by byte, the match can overlap the bytes being written */
+                        for(size_t i=0; i<n; ++i)
+                            out = z_put(out, z_ring[(out-dist) & (Z_RING_SIZE-1)], flush);
+                    }
+                }
+            }
+            break;
+        default:
+            log_warning("z_unpack() unknown compression method %d", z[0]);
+            return 0;
+    }
+
+    /* The last partial half */
+    size_t rem = out & (Z_RING_SIZE/2-1);
+    if (rem)
+        flush(z_ring + ((out-rem) & (Z_RING_SIZE-1)), rem);
+    return out;
+}
+
+
+STATIC size_t do_push_rams_z(const uint8_t *lsb_z, const uint8_t *msb_z) {
+    set_bypass(lsb_z != NULL, msb_z != NULL);
+
+    const uint8_t *planes[2] = {lsb_z, msb_z};
+    size_t total = 0;
+    for(size_t i=0; i<2; ++i) {
+        if(! planes[i])
+            continue;
+        write_command(i == 0 ? SSD1681_RAM0_WRITE : SSD1681_RAM1_WRITE);
+        size_t len = z_unpack(planes[i], z_flush);
+        if (! len)
+            return 0;
+        total += len;
     }
+    return total;
+}
+
+size_t screen_push_rams_z(const uint8_t *lsb_z, const uint8_t *msb_z) {
+    submit(&(command_t){.op = OP_PUSH_Z, .lsb = lsb_z, .msb = msb_z});
+    /* The planes may not be decoded yet, but their headers tell their lengths */
+    return (lsb_z ? lsb_z[1] | (lsb_z[2] << 8) : 0) + (msb_z ? msb_z[1] | (msb_z[2] << 8) : 0);
+}
+
+
+STATIC void do_push_rams_async(const uint8_t *lsb, const uint8_t *msb, size_t len, screen_callback_t done) {
+    set_bypass(lsb != NULL, msb != NULL);
+
+    /* The DMA interrupt does the rest */
+    push_planes[0] = lsb;
+    push_planes[1] = msb;
+    push_len = len;
+    push_done = done;
+    push_ongoing = true;
+    push_next_plane();
+}
 
+void screen_push_rams_async(const uint8_t *lsb, const uint8_t *msb, size_t len, screen_callback_t done) {
+    submit(&(command_t){.op = OP_PUSH_ASYNC, .lsb = lsb, .msb = msb, .len = len, .done = done});
+}
+
+
+bool screen_pushing(void) {
+    return push_ongoing;
+}
+
+
+/* FNV-1a, the M0+ multiplies in a cycle */
+#define CHECKSUM_INIT 2166136261u
+static inline uint32_t checksum_add(uint32_t sum, const uint8_t *buf, size_t len) {
+    for(size_t i=0; i<len; ++i)
+        sum = (sum ^ buf[i]) * 16777619u;
+    return sum;
+}
+
+uint32_t screen_checksum(const uint8_t *plane, size_t stride, size_t row_len, size_t rows) {
+    uint32_t sum = CHECKSUM_INIT;
+    for(size_t j=0; j<rows; ++j)
+        sum = checksum_add(sum, plane + j*stride, row_len);
+    return sum;
+}
+
+
+/* Reads the rows [j0, j0+rows[ of the current window of a RAM bank (0 for B/W, 1 for RED),
+ * to dst and/or to the checksum sum. A row at a time: each read starts with a dummy byte. */
+STATIC void read_bank(uint8_t bank, size_t j0, size_t rows, size_t row_len, uint8_t *dst, size_t stride, uint32_t *sum) {
+    uint8_t buf[1 + SCREEN_WIDTH/8];
+    uint16_t cmd = SSD1681_RAM_SELECT | (bank << 8);
+    send((uint8_t *)&cmd, 2);
+    for(size_t j=j0; j<j0+rows; ++j) {
+        set_ram_row(j);
+        receive(SSD1681_RAM_READ, buf, 1+row_len);
+        if (dst)
+            memcpy(dst + (j-j0)*stride, buf+1, row_len);
+        if (sum)
+            *sum = checksum_add(*sum, buf+1, row_len);
+    }
+}
+
+/* Runs a command that returns something right away: the queue must be empty and the controller free */
+STATIC bool run_now(void) {
+    screen_task();
+    uint32_t irq = save_and_disable_interrupts();
+    bool now = !running && queue_len == 0 && !controller_busy();
+    if (now)
+        running = true;
+    restore_interrupts(irq);
+    return now;
+}
+
+STATIC void run_now_end(void) {
+    set_ram_row(0);  /* The next push starts at the window again */
+    running = false;
+    screen_task();
+}
+
+bool screen_read_rams_window(uint8_t *lsb, uint8_t *msb, size_t stride, size_t row_len, size_t rows) {
+    if (row_len > SCREEN_WIDTH/8 || ! run_now())
+        return false;
+    uint8_t *planes[2] = {lsb, msb};
+    for(uint8_t i=0; i<2; ++i)
+        if (planes[i])
+            read_bank(i, 0, rows, row_len, planes[i], stride, NULL);
+    run_now_end();
+    return true;
+}
+
+bool screen_checksum_rams_window(uint32_t *lsb_sum, uint32_t *msb_sum, size_t row_len, size_t rows) {
+    if (row_len > SCREEN_WIDTH/8 || ! run_now())
+        return false;
+    uint32_t *sums[2] = {lsb_sum, msb_sum};
+    for(uint8_t i=0; i<2; ++i)
+        if (sums[i]) {
+            *sums[i] = CHECKSUM_INIT;
+            read_bank(i, 0, rows, row_len, NULL, 0, sums[i]);
+        }
+    run_now_end();
+    return true;
+}
+
+
+STATIC void do_show_rams(void) {
     /* Configure then Activate */
     /* 0xC7 seems the normal mode for our target */
     /* 0xF7 (load temperature) on the b version (Red) */
-    /* 0xCF for the partial image (display mode 2) */
+    /* 0xCF for the partial image (display mode 2), see do_show_rams_fast */
     send("\x22\xC7", 2);
+    refreshing = true;
     send("\x20", 1);
 }
 
+void screen_show_rams(void) {
+    submit(&(command_t){.op = OP_SHOW_RAMS});
+}
 
-void screen_push_ws(const uint8_t *luts) {
-    if (screen_busy()) {
-        log_warning("screen_push_ws() called but screen is busy");
+
+STATIC void do_show_rams_fast(void) {
+    /* Same sequence (clock and analog on, display, analog and clock off), in display mode 2 */
+    send("\x22\xCF", 2);
+    refreshing = true;
+    send("\x20", 1);
+}
+
+void screen_show_rams_fast(void) {
+    submit(&(command_t){.op = OP_SHOW_RAMS_FAST});
+}
+
+
+STATIC void do_push_ws(const uint8_t *luts) {
+    /* Slideshows load the same LUT for every frame: skip it when the controller already has it */
+    if (ws_valid && memcmp(ws_resident, luts, WS_SIZE) == 0) {
+        ++ws_stats.skipped;
+        ws_stats.bytes_saved += WS_UPLOAD_BYTES;
+        ws_stats.commands_saved += WS_UPLOAD_COMMANDS;
         return;
     }
+    ++ws_stats.uploaded;
+    memcpy(ws_resident, luts, WS_SIZE);
+    ws_valid = true;
 
     /* First 153 are the LUT + similar parameters */
-    gpio_put(BADGE_SCREEN_DC, 0);  /* Low for commands, high for data */
-    spi_write_blocking(spi0, "\x32", 1);
-    gpio_put(BADGE_SCREEN_DC, 1);
-    spi_write_blocking(spi0, luts, 153);
+    write_command(0x32);
+    write_data(luts, 153);
 
     /* Then EOPT, VGH, VSH1, VSH2, VSL, VCOM */
     /* Put the command in a 4 bytes int, as the longest command has 3 params */
@@ -366,6 +1138,182 @@ void screen_push_ws(const uint8_t *luts) {
     /* Then configure soft booster start !! TODO */
 }
 
+void screen_push_ws(const uint8_t *luts) {
+    submit(&(command_t){.op = OP_PUSH_WS, .lsb = luts});
+}
+
+
+screen_ws_stats_t screen_ws_stats(void) {
+    return ws_stats;
+}
+
+
+/* A full frame replaces everything that is shown, the RAM operations are what it replaces */
+STATIC bool is_full_frame(op_t op) {
+    return op == OP_CLEAR || op == OP_SHOW_BW || op == OP_SHOW_4G || op == OP_SHOW_Z || op == OP_SHOW_DIFF
+        || op == OP_SHOW_FAST;
+}
+
+STATIC bool is_ram_op(op_t op) {
+    return op == OP_POSITION || op == OP_PUSH_RAMS || op == OP_PUSH_WINDOW || op == OP_PUSH_Z
+        || op == OP_SHOW_RAMS || op == OP_SHOW_RAMS_FAST || op == OP_PUSH_WS;
+}
+
+
+/* Adds a command to the queue, must be called with the interrupts disabled (logs are left to the caller).
+ * A full frame removes the queued commands that it supersedes, back to a deep sleep or an asynchronous push
+ * (the callback must still be called). A clear only supersedes full frames, as it does not set the RAM.
+ * Returns false when the queue is full and the command dropped, *dropped counts the superseded ones. */
+STATIC bool enqueue(const command_t *cmd, size_t *dropped) {
+    *dropped = 0;
+    if (is_full_frame(cmd->op)) {
+        for(size_t i=queue_len; i>0; --i) {
+            op_t op = queue[i-1].op;
+            if (op == OP_DEEP_SLEEP || op == OP_PUSH_ASYNC)
+                break;
+            if (is_full_frame(op) || (cmd->op != OP_CLEAR && is_ram_op(op))) {
+                memmove(&queue[i-1], &queue[i], (queue_len-i)*sizeof(command_t));
+                --queue_len;
+                ++*dropped;
+            }
+        }
+    }
+
+    if (queue_len >= SCREEN_QUEUE_SIZE)
+        return false;
+    queue[queue_len++] = *cmd;
+    return true;
+}
+
+
+STATIC void run(const command_t *cmd) {
+    switch(cmd->op) {
+    case OP_BORDER:
+        do_border(cmd->color);
+        break;
+    case OP_CLEAR:
+        do_clear(cmd->bit);
+        break;
+    case OP_DEEP_SLEEP:
+        do_deep_sleep();
+        break;
+    case OP_POSITION:
+        do_set_image_position(cmd->window[0], cmd->window[1], cmd->window[2], cmd->window[3]);
+        break;
+    case OP_SHOW_BW:
+        do_show_image_bw(cmd->lsb);
+        break;
+    case OP_SHOW_4G:
+        do_show_image_4g(cmd->lsb, cmd->msb);
+        break;
+    case OP_SHOW_Z:
+        do_show_image_z(cmd->lsb, cmd->msb);
+        break;
+    case OP_SHOW_DIFF:
+        do_show_image_diff(cmd->lsb);
+        break;
+    case OP_SHOW_FAST:
+        do_show_image_fast(cmd->lsb);
+        break;
+    case OP_PUSH_RAMS:
+        do_push_rams(cmd->lsb, cmd->msb, cmd->len);
+        break;
+    case OP_PUSH_WINDOW:
+        do_push_rams_window(cmd->lsb, cmd->msb, cmd->stride, cmd->len, cmd->rows);
+        break;
+    case OP_PUSH_Z:
+        do_push_rams_z(cmd->lsb, cmd->msb);
+        break;
+    case OP_PUSH_ASYNC:
+        do_push_rams_async(cmd->lsb, cmd->msb, cmd->len, cmd->done);
+        break;
+    case OP_SHOW_RAMS:
+        do_show_rams();
+        break;
+    case OP_SHOW_RAMS_FAST:
+        do_show_rams_fast();
+        break;
+    case OP_PUSH_WS:
+        do_push_ws(cmd->lsb);
+        break;
+    }
+}
+
+
+/* Runs the command now if nothing else is queued and the screen is free, else queues it */
+STATIC void submit(const command_t *cmd) {
+    screen_task();  /* Older commands first */
+
+    size_t dropped = 0;
+    bool queued = true;
+    uint32_t irq = save_and_disable_interrupts();
+    bool now = !running && queue_len == 0 && !controller_busy();
+    if (now)
+        running = true;
+    else
+        queued = enqueue(cmd, &dropped);
+    restore_interrupts(irq);
+
+    /* Logged with the interrupts enabled */
+    if (dropped)
+        log_info("screen: %u queued commands superseded", (unsigned)dropped);
+    if (! queued)
+        log_warning("screen: queue full, command %d dropped", cmd->op);
+
+    if (now) {
+        run(cmd);
+        running = false;
+        screen_task();  /* Commands queued by interrupts meanwhile */
+    }
+}
+
+
+void screen_task(void) {
+    while(true) {
+        command_t cmd;
+        uint32_t irq = save_and_disable_interrupts();
+        bool now = !running && queue_len > 0 && !controller_busy();
+        if (now) {
+            running = true;
+            cmd = queue[0];
+            --queue_len;
+            memmove(&queue[0], &queue[1], queue_len*sizeof(command_t));
+        }
+        restore_interrupts(irq);
+
+        if (! now)
+            return;
+        run(&cmd);
+        running = false;
+    }
+}
+
+
+/* Spare IRQ raised by busy_irq and push_end: the other interrupts (e.g. the radio) preempt the callbacks
+ * and the blocking commands, which run here in order */
+STATIC void task_irq_handler(void) {
+    uint32_t irq = save_and_disable_interrupts();
+    bool ready = ready_pending, refresh = refresh_pending;
+    screen_callback_t pushed = push_done_pending;
+    ready_pending = false;
+    refresh_pending = false;
+    push_done_pending = NULL;
+    restore_interrupts(irq);
+
+    if (pushed)
+        pushed();
+    if (ready && ready_cb)
+        ready_cb();
+    if (refresh && refresh_cb)
+        refresh_cb();
+    screen_task();
+}
+
+
+size_t screen_queued(void) {
+    return queue_len;
+}
+
 
 const uint8_t screen_ws_1681_bw[159] = \
     "\x80\x48\x40\x00\x00\x00\x00\x00\x00\x00\x00\x00" /* r=0, bw=0 */ \
@@ -448,3 +1396,31 @@ const uint8_t screen_ws_1681_diff[159] = \
     "\x00"  /* VSH2, 0x00 == ???, POR is 5V */\
     "\x32"  /*  VSL, 0x32 == -15V */          \
     "\x20"; /* VCOM, 0x20 == -0.8V */
+
+/* Same as the diff one, with fewer frames at twice the frame rate: one short phase, for display mode 2 */
+const uint8_t screen_ws_1681_fast[159] = \
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" /* 00 = no touch */ \
+    "\x80\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" /* 01 = lighter */ \
+    "\x40\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" /* 10 = darker */ \
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" /* 11 = no touch */ \
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00" \
+    "\x05\x00\x00\x00\x00\x00\x00" /* TP[0A], TP[0B], SR[0AB], TP[0C], TP[0D], SR[0CD], RP[0] */ \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x00\x00\x00\x00\x00\x00\x00" \
+    "\x44\x22\x22\x22\x22\x22" "\x00\x00\x00" /* FR[0] = 0x4 */ \
+    "\x00"  /* EOPT, 0x22 = normal */         \
+    "\x17"  /*  VGH, 0x17 == 0x00 == 20V */   \
+    "\x41"  /* VSH1, 0x41 == 15V */           \
+    /* This LUT never uses VSH2 */            \
+    "\x00"  /* VSH2, 0x00 == ???, POR is 5V */\
+    "\x32"  /*  VSL, 0x32 == -15V */          \
+    "\x20"; /* VCOM, 0x20 == -0.8V */
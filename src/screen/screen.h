@@ -15,29 +15,42 @@
  *
  * However, we can't wait for an image to be completely rendered, as this takes around 1s.
  *
- * If image transfer is not quick enough, we can use DMA with SPI DREQ to transfer data to the screen.
- * However, be aware that the D/C pin must be low when pushing the first byte, then it must be kept high.
- *
- * Most of the commands require the screen to not be busy, which means that it must be booted
- * and not currently working. Few of the commands take time (e.g. rendering) and the documentation of the functions
- * explain when to be not busy and whether the screen will be busy afterwards.
+ * If image transfer is not quick enough, use screen_push_rams_async() which transfers the planes with DMA (SPI DREQ).
+ * The D/C pin must be low when pushing the first byte, then it must be kept high:
+ * the command bytes are sent by the CPU and the planes by the DMA, the DMA interrupt sequences them.
+ *
+ * The commands are sent when the screen is not busy, which means that it is booted and not currently working.
+ * Few of the commands take time (e.g. rendering) and the documentation of the functions
+ * explain whether the screen will be busy afterwards.
+ * Commands given while the screen is busy are queued (at most \ref SCREEN_QUEUE_SIZE), then sent in order
+ * when the screen is not busy anymore: from the falling edge of BUSY, or by screen_task()
+ * (also called by screen_busy() and by each command).
+ * The GPIO and DMA interrupt handlers only advance the boot and the asynchronous push: the callbacks and the queued
+ * commands run from a spare IRQ at the lowest priority, raised by them, so that the blocking pushes of the planes
+ * (several ms of SPI for a full image) are preempted by the other interrupts (e.g. the radio).
+ * The commands do not log from there, except the warning of an invalid compressed plane.
+ * A full frame (screen_show_image_* or screen_clear()) supersedes the queued frames and RAM operations,
+ * so that a slow screen always shows the latest frame. The planes given to queued commands are borrowed
+ * until the commands are sent.
  *
  * Another note is that the MOSI/TX and MISO/RX pins are a single pin of the e-Paper device (DIN).
  * You have to put the TX pin to another GPIO function so that it does not overwrite the RX pin while reading.
  *
  * You can compile images using the image2epaper.py script.
+ * With --compress, the planes are compressed (run length or LZSS, whichever is smaller, see image2epaper.py),
+ * and screen_push_rams_z() decodes them straight to the SPI through a 512 bytes ring, without a full plane in RAM.
  *
  * The usual use of this library is:
  * - screen_init(),
- * - call screen_boot() regularly until it returns true (~15ms),
+ * - screen_boot(), then poll it until it returns true (~21ms) or wait for the ready callback (screen_set_callbacks()),
  * - now you can push an image:
  *   - set the image position with screen_set_image_position(),
  *   - use one of the screen_show_image_* functions,
  *   - or manually screen_set_ws() to load some waveform settings to choose your color mode and refresh style
  *     (black and white, or 4 grays, partial/full refresh, ...),
- *     then screen_push_rams() to load the image in the RAM banks,
+ *     then screen_push_rams() (or screen_push_rams_async()) to load the image in the RAM banks,
  *     then screen_show_rams() to actually show your image,
- *   - wait for screen_busy() to go low (~1s)
+ *   - wait for screen_busy() to go low (~1s), or call screen_task() regularly and give the next commands anytime
  * - either push another image
  * - or go screen_deep_sleep() -> call screen_boot() to reset and push other images.
  *
@@ -49,10 +62,10 @@
  *  and to not refresh the screen too much (> 3 minutes between refreshes (!!!)).
  *
  * TODO:
- * - text -> probably too complex, we will send pre-rendered images,
+ * - ~~text -> probably too complex, we will send pre-rendered images~~ -> text.h, drawn in the planes,
  * - ~~have a ws that uses the RED ram as a mask to NOT update some pixels (overlay)~~
- *   have a ws that does not change pixels that are equals in both RAMs, and update the others
- *   -> have a "rolling frame" and show the diffs,
+ *   ~~have a ws that does not change pixels that are equals in both RAMs, and update the others
+ *   -> have a "rolling frame" and show the diffs~~ -> screen_show_image_diff(),
  * - try to have more gray levels (try to adjust the FR[n]),
  * - have a ws that refresh a zone of the RAM (uses the RED mask to not touch the rest), so that a previous black can be canceled,
  *   then push the new image for that zone and draw it quicker/without traces,
@@ -64,29 +77,102 @@
 
 #define SCREEN_HEIGHT 200
 #define SCREEN_WIDTH 200
+/** Size of a fullscreen bitplane, in bytes (pixels are packed 8 per byte along X) */
+#define SCREEN_PLANE_SIZE (SCREEN_WIDTH*SCREEN_HEIGHT/8)
+
+/** Maximum number of commands waiting for the screen, see \ref screen_task */
+#define SCREEN_QUEUE_SIZE 16
+
+/** Number of fast updates between two full refreshes by default, see \ref screen_show_image_fast. */
+#define SCREEN_FAST_FULL_PERIOD 10
+
+/** \brief Callback for asynchronous operations.
+ *
+ * Called from the spare IRQ of the library, at the lowest priority: other interrupts preempt it,
+ * and you can call other screen functions from there. */
+typedef void (*screen_callback_t)(void);
+
+/** \brief Compression method of a plane, first byte of the planes generated by image2epaper.py --compress.
+ *
+ * The method is followed by the decompressed length (2 bytes, little-endian) then the data. */
+typedef enum {
+    SCREEN_Z_RAW = 0,  /**< Not compressed */
+    SCREEN_Z_RLE = 1,  /**< c < 128: c+1 literal bytes follow, c >= 128: the next byte is repeated c-125 times */
+    SCREEN_Z_LZ  = 2,  /**< LZSS: a flag byte for the next 8 items, LSB first, 1 for a literal byte,
+                        *   0 for a match of 2 bytes (distance-1, length-3), at most 256 bytes back */
+} screen_z_method_t;
+
+/** \brief Waveform settings uploads, see \ref screen_push_ws. */
+typedef struct {
+    uint32_t uploaded;
+    uint32_t skipped;         /**< Identical to the settings already in the controller */
+    uint32_t bytes_saved;     /**< SPI bytes not sent because of the skipped uploads */
+    uint32_t commands_saved;  /**< Commands not sent (5 per upload) */
+} screen_ws_stats_t;
+
+/** \brief Length of the steps of the last boot, see \ref screen_boot_timings. */
+typedef struct {
+    uint32_t sleep_us;         /**< Wait for the power to settle (0 when waking up) */
+    uint32_t hwreset_us;       /**< RST low */
+    uint32_t hwreset_busy_us;  /**< BUSY high after RST */
+    uint32_t swreset_us;       /**< Software reset (0 when waking up) */
+    uint32_t setup_us;         /**< Settings, temperature and LUT load */
+    uint32_t total_us;
+    bool wake;                 /**< Whether it was a wake up from \ref screen_deep_sleep */
+} screen_boot_timings_t;
 
 /** \brief Initialize the screen library for write operations. */
 void screen_init(void);
 
 /** \brief Boots the screen (hard reset, soft reset, setup).
  *
- * Booting is a long process (~21ms) and this function goes through the steps to boot.
- * This function does not block more than hundreds of µs to send commands through the SPI,
- * hence it must be called regularly (e.g. 100Hz) until it returns true.
- * Must be called after \ref screen_init.
+ * Booting is a long process (~21ms). The first call starts it, then the steps are done from interrupts:
+ * one-shot alarms for the fixed delays, and the falling edges of the BUSY pin for the others,
+ * so the screen is ready as soon as the hardware allows it.
+ * Polling it (e.g. `while(! screen_boot())`) is still fine, and it logs the length of the steps once ready.
+ * Must be called after \ref screen_init, and to wake up after \ref screen_deep_sleep.
  *
- * \return true when ready, after at least 4 calls. */
+ * Waking up is shorter (~8ms): the power is already settled and the hardware reset already reset the registers,
+ * so there is no wait before the reset nor software reset.
+ * The temperature measured by the previous boot is written to the controller instead of measured again,
+ * unless it is older than 10 minutes.
+ *
+ * \return true when ready. */
 bool screen_boot(void);
 
+/** \brief Length of the steps of the last boot, valid once \ref screen_boot returned true. */
+screen_boot_timings_t screen_boot_timings(void);
+
+/** \brief Sets the functions called when the screen is ready after a boot, and when a refresh is done.
+ *
+ * They are called after the falling edge of BUSY (see \ref screen_callback_t), before the queued commands are sent.
+ * For instance, calling \ref screen_deep_sleep() from \p refresh_done puts the screen asleep
+ * as soon as it is not used anymore.
+ *
+ * \param ready        Called at the end of the boot, NULL for none.
+ * \param refresh_done Called at the end of screen_clear(), screen_show_rams() and screen_show_image_*(),
+ *                     NULL for none. */
+void screen_set_callbacks(screen_callback_t ready, screen_callback_t refresh_done);
+
 /** \brief Tells whether the screen is busy for now.
  *
- * The screen cannot receive commands while busy.
- * Also returns true when the screen is not ready (\ref screen_boot). */
+ * The commands given while busy are queued.
+ * Also returns true when the screen is not ready (\ref screen_boot),
+ * when an asynchronous push is ongoing (\ref screen_push_rams_async) or when commands are queued.
+ * Sends the queued commands that can be sent (\ref screen_task). */
 bool screen_busy(void);
 
+/** \brief Sends the queued commands, until the screen is busy or the queue is empty.
+ *
+ * Call it regularly (or call \ref screen_busy) to drain the queue. */
+void screen_task(void);
+
+/** \brief Number of commands waiting in the queue. */
+size_t screen_queued(void);
+
 /** \brief Sets the border color.
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  *
  * \param color Choose the color from the LUTs
  *              (for B/W will be 0 or 2=black, 1 or 3=white, for 4 grays will be 0 black to 3 white) */
@@ -94,7 +180,7 @@ void screen_border(uint8_t color);
 
 /** \brief Show a uniform image. Clear to white before storing the screen for long times (days).
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  * This keeps the screen busy for a while (~1.8s).
  *
  * Bypasses the RAM content to display \param on the whole bit but uses the current LUTs,
@@ -107,14 +193,14 @@ void screen_clear(bool bit);
 
 /** \brief Put the screen in deep sleep mode. Should be done after pushing images.
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  *
  * After being asleep, the screen will stay busy and needs to be booted again, see \ref screen_boot. */
 void screen_deep_sleep(void);
 
 /** \brief Show the image fullscreen with 2 colors (black and white).
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  * This keeps the screen busy for a while (~1.8s).
  *
  * The screen will be cleared before showing your image.
@@ -127,7 +213,7 @@ void screen_show_image_bw(const uint8_t *img);
 
 /** \brief Show the image fullscreen with 4 colors (4 gray levels).
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  * This keeps the screen busy for a while (~1.9s).
  *
  * The screen will be cleared before showing your image.
@@ -141,9 +227,54 @@ void screen_show_image_bw(const uint8_t *img);
  * \param lsb   The image MSB plane, which must be of size 5000 */
 void screen_show_image_4g(const uint8_t *lsb, const uint8_t *msb);
 
+/** \brief Show a compressed image fullscreen, with 2 colors (\p msb_z is NULL) or 4 grays.
+ *
+ * Same as \ref screen_show_image_bw and \ref screen_show_image_4g, with planes generated by image2epaper.py --compress.
+ *
+ * \param lsb_z The compressed LSB plane, which must decompress to 5000 bytes
+ * \param msb_z The compressed MSB plane (or NULL for a black and white image) */
+void screen_show_image_z(const uint8_t *lsb_z, const uint8_t *msb_z);
+
+/** \brief Show the image fullscreen with 2 colors, only driving the pixels that changed since the previous call.
+ *
+ * Queued while the screen is busy.
+ * This keeps the screen busy for a while, but less than a full refresh, and without flickering.
+ *
+ * The library keeps a copy of the previous image. The new image is pushed in the B/W RAM,
+ * the previous one in the RED RAM, and \ref screen_ws_1681_diff lightens or darkens the pixels that differ.
+ * Only the rows that changed are pushed (compared 32 bits at a time, faster if \p img is aligned on 4 bytes),
+ * and nothing is done when the image did not change.
+ *
+ * Experimental, not verified on a badge yet: with cmake -DBADGE_SCREEN_DIFF_READBACK=ON, the library does not keep
+ * the copy (5000 bytes): the previous image is read back from the B/W RAM a row at a time (~20ms), and the rows to
+ * update are copied to the RED RAM before the new ones are written (see \ref screen_read_rams_window).
+ * Keep the default until the reads have been checked on hardware.
+ *
+ * The first call (or after any other function that changes or hides the RAM content) does a full refresh
+ * (\ref screen_show_image_bw), the next ones show the differences.
+ *
+ * \param img   The image buffer, which must be of size 5000 (=200*(200/8)) */
+void screen_show_image_diff(const uint8_t *img);
+
+/** \brief Same as \ref screen_show_image_diff, with short phases in display mode 2 (~0.3s instead of ~0.4s to 1.8s).
+ *
+ * Queued while the screen is busy.
+ *
+ * Uses \ref screen_ws_1681_fast, which leaves some ghosting on the changed pixels.
+ * The ghosting is cleared by a full refresh (\ref screen_show_image_bw) every \ref SCREEN_FAST_FULL_PERIOD fast updates,
+ * see \ref screen_set_fast_full_period.
+ *
+ * \param img   The image buffer, which must be of size 5000 (=200*(200/8)) */
+void screen_show_image_fast(const uint8_t *img);
+
+/** \brief Sets the number of fast updates between two full refreshes of \ref screen_show_image_fast.
+ *
+ * \param period Number of fast updates, 0 to never do a full refresh (but the first one). */
+void screen_set_fast_full_period(uint8_t period);
+
 /** \brief Set the screen position of the next image
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  *
  * The (0,0) origin is in the lower right angle.
  * The X coordinates can only be controlled by increments of 8 (0*8 to 25*8=200).
@@ -158,14 +289,13 @@ void screen_show_image_4g(const uint8_t *lsb, const uint8_t *msb);
  * There may be a bug/feature when you push too much data to the window,
  * it will leak on lines with y < y0.
  *
- * \return The number of bytes of the bitplane to push (image size = (y1-y0)*((x1-x0)//8))
- * \return SIZE_T_MAX when the screen is busy */
+ * \return The number of bytes of the bitplane to push (image size = (y1-y0)*((x1-x0)//8)) */
 size_t screen_set_image_position(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
 #define screen_clear_image_position() screen_set_image_position(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)
 
 /** \brief Low level: push an image with 2 bit planes in the current screen position.
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  *
  * The image size depends on the currently selected window size.
  * The image is organized in 2 planes: one is the most significant bit (\param MSB) of the pixel color,
@@ -183,27 +313,122 @@ size_t screen_set_image_position(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
  */
 void screen_push_rams(const uint8_t *lsb, const uint8_t *msb, size_t len);
 
+/** \brief Low level: same as \ref screen_push_rams, but the pushed window is cut from larger planes.
+ *
+ * Queued while the screen is busy.
+ *
+ * Pushes \p rows rows of \p row_len bytes, each row starting \p stride bytes after the previous one.
+ * This is used to push a sub-window of a fullscreen buffer (see screen_fb.h).
+ *
+ * \param lsb       The least significant bitplane of the image, pointing to the first byte of the window (or NULL).
+ * \param msb       The most significant bitplane of the image, pointing to the first byte of the window (or NULL).
+ * \param stride    Number of bytes between two rows of the planes (25 for fullscreen planes).
+ * \param row_len   Number of bytes of a row of the window (window width / 8).
+ * \param rows      Number of rows of the window. */
+void screen_push_rams_window(const uint8_t *lsb, const uint8_t *msb, size_t stride, size_t row_len, size_t rows);
+
+/** \brief Low level: same as \ref screen_push_rams, but the planes are transferred by DMA.
+ *
+ * Queued while the screen is busy.
+ * This keeps the screen busy until both planes are transferred (~5ms for 2 planes @20MHz),
+ * but the function returns after a few µs, and the CPU is free in the meantime.
+ *
+ * The planes are borrowed until the transfer is complete, don't modify them before.
+ *
+ * \param lsb   The least significant bitplane of the image (or NULL).
+ * \param msb   The most significant bitplane of the image (or NULL).
+ * \param len   The length of both planes, in bytes (<= 5000).
+ * \param done  Called after the DMA interrupt when the transfer is complete (or NULL, then poll \ref screen_pushing). */
+void screen_push_rams_async(const uint8_t *lsb, const uint8_t *msb, size_t len, screen_callback_t done);
+
+/** \brief Low level: same as \ref screen_push_rams, with compressed planes (see \ref screen_z_method_t).
+ *
+ * Queued while the screen is busy.
+ *
+ * The planes are decompressed in a small ring buffer, which is sent to the RAM banks 256 bytes at a time,
+ * so that the decompression and the transfer are interleaved.
+ * The decompressed length must match the current window.
+ *
+ * \param lsb_z The compressed least significant bitplane of the image (or NULL).
+ * \param msb_z The compressed most significant bitplane of the image (or NULL).
+ * \return The number of decompressed bytes to push in the RAM banks, as told by the headers of the planes. */
+size_t screen_push_rams_z(const uint8_t *lsb_z, const uint8_t *msb_z);
+
+/** \brief Tells whether an asynchronous push is still ongoing. */
+bool screen_pushing(void);
+
+/** \brief Low level: reads the current window of the RAM banks, the reverse of \ref screen_push_rams_window.
+ *
+ * Not queued: returns false right away when the screen is busy or commands are queued.
+ * TX is disconnected from DIN during the reads (see the note at the top), which has not been verified on hardware yet.
+ * The reads are slower than the writes (2.5MHz, ~16ms for a fullscreen plane) and block the caller,
+ * a row at a time (SSD1681_RAM_READ starts with a dummy byte). The RAM counters are back at the start of the
+ * window afterwards, so the next push is not disturbed.
+ *
+ * \param lsb       Destination of the B/W RAM (or NULL).
+ * \param msb       Destination of the RED RAM (or NULL).
+ * \param stride    Number of bytes between two rows of the destinations.
+ * \param row_len   Number of bytes of a row of the window (window width / 8, <= 25).
+ * \param rows      Number of rows of the window.
+ * \return true when read. */
+bool screen_read_rams_window(uint8_t *lsb, uint8_t *msb, size_t stride, size_t row_len, size_t rows);
+
+/** \brief Low level: same as \ref screen_read_rams_window, but only computes the checksums of the banks.
+ *
+ * Compare them with \ref screen_checksum of the planes to verify a push, e.g. after long or asynchronous transfers,
+ * without a buffer for the read planes.
+ *
+ * \return true when read. */
+bool screen_checksum_rams_window(uint32_t *lsb_sum, uint32_t *msb_sum, size_t row_len, size_t rows);
+
+/** \brief Checksum of a window of a plane in memory (FNV-1a of the bytes, row after row). */
+uint32_t screen_checksum(const uint8_t *plane, size_t stride, size_t row_len, size_t rows);
+
 /** \brief Low level: actually show the image in RAM using the current waveform settings pushed to screen.
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  * This keeps the screen busy for a while.
  *
  * Use with \ref screen_push_ws and \ref screen_push_rams. */
 void screen_show_rams(void);
 
+/** \brief Low level: same as \ref screen_show_rams, in display mode 2 (partial update).
+ *
+ * Queued while the screen is busy.
+ *
+ * Use with waveform settings that only drive the pixels that change, such as \ref screen_ws_1681_fast. */
+void screen_show_rams_fast(void);
+
 /** \brief Low level: push a new Waveform Settings to the screen.
  *
  * You should read the SSD1681 datasheet to understand how to program the waveform settings.
  * It is meant to be able to develop new LUT and enhance your display.
  *
- * The screen must not be busy.
+ * Queued while the screen is busy.
  *
  * \param lut The waveform settings (also called LUTs because most of it are 5 LUTs).
  *            Must be 159 bytes long: 153 for the VS+RP+TP+SP+FR+XON settings + 6 bytes for EOPT,
  *            VGH, VSH1, VSH2, VSL and VCOM.
+ *
+ * The controller keeps the last waveform settings until the next reset or deep sleep:
+ * pushing the same settings again sends nothing (see \ref screen_ws_stats).
  * */
 void screen_push_ws(const uint8_t *luts);
 
+/** \brief Counts the uploads of waveform settings, and the ones skipped because the controller already had them. */
+screen_ws_stats_t screen_ws_stats(void);
+
+/** \brief Temperature measured by the sensor of the screen at the last boot, in °C.
+ *
+ * The full refreshes (\ref screen_clear excepted) use a variant of \ref screen_ws_1681_bw or \ref screen_ws_1681_4grays
+ * for this temperature: the warmer, the less the clearing group is repeated. For a B/W image (~0.1s more in 4 grays):
+ * - 28°C and above: once, ~1.0s,
+ * - 15°C to 27°C: twice, ~1.35s,
+ * - 5°C to 14°C: 3 times as in the reference tables, ~1.7s,
+ * - below 5°C: 5 times, ~2.4s.
+ * The tables pushed with \ref screen_push_ws are used as they are. */
+int8_t screen_temperature(void);
+
 
 /** Waveform settings, taken from the Arduino "test suite".
  * 2 colors, only uses the B/W RAM, 0 = black, 1 = white.
@@ -221,6 +446,10 @@ extern const uint8_t screen_ws_1681_4grays[];
  * but leave untouched pixels 00 and 11. */
 extern const uint8_t screen_ws_1681_diff[];
 
+/** Homemade waveform settings like screen_ws_1681_diff, with a single short phase at 100Hz (~50ms),
+ * for display mode 2 (see screen_show_rams_fast). */
+extern const uint8_t screen_ws_1681_fast[];
+
 
 typedef enum {
     SSD1681_DRIVER_CTRL = 0x01,
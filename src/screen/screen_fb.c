@@ -0,0 +1,133 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "badge_defs.h"
+#include "log.h"
+#include "screen_fb.h"
+
+
+#define STRIDE (SCREEN_WIDTH/8)
+
+
+STATIC uint32_t area(const screen_rect_t *r) {
+    return (uint32_t)(r->x1-r->x0) * (r->y1-r->y0);
+}
+
+STATIC screen_rect_t bounding_box(const screen_rect_t *a, const screen_rect_t *b) {
+    screen_rect_t r = {
+        a->x0 < b->x0 ? a->x0 : b->x0,
+        a->y0 < b->y0 ? a->y0 : b->y0,
+        a->x1 > b->x1 ? a->x1 : b->x1,
+        a->y1 > b->y1 ? a->y1 : b->y1,
+    };
+    return r;
+}
+
+/* Merge zones when they overlap, or when merging does not push more bytes (e.g. adjacent zones of same width) */
+STATIC bool should_merge(const screen_rect_t *a, const screen_rect_t *b) {
+    if (a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1)
+        return true;
+    screen_rect_t u = bounding_box(a, b);
+    return area(&u) <= area(a) + area(b);
+}
+
+STATIC void remove_damage(screen_fb_t *fb, size_t i) {
+    fb->damage[i] = fb->damage[--fb->n_damage];
+}
+
+
+void screen_fb_init(screen_fb_t *fb, bool gray, uint8_t color) {
+    memset(fb->lsb, (color & 1) ? 0xFF : 0x00, SCREEN_PLANE_SIZE);
+    memset(fb->msb, (color & 2) ? 0xFF : 0x00, SCREEN_PLANE_SIZE);
+    fb->gray = gray;
+    fb->n_damage = 0;
+    screen_fb_damage(fb, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+
+void screen_fb_damage(screen_fb_t *fb, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1) {
+    /* Snap to the screen window granularity and bind to the screen */
+    screen_rect_t r = {
+        x0 & ~7,
+        y0,
+        x1 >= SCREEN_WIDTH-7 ? SCREEN_WIDTH : (x1+7) & ~7,
+        y1 >= SCREEN_HEIGHT ? SCREEN_HEIGHT : y1,
+    };
+    if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        return;
+
+    /* Merge with the existing zones, which may in turn make the merged zone overlap other zones */
+    bool merged;
+    do {
+        merged = false;
+        for(size_t i=0; i<fb->n_damage; ++i) {
+            if (should_merge(&r, &fb->damage[i])) {
+                r = bounding_box(&r, &fb->damage[i]);
+                remove_damage(fb, i);
+                merged = true;
+                break;
+            }
+        }
+        /* No room for a new zone: merge with the zone that grows the least */
+        if (! merged && fb->n_damage == SCREEN_FB_MAX_DAMAGE) {
+            size_t best = 0;
+            uint32_t best_cost = UINT32_MAX;
+            for(size_t i=0; i<fb->n_damage; ++i) {
+                screen_rect_t u = bounding_box(&r, &fb->damage[i]);
+                uint32_t cost = area(&u) - area(&fb->damage[i]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best = i;
+                }
+            }
+            r = bounding_box(&r, &fb->damage[best]);
+            remove_damage(fb, best);
+            merged = true;
+        }
+    } while(merged);
+
+    fb->damage[fb->n_damage++] = r;
+}
+
+
+screen_rect_t screen_fb_window(const screen_rect_t *zone) {
+    /* Image (0,0) is the last byte of the RAM (X and Y decrement), which is the screen's (200,200) */
+    screen_rect_t win = {
+        SCREEN_WIDTH - zone->x1,
+        SCREEN_HEIGHT - zone->y1,
+        SCREEN_WIDTH - zone->x0,
+        SCREEN_HEIGHT - zone->y0,
+    };
+    return win;
+}
+
+
+size_t screen_fb_push(screen_fb_t *fb) {
+    if (screen_busy()) {
+        log_warning("screen_fb_push() called but screen is busy");
+        return 0;
+    }
+
+    size_t pushed = 0;
+    for(size_t i=0; i<fb->n_damage; ++i) {
+        const screen_rect_t *zone = &fb->damage[i];
+        screen_rect_t win = screen_fb_window(zone);
+        size_t len = screen_set_image_position(win.x0, win.y0, win.x1, win.y1);
+
+        size_t offset = zone->y0*STRIDE + zone->x0/8;
+        size_t row_len = (zone->x1-zone->x0)/8;
+        screen_push_rams_window(fb->lsb + offset, fb->gray ? fb->msb + offset : NULL,
+                                STRIDE, row_len, zone->y1-zone->y0);
+        pushed += fb->gray ? 2*len : len;
+    }
+    fb->n_damage = 0;
+
+    return pushed;
+}
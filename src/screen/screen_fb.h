@@ -0,0 +1,77 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file screen_fb.h
+ *
+ * \brief Screen framebuffer API: keep a copy of the screen RAM and only push what changed.
+ *
+ * The framebuffer holds both fullscreen planes, in the same format as the images of screen_show_image_4g().
+ * Draw in the planes, then tell which zones changed with screen_fb_damage().
+ * The damaged zones are snapped to the 8 pixels granularity of the screen windows and merged,
+ * and screen_fb_push() only pushes these windows to the screen RAM.
+ *
+ * The usual use is:
+ * - screen_fb_init() once the screen is booted, then screen_fb_push() + screen_show_rams() to show the first frame,
+ * - draw in fb->lsb/fb->msb, call screen_fb_damage() with the changed zones,
+ * - when the screen is not busy, screen_fb_push() then screen_show_rams().
+ *
+ * Coordinates are image coordinates: (0,0) is the top left pixel (the first byte of a fullscreen plane),
+ * and the x1 and y1 coordinates are excluded.
+ * The conversion to the reversed screen coordinates is done by screen_fb_window().
+ * */
+
+#ifndef _SCREEN_FB_H
+#define _SCREEN_FB_H
+
+#include "screen.h"
+
+/** Maximum number of separate damaged zones, more zones are merged together. */
+#define SCREEN_FB_MAX_DAMAGE 8
+
+/** \brief A rectangle, x1 and y1 excluded. */
+typedef struct {
+    uint8_t x0, y0;
+    uint8_t x1, y1;
+} screen_rect_t;
+
+typedef struct {
+    /* Aligned so that the planes can be processed 32 bits at a time */
+    uint8_t lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));  /**< B/W RAM plane */
+    uint8_t msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));  /**< RED RAM plane, not pushed in black and white */
+    bool gray;  /**< Whether the msb plane is used (4 grays) or not (black and white) */
+    uint8_t n_damage;
+    screen_rect_t damage[SCREEN_FB_MAX_DAMAGE];  /**< Snapped zones that were not pushed yet */
+} screen_fb_t;
+
+/** \brief Fill the framebuffer with a color and damage the whole screen.
+ *
+ * \param gray  Use both planes (4 grays) or only the lsb one (black and white).
+ * \param color Between 0 (black) and 3 (white), only bit 0 is used in black and white. */
+void screen_fb_init(screen_fb_t *fb, bool gray, uint8_t color);
+
+/** \brief Tell that the zone [x0,x1[ x [y0,y1[ changed and must be pushed.
+ *
+ * The zone is snapped to multiples of 8 on X and merged with overlapping zones. */
+void screen_fb_damage(screen_fb_t *fb, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+
+/** \brief Push the damaged zones to the screen RAM.
+ *
+ * The screen must not be busy: the push is not queued, the damaged zones are kept and merged with the next ones.
+ * Does not show the RAM, call \ref screen_show_rams afterwards.
+ * The screen window is left on the last pushed zone.
+ *
+ * \return The number of bytes pushed in the RAM banks (0 if nothing changed). */
+size_t screen_fb_push(screen_fb_t *fb);
+
+/** \brief Compute the screen window of an image zone.
+ *
+ * The screen RAM is written with decreasing X and Y (see setup() in screen.c),
+ * hence the first byte of the zone (its top left) is the last byte of the screen window.
+ *
+ * \param zone  Snapped zone in image coordinates.
+ * \return The screen window to give to \ref screen_set_image_position. */
+screen_rect_t screen_fb_window(const screen_rect_t *zone);
+
+#endif /* _SCREEN_FB_H */
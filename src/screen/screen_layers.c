@@ -0,0 +1,165 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "badge_defs.h"
+#include "gfx.h"
+#include "screen_fb.h"
+#include "screen_layers.h"
+
+
+#define STRIDE (SCREEN_WIDTH/8)
+
+/* A band of 8 rows of tiles is composed here, then compared to the framebuffer */
+STATIC uint8_t band_lsb[GFX_PLANE_SIZE(SCREEN_WIDTH, 8)] __attribute__((aligned(4)));
+STATIC uint8_t band_msb[GFX_PLANE_SIZE(SCREEN_WIDTH, 8)] __attribute__((aligned(4)));
+
+
+/* Marks the tiles of [x0,x1[ x [y0,y1[, clipped to the screen */
+STATIC void mark(screen_layers_t *c, int x0, int y0, int x1, int y1) {
+    if (x0 < 0)
+        x0 = 0;
+    if (y0 < 0)
+        y0 = 0;
+    if (x1 > SCREEN_WIDTH)
+        x1 = SCREEN_WIDTH;
+    if (y1 > SCREEN_HEIGHT)
+        y1 = SCREEN_HEIGHT;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    uint32_t bits = (1u << ((x1+7)/8)) - (1u << (x0/8));
+    for(int ty=y0/8; ty<(y1+7)/8; ++ty)
+        c->dirty[ty] |= bits;
+}
+
+STATIC void mark_layer(screen_layers_t *c, const screen_layer_t *l) {
+    if (l->visible)
+        mark(c, l->x, l->y, l->x + l->image.width, l->y + l->image.height);
+}
+
+
+/* Whether the layer is drawn in [x0,x1[ x [y0,y1[, or hides it entirely (opaque and covering it) */
+STATIC bool overlaps(const screen_layer_t *l, int x0, int y0, int x1, int y1) {
+    return l->visible && l->x < x1 && x0 < l->x + l->image.width && l->y < y1 && y0 < l->y + l->image.height;
+}
+
+STATIC bool hides(const screen_layer_t *l, int x0, int y0, int x1, int y1) {
+    return l->visible && ! l->image.mask && l->x <= x0 && x1 <= l->x + l->image.width
+           && l->y <= y0 && y1 <= l->y + l->image.height;
+}
+
+
+/* Composes the tiles [tx0,tx1[ of the band ty, and copies the tiles that changed to the framebuffer */
+STATIC size_t compose_run(screen_layers_t *c, int ty, int tx0, int tx1) {
+    screen_fb_t *fb = c->fb;
+    int x0 = 8*tx0, x1 = 8*tx1, y0 = 8*ty, y1 = y0+8;
+    gfx_planes_t band = {band_lsb, fb->gray ? band_msb : NULL, x1-x0, 8, tx1-tx0};
+
+    /* The layers beneath the highest one that hides the run are not drawn */
+    int bottom = SCREEN_LAYERS-1;
+    while(bottom >= 0 && ! hides(&c->layers[bottom], x0, y0, x1, y1))
+        --bottom;
+    if (bottom < 0) {
+        gfx_fill(&band, c->color);
+        bottom = 0;
+    }
+    for(int z=bottom; z<SCREEN_LAYERS; ++z) {
+        const screen_layer_t *l = &c->layers[z];
+        if (overlaps(l, x0, y0, x1, y1))
+            gfx_blit(&band, l->x - x0, l->y - y0, &l->image);
+    }
+
+    size_t changed = 0;
+    for(int tx=tx0; tx<tx1; ++tx) {
+        uint8_t *lsb = fb->lsb + y0*STRIDE + tx;
+        uint8_t *msb = fb->msb + y0*STRIDE + tx;
+        const uint8_t *blsb = band_lsb + (tx-tx0);
+        const uint8_t *bmsb = band_msb + (tx-tx0);
+        bool diff = false;
+        for(int j=0; j<8; ++j) {
+            diff |= lsb[j*STRIDE] != blsb[j*band.stride];
+            if (fb->gray)
+                diff |= msb[j*STRIDE] != bmsb[j*band.stride];
+        }
+        if (! diff)
+            continue;
+
+        for(int j=0; j<8; ++j) {
+            lsb[j*STRIDE] = blsb[j*band.stride];
+            if (fb->gray)
+                msb[j*STRIDE] = bmsb[j*band.stride];
+        }
+        screen_fb_damage(fb, x0 + 8*(tx-tx0), y0, x0 + 8*(tx-tx0+1), y1);
+        ++changed;
+    }
+
+    return changed;
+}
+
+
+void screen_layers_init(screen_layers_t *c, screen_fb_t *fb, uint8_t color) {
+    c->fb = fb;
+    c->color = color;
+    memset(c->layers, 0, sizeof(c->layers));
+    memset(c->dirty, 0, sizeof(c->dirty));  /* mark() only sets bits, the struct may be on the stack */
+    mark(c, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+
+void screen_layers_show(screen_layers_t *c, screen_layer_z_t z, const gfx_image_t *image, int x, int y) {
+    screen_layer_t *l = &c->layers[z];
+    mark_layer(c, l);
+    l->image = *image;
+    l->x = x;
+    l->y = y;
+    l->visible = true;
+    mark_layer(c, l);
+}
+
+
+void screen_layers_move(screen_layers_t *c, screen_layer_z_t z, int x, int y) {
+    screen_layer_t *l = &c->layers[z];
+    mark_layer(c, l);
+    l->x = x;
+    l->y = y;
+    mark_layer(c, l);
+}
+
+
+void screen_layers_hide(screen_layers_t *c, screen_layer_z_t z) {
+    screen_layer_t *l = &c->layers[z];
+    mark_layer(c, l);
+    l->visible = false;
+}
+
+
+void screen_layers_damage(screen_layers_t *c, screen_layer_z_t z, int x, int y, int w, int h) {
+    const screen_layer_t *l = &c->layers[z];
+    if (l->visible)
+        mark(c, l->x + x, l->y + y, l->x + x + w, l->y + y + h);
+}
+
+
+size_t screen_layers_compose(screen_layers_t *c) {
+    size_t changed = 0;
+    for(int ty=0; ty<SCREEN_LAYERS_TILES; ++ty) {
+        uint32_t d = c->dirty[ty];
+        c->dirty[ty] = 0;
+        /* Runs of consecutive marked tiles are composed together */
+        while(d) {
+            int tx0 = __builtin_ctz(d), tx1 = tx0;
+            while(tx1 < SCREEN_LAYERS_TILES && ((d >> tx1) & 1))
+                ++tx1;
+            d &= ~((1u << tx1) - (1u << tx0));
+            changed += compose_run(c, ty, tx0, tx1);
+        }
+    }
+    return changed;
+}
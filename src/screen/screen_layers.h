@@ -0,0 +1,88 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file screen_layers.h
+ *
+ * \brief Screen layers API: stack a background, a content and an overlay image in a framebuffer.
+ *
+ * Pushing a notification over the screen RAM (see test_subimage() in tests/screen.c) cannot be undone:
+ * what was beneath it is lost. The layers keep the images instead of their pixels, so that a notification can be
+ * shown, moved and removed, and the screen gets back exactly what was beneath it.
+ *
+ * The screen is cut in tiles of 8x8 pixels, the granularity of the screen windows.
+ * Showing, moving or hiding a layer marks the tiles it covers, before and after the change.
+ * \ref screen_layers_compose then redraws only the marked tiles, from the lowest layer to the highest
+ * with gfx_blit() (masks and any X are supported), in a band of 8 rows.
+ * The tiles which really changed are copied to the framebuffer and damaged (screen_fb_damage()),
+ * so that screen_fb_push() only pushes them.
+ *
+ * The usual use is:
+ * - screen_fb_init() then screen_layers_init(),
+ * - screen_layers_show() the background, the content, a notification in the overlay, ...
+ * - screen_layers_compose(), then screen_fb_push() and screen_show_rams() when the screen is not busy,
+ * - screen_layers_hide() the notification, compose and push again: only its tiles are pushed.
+ *
+ * Coordinates are image coordinates, as in screen_fb.h. Layers can be partly or entirely outside of the screen.
+ * */
+
+#ifndef _SCREEN_LAYERS_H
+#define _SCREEN_LAYERS_H
+
+#include "gfx.h"
+#include "screen_fb.h"
+
+/** Number of tiles of 8x8 pixels on each axis */
+#define SCREEN_LAYERS_TILES (SCREEN_WIDTH/8)
+
+/** \brief Layers, from the lowest to the highest. */
+typedef enum {
+    SCREEN_LAYER_BACKGROUND,
+    SCREEN_LAYER_CONTENT,
+    SCREEN_LAYER_OVERLAY,  /**< Notifications, menus, ... */
+    SCREEN_LAYERS,
+} screen_layer_z_t;
+
+typedef struct {
+    gfx_image_t image;  /**< The planes are not copied, they must live as long as the layer is visible */
+    int16_t x, y;       /**< Top left of the image */
+    bool visible;
+} screen_layer_t;
+
+typedef struct {
+    screen_fb_t *fb;
+    uint8_t color;  /**< Color beneath the background */
+    screen_layer_t layers[SCREEN_LAYERS];
+    uint32_t dirty[SCREEN_LAYERS_TILES];  /**< Tiles to compose: bit tx of dirty[ty] */
+} screen_layers_t;
+
+/** \brief Start with no visible layer, over a framebuffer initialized with screen_fb_init().
+ *
+ * The whole screen is composed by the next \ref screen_layers_compose.
+ *
+ * \param color Shown where no layer is drawn, between 0 (black) and 3 (white). */
+void screen_layers_init(screen_layers_t *c, screen_fb_t *fb, uint8_t color);
+
+/** \brief Show an image in a layer, in place of the previous one. */
+void screen_layers_show(screen_layers_t *c, screen_layer_z_t z, const gfx_image_t *image, int x, int y);
+
+/** \brief Move the image of a layer. */
+void screen_layers_move(screen_layers_t *c, screen_layer_z_t z, int x, int y);
+
+/** \brief Remove the image of a layer, the layers beneath it are shown again. */
+void screen_layers_hide(screen_layers_t *c, screen_layer_z_t z);
+
+/** \brief Tell that the pixels [x,x+w[ x [y,y+h[ of the image of a layer changed (image coordinates of the layer).
+ *
+ * For images drawn at run time, e.g. with gfx.h. */
+void screen_layers_damage(screen_layers_t *c, screen_layer_z_t z, int x, int y, int w, int h);
+
+/** \brief Compose the marked tiles, and damage the framebuffer where they changed.
+ *
+ * Does not push anything, call screen_fb_push() afterwards.
+ *
+ * \return The number of tiles that changed. */
+size_t screen_layers_compose(screen_layers_t *c);
+
+#endif /* _SCREEN_LAYERS_H */
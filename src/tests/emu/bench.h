@@ -0,0 +1,69 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Harness of the gfx benchmarks on the host (gfx_draw_bench.c, gfx_bench.c, gfx_chunky_bench.c): the failures
+ * of the checks against the pixel by pixel references, the reference color of an image pixel, and the timings.
+ * The timings are in µs of the host, and in time stamp counter cycles on x86: the ratio to the reference is
+ * what matters, the host is not the RP2040. */
+
+#ifndef _EMU_BENCH_H
+#define _EMU_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "gfx.h"
+
+
+static int failures = 0;
+static double bench_cycles = 0;  /* Cycles per run of the last TIME, 0 without a cycle counter */
+
+
+/* Color of a pixel of an image, the black and white ones only have their lsb plane */
+static inline uint8_t image_color(const gfx_image_t *src, int x, int y) {
+    size_t k = y*src->stride + x/8;
+    uint8_t m = 0x80 >> (x & 7);
+    uint8_t color = (src->lsb[k] & m) ? 1 : 0;
+    if (src->msb ? (src->msb[k] & m) : color)
+        color |= 2;
+    return color;
+}
+
+
+static inline double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static inline uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Runs code reps times (_i is the run), returns the µs per run and sets bench_cycles */
+#define TIME(reps, code) ({ \
+    double _t0 = now_us(); \
+    uint64_t _c0 = cycles(); \
+    for(int _i=0; _i<(reps); ++_i) { code; } \
+    bench_cycles = (double)(cycles() - _c0) / (reps); \
+    (now_us() - _t0) / (reps); \
+})
+
+
+/* Result of main: non-zero when a check failed */
+static inline int bench_end(void) {
+    printf("%s, %d failures\n", failures ? "FAILED" : "ok", failures);
+    return failures != 0;
+}
+
+#endif /* _EMU_BENCH_H */
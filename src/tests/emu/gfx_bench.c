@@ -0,0 +1,139 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Rotations and mirrors of packed planes on the host: gfx_rotate and gfx_mirror (8x8 bit matrix transposes,
+ * byte reversals) against a pixel by pixel reference. Both must give the same planes, for several sizes
+ * and for both kinds of images, then both are timed (see bench.h).
+ *
+ * Returns non-zero when a check fails. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gfx.h"
+#include "bench.h"
+
+
+#define MAX_SIZE 200
+#define PLANE_SIZE GFX_PLANE_SIZE(MAX_SIZE, MAX_SIZE)
+
+static uint8_t src_lsb[PLANE_SIZE], src_msb[PLANE_SIZE];
+static uint8_t dst_lsb[PLANE_SIZE], dst_msb[PLANE_SIZE];
+static uint8_t ref_lsb[PLANE_SIZE], ref_msb[PLANE_SIZE];
+
+
+/* Reference rotation and mirrors, pixel by pixel */
+static void naive_rotate(const gfx_planes_t *dst, const gfx_image_t *src, gfx_rotation_t rotation) {
+    int w = src->width, h = src->height;
+    for(int y=0; y<h; ++y)
+        for(int x=0; x<w; ++x) {
+            uint8_t color = image_color(src, x, y);
+            switch(rotation) {
+                case GFX_ROTATE_0:   gfx_pixel(dst, x, y, color); break;
+                case GFX_ROTATE_90:  gfx_pixel(dst, h-1-y, x, color); break;
+                case GFX_ROTATE_180: gfx_pixel(dst, w-1-x, h-1-y, color); break;
+                case GFX_ROTATE_270: gfx_pixel(dst, y, w-1-x, color); break;
+            }
+        }
+}
+
+static void naive_mirror(const gfx_planes_t *dst, const gfx_image_t *src, bool flip_x, bool flip_y) {
+    for(int y=0; y<src->height; ++y)
+        for(int x=0; x<src->width; ++x)
+            gfx_pixel(dst, flip_x ? src->width-1-x : x, flip_y ? src->height-1-y : y, image_color(src, x, y));
+}
+
+
+static void clear_planes(void) {
+    memset(dst_lsb, 0, PLANE_SIZE);
+    memset(dst_msb, 0, PLANE_SIZE);
+    memset(ref_lsb, 0, PLANE_SIZE);
+    memset(ref_msb, 0, PLANE_SIZE);
+}
+
+static void compare(const char *what, const gfx_image_t *img) {
+    if (memcmp(dst_lsb, ref_lsb, PLANE_SIZE) || memcmp(dst_msb, ref_msb, PLANE_SIZE)) {
+        printf("  FAILED: %s of %dx%d %s differs\n", what, img->width, img->height, img->msb ? "4g" : "bw");
+        ++failures;
+    }
+}
+
+static void check_sizes(void) {
+    static const int sizes[][2] = {{200, 200}, {8, 1}, {8, 8}, {16, 13}, {96, 75}, {200, 7}, {24, 200}};
+    for(size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+        for(int gray=0; gray<2; ++gray) {
+            int w = sizes[s][0], h = sizes[s][1];
+            gfx_image_t img = {src_lsb, gray ? src_msb : NULL, NULL, w, h, MAX_SIZE/8};
+
+            for(int r=GFX_ROTATE_0; r<=GFX_ROTATE_270; ++r) {
+                uint16_t dw = r & 1 ? h : w, dh = r & 1 ? w : h;
+                gfx_planes_t dst = {dst_lsb, dst_msb, dw, dh, (dw+7)/8};
+                gfx_planes_t ref = {ref_lsb, ref_msb, dw, dh, (dw+7)/8};
+                clear_planes();
+                gfx_rotate(&dst, &img, r);
+                naive_rotate(&ref, &img, r);
+                compare((const char *[]){"rotate 0", "rotate 90", "rotate 180", "rotate 270"}[r], &img);
+            }
+
+            for(int flip=1; flip<4; ++flip) {
+                gfx_planes_t dst = {dst_lsb, dst_msb, w, h, MAX_SIZE/8};
+                gfx_planes_t ref = {ref_lsb, ref_msb, w, h, MAX_SIZE/8};
+                clear_planes();
+                gfx_mirror(&dst, &img, flip & 1, flip & 2);
+                naive_mirror(&ref, &img, flip & 1, flip & 2);
+                compare((const char *[]){"", "mirror x", "mirror y", "mirror xy"}[flip], &img);
+
+                /* In place, from a copy of the source (a black and white image only has its lsb plane) */
+                memcpy(dst_lsb, src_lsb, PLANE_SIZE);
+                memcpy(dst_msb, src_msb, PLANE_SIZE);
+                gfx_image_t copy = {dst_lsb, gray ? dst_msb : NULL, NULL, w, h, MAX_SIZE/8};
+                gfx_planes_t same = {dst_lsb, gray ? dst_msb : NULL, w, h, MAX_SIZE/8};
+                gfx_mirror(&same, &copy, flip & 1, flip & 2);
+                if (! gray)
+                    memcpy(ref_msb, dst_msb, PLANE_SIZE);
+                for(int y=0; y<MAX_SIZE; ++y)  /* Bytes after the image are left as they are */
+                    for(int k=0; k<MAX_SIZE/8; ++k)
+                        if (y >= h || k >= w/8) {
+                            ref_lsb[y*MAX_SIZE/8 + k] = src_lsb[y*MAX_SIZE/8 + k];
+                            ref_msb[y*MAX_SIZE/8 + k] = src_msb[y*MAX_SIZE/8 + k];
+                        }
+                compare((const char *[]){"", "mirror x in place", "mirror y in place", "mirror xy in place"}[flip],
+                        &img);
+            }
+        }
+    printf("rotate and mirror against the pixel by pixel reference: %s\n", failures ? "FAILED" : "ok");
+}
+
+
+static void bench(void) {
+    gfx_image_t img = {src_lsb, src_msb, NULL, MAX_SIZE, MAX_SIZE, MAX_SIZE/8};
+    gfx_planes_t dst = {dst_lsb, dst_msb, MAX_SIZE, MAX_SIZE, MAX_SIZE/8};
+    static const char *names[] = {"rotate 0", "rotate 90", "rotate 180", "rotate 270"};
+
+    printf("%dx%d 4 grays, µs per image:   kernel  per pixel  speedup\n", MAX_SIZE, MAX_SIZE);
+    for(int r=GFX_ROTATE_0; r<=GFX_ROTATE_270; ++r) {
+        double fast = TIME(2000, gfx_rotate(&dst, &img, r));
+        double naive = TIME(50, naive_rotate(&dst, &img, r));
+        printf("- %-26s %8.1f %10.1f %7.1fx\n", names[r], fast, naive, naive/fast);
+    }
+    double fast = TIME(2000, gfx_mirror(&dst, &img, true, false));
+    double naive = TIME(50, naive_mirror(&dst, &img, true, false));
+    printf("- %-26s %8.1f %10.1f %7.1fx\n", "mirror x", fast, naive, naive/fast);
+}
+
+
+int main(void) {
+    srand(1);
+    for(size_t i=0; i<PLANE_SIZE; ++i) {
+        src_lsb[i] = rand();
+        src_msb[i] = rand();
+    }
+
+    check_sizes();
+    bench();
+
+    return bench_end();
+}
@@ -0,0 +1,153 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Chunky conversions on the host: gfx_chunky8_to_planes, gfx_chunky2_to_planes and back, against pixel by pixel
+ * references, for several widths and for both kinds of planes, then timed in bytes of the chunky buffer per cycle
+ * (time stamp counter cycles on x86, see bench.h).
+ *
+ * Returns non-zero when a check fails. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gfx.h"
+#include "gfx_chunky.h"
+#include "bench.h"
+
+
+#define MAX_SIZE 200
+#define PLANE_SIZE GFX_PLANE_SIZE(MAX_SIZE, MAX_SIZE)
+#define STRIDE8 MAX_SIZE
+#define STRIDE2 ((MAX_SIZE/4 + 3) & ~3)
+
+static uint8_t src_lsb[PLANE_SIZE], src_msb[PLANE_SIZE];
+static uint8_t dst_lsb[PLANE_SIZE], dst_msb[PLANE_SIZE];
+static uint8_t ref_lsb[PLANE_SIZE], ref_msb[PLANE_SIZE];
+static uint8_t chunky[STRIDE8*MAX_SIZE] __attribute__((aligned(4)));
+static uint8_t ref_chunky[STRIDE8*MAX_SIZE] __attribute__((aligned(4)));
+
+
+/* References, pixel by pixel */
+static void naive_to_planes(const gfx_planes_t *dst, const uint8_t *src, size_t stride, int bits) {
+    for(int y=0; y<dst->height; ++y)
+        for(int x=0; x<dst->width; ++x) {
+            const uint8_t *row = src + y*stride;
+            uint8_t color = bits == 8 ? row[x] & 3 : (row[x/4] >> (6 - 2*(x & 3))) & 3;
+            if (! dst->msb && (color & 1))
+                color = 3;
+            gfx_pixel(dst, x, y, color);
+        }
+}
+
+static void naive_to_chunky(uint8_t *dst, size_t stride, const gfx_image_t *src, int bits) {
+    for(int y=0; y<src->height; ++y)
+        for(int x=0; x<src->width; ++x) {
+            uint8_t *row = dst + y*stride;
+            uint8_t color = image_color(src, x, y);
+            if (bits == 8)
+                row[x] = color;
+            else
+                row[x/4] = (row[x/4] & ~(0xC0 >> (2*(x & 3)))) | (color << (6 - 2*(x & 3)));
+        }
+}
+
+
+static void check(bool ok, const char *what, int w, int h, bool gray) {
+    if (! ok) {
+        printf("  FAILED: %s of %dx%d %s differs\n", what, w, h, gray ? "4g" : "bw");
+        ++failures;
+    }
+}
+
+static void check_sizes(void) {
+    static const int sizes[][2] = {{200, 200}, {8, 1}, {16, 3}, {24, 13}, {104, 100}, {200, 7}};
+    for(size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+        for(int gray=0; gray<2; ++gray)
+            for(int bits=2; bits<=8; bits+=6) {
+                int w = sizes[s][0], h = sizes[s][1];
+                size_t stride = bits == 8 ? STRIDE8 : STRIDE2;
+                size_t row_len = bits == 8 ? w : w/4;
+                gfx_image_t img = {src_lsb, gray ? src_msb : NULL, NULL, w, h, MAX_SIZE/8};
+                gfx_planes_t dst = {dst_lsb, gray ? dst_msb : NULL, w, h, MAX_SIZE/8};
+                gfx_planes_t ref = {ref_lsb, gray ? ref_msb : NULL, w, h, MAX_SIZE/8};
+
+                /* Planes to chunky: only the pixels of the image are compared */
+                memset(chunky, 0xAA, sizeof(chunky));
+                memset(ref_chunky, 0x55, sizeof(ref_chunky));
+                if (bits == 8)
+                    gfx_planes_to_chunky8(chunky, stride, &img);
+                else
+                    gfx_planes_to_chunky2(chunky, stride, &img);
+                naive_to_chunky(ref_chunky, stride, &img, bits);
+                bool ok = true;
+                for(int y=0; y<h; ++y)
+                    ok &= memcmp(chunky + y*stride, ref_chunky + y*stride, row_len) == 0;
+                check(ok, bits == 8 ? "planes to chunky8" : "planes to chunky2", w, h, gray);
+
+                /* Back to the planes, from random colors (the high bits of the 8 bits pixels are ignored) */
+                for(size_t i=0; i<sizeof(chunky); ++i)
+                    chunky[i] = rand();
+                memset(dst_lsb, 0, PLANE_SIZE);
+                memset(dst_msb, 0, PLANE_SIZE);
+                memset(ref_lsb, 0, PLANE_SIZE);
+                memset(ref_msb, 0, PLANE_SIZE);
+                if (bits == 8)
+                    gfx_chunky8_to_planes(&dst, chunky, stride);
+                else
+                    gfx_chunky2_to_planes(&dst, chunky, stride);
+                naive_to_planes(&ref, chunky, stride, bits);
+                check(memcmp(dst_lsb, ref_lsb, PLANE_SIZE) == 0 && memcmp(dst_msb, ref_msb, PLANE_SIZE) == 0,
+                      bits == 8 ? "chunky8 to planes" : "chunky2 to planes", w, h, gray);
+            }
+    printf("chunky conversions against the pixel by pixel reference: %s\n", failures ? "FAILED" : "ok");
+}
+
+
+static void report(const char *name, size_t bytes, double fast, double fast_cyc, double naive) {
+    printf("- %-22s %8.1f %10.1f %7.1fx", name, fast, naive, naive/fast);
+    if (fast_cyc > 0)
+        printf(" %8.2f", bytes/fast_cyc);
+    printf("\n");
+}
+
+static void bench(void) {
+    gfx_image_t img = {src_lsb, src_msb, NULL, MAX_SIZE, MAX_SIZE, MAX_SIZE/8};
+    gfx_planes_t dst = {dst_lsb, dst_msb, MAX_SIZE, MAX_SIZE, MAX_SIZE/8};
+    size_t bytes8 = MAX_SIZE*MAX_SIZE, bytes2 = MAX_SIZE*MAX_SIZE/4;
+    double fast, naive, cyc;
+
+    printf("%dx%d 4 grays, µs per image:   kernel  per pixel  speedup  bytes/cycle\n", MAX_SIZE, MAX_SIZE);
+    fast = TIME(2000, gfx_chunky8_to_planes(&dst, chunky, STRIDE8));
+    cyc = bench_cycles;
+    naive = TIME(50, naive_to_planes(&dst, chunky, STRIDE8, 8));
+    report("chunky8 to planes", bytes8, fast, cyc, naive);
+    fast = TIME(2000, gfx_chunky2_to_planes(&dst, chunky, STRIDE2));
+    cyc = bench_cycles;
+    naive = TIME(50, naive_to_planes(&dst, chunky, STRIDE2, 2));
+    report("chunky2 to planes", bytes2, fast, cyc, naive);
+    fast = TIME(2000, gfx_planes_to_chunky8(chunky, STRIDE8, &img));
+    cyc = bench_cycles;
+    naive = TIME(50, naive_to_chunky(chunky, STRIDE8, &img, 8));
+    report("planes to chunky8", bytes8, fast, cyc, naive);
+    fast = TIME(2000, gfx_planes_to_chunky2(chunky, STRIDE2, &img));
+    cyc = bench_cycles;
+    naive = TIME(50, naive_to_chunky(chunky, STRIDE2, &img, 2));
+    report("planes to chunky2", bytes2, fast, cyc, naive);
+}
+
+
+int main(void) {
+    srand(1);
+    for(size_t i=0; i<PLANE_SIZE; ++i) {
+        src_lsb[i] = rand();
+        src_msb[i] = rand();
+    }
+
+    check_sizes();
+    bench();
+
+    return bench_end();
+}
@@ -0,0 +1,165 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Drawing primitives on the host: gfx_fill_rect, gfx_hline, gfx_vline, gfx_blit and gfx_stencil (32 bits masks per
+ * row span) against pixel by pixel references, at any position and clipped, for both kinds of planes.
+ * Then all the primitives are timed in pixels/s, the same list as test_bench in tests/gfx.c, so that regressions
+ * of the inner loops are caught without a badge (see bench.h).
+ *
+ * Returns non-zero when a check fails. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gfx.h"
+#include "bench.h"
+
+
+#define SIZE 200
+#define PLANE_SIZE GFX_PLANE_SIZE(SIZE, SIZE)
+#define IMG_W 72
+#define IMG_H 61
+#define IMG_STRIDE (IMG_W/8)
+
+static uint8_t dst_lsb[PLANE_SIZE] __attribute__((aligned(4))), dst_msb[PLANE_SIZE] __attribute__((aligned(4)));
+static uint8_t ref_lsb[PLANE_SIZE] __attribute__((aligned(4))), ref_msb[PLANE_SIZE] __attribute__((aligned(4)));
+static uint8_t img_lsb[IMG_STRIDE*IMG_H], img_msb[IMG_STRIDE*IMG_H], img_mask[IMG_STRIDE*IMG_H];
+
+
+/* References, pixel by pixel */
+static void naive_fill_rect(const gfx_planes_t *dst, int x, int y, int w, int h, uint8_t color) {
+    for(int j=y; j<y+h; ++j)
+        for(int i=x; i<x+w; ++i)
+            gfx_pixel(dst, i, j, color);
+}
+
+static void naive_blit(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src, int stencil) {
+    for(int j=0; j<src->height; ++j)
+        for(int i=0; i<src->width; ++i) {
+            if (src->mask && !(src->mask[j*src->stride + i/8] & (0x80 >> (i & 7))))
+                continue;
+            gfx_pixel(dst, x+i, y+j, stencil < 0 ? image_color(src, i, j) : stencil);
+        }
+}
+
+
+/* Both planes start from the same random content, so that the pixels around the shapes are checked too */
+static void random_planes(void) {
+    for(size_t i=0; i<PLANE_SIZE; ++i) {
+        dst_lsb[i] = ref_lsb[i] = rand();
+        dst_msb[i] = ref_msb[i] = rand();
+    }
+}
+
+static void compare(const char *what, int x, int y, bool gray) {
+    if (memcmp(dst_lsb, ref_lsb, PLANE_SIZE) || (gray && memcmp(dst_msb, ref_msb, PLANE_SIZE))) {
+        printf("  FAILED: %s at %d,%d on %s planes differs\n", what, x, y, gray ? "4g" : "bw");
+        ++failures;
+    }
+}
+
+static void check_shapes(void) {
+    for(int gray=0; gray<2; ++gray) {
+        gfx_planes_t dst = {dst_lsb, gray ? dst_msb : NULL, SIZE, SIZE, SIZE/8};
+        gfx_planes_t ref = {ref_lsb, gray ? ref_msb : NULL, SIZE, SIZE, SIZE/8};
+        gfx_image_t img = {img_lsb, gray ? img_msb : NULL, NULL, IMG_W, IMG_H, IMG_STRIDE};
+        gfx_image_t masked = {img_lsb, gray ? img_msb : NULL, img_mask, IMG_W, IMG_H, IMG_STRIDE};
+
+        /* Every alignment of the first and last words, and the clipping on each side */
+        for(int x=-40; x<SIZE+8; x+=3) {
+            int y = (x*7) % (SIZE+40) - 20, w = 1 + (x+40) % 97, h = 1 + (x+40) % 23;
+            uint8_t color = (x+40) & 3;
+
+            random_planes();
+            gfx_fill_rect(&dst, x, y, w, h, color);
+            naive_fill_rect(&ref, x, y, w, h, color);
+            compare("fill_rect", x, y, gray);
+
+            random_planes();
+            gfx_hline(&dst, x, y, w, color);
+            naive_fill_rect(&ref, x, y, w, 1, color);
+            compare("hline", x, y, gray);
+
+            random_planes();
+            gfx_vline(&dst, x, y, h*8, color);
+            naive_fill_rect(&ref, x, y, 1, h*8, color);
+            compare("vline", x, y, gray);
+
+            random_planes();
+            gfx_blit(&dst, x, y, &img);
+            naive_blit(&ref, x, y, &img, -1);
+            compare("blit", x, y, gray);
+
+            random_planes();
+            gfx_blit(&dst, x, y, &masked);
+            naive_blit(&ref, x, y, &masked, -1);
+            compare("masked blit", x, y, gray);
+
+            random_planes();
+            gfx_stencil(&dst, x, y, &masked, color);
+            naive_blit(&ref, x, y, &masked, color);
+            compare("stencil", x, y, gray);
+        }
+    }
+    printf("drawing primitives against the pixel by pixel reference: %s\n", failures ? "FAILED" : "ok");
+}
+
+
+static void report(const char *name, double pixels, double us, double naive_us) {
+    printf("- %-28s %9.2f %10.1f", name, us, pixels/us);
+    if (naive_us > 0)
+        printf(" %7.1fx", naive_us/us);
+    printf("\n");
+}
+
+static void bench(void) {
+    gfx_planes_t gray = {dst_lsb, dst_msb, SIZE, SIZE, SIZE/8};
+    gfx_planes_t bw = {dst_lsb, NULL, SIZE, SIZE, SIZE/8};
+    gfx_image_t img = {img_lsb, img_msb, NULL, IMG_W, IMG_H, IMG_STRIDE};
+    gfx_image_t masked = {img_lsb, img_msb, img_mask, IMG_W, IMG_H, IMG_STRIDE};
+    double us;
+
+    printf("%dx%d planes:                     µs per run  Mpixels/s  speedup\n", SIZE, SIZE);
+    report("fill 4g", SIZE*SIZE, TIME(2000, gfx_fill(&gray, 1)), 0);
+    us = TIME(2000, gfx_fill_rect(&gray, 0, 0, SIZE, SIZE, 2));
+    report("fill_rect fullscreen 4g", SIZE*SIZE, us, TIME(50, naive_fill_rect(&gray, 0, 0, SIZE, SIZE, 2)));
+    us = TIME(2000, gfx_fill_rect(&bw, 0, 0, SIZE, SIZE, 0));
+    report("fill_rect fullscreen bw", SIZE*SIZE, us, TIME(50, naive_fill_rect(&bw, 0, 0, SIZE, SIZE, 0)));
+    us = TIME(20000, gfx_fill_rect(&gray, 13+_i%50, 7, 37, 53, 1));
+    report("fill_rect 37x53 4g", 37*53, us, TIME(500, naive_fill_rect(&gray, 13+_i%50, 7, 37, 53, 1)));
+    report("hline 150 4g", 150, TIME(200000, gfx_hline(&gray, 3+_i%40, _i%SIZE, 150, 2)), 0);
+    report("hline 7 4g", 7, TIME(200000, gfx_hline(&gray, 3+_i%40, _i%SIZE, 7, 2)), 0);
+    report("vline 150 4g", 150, TIME(200000, gfx_vline(&gray, _i%SIZE, 20, 150, 1)), 0);
+    report("line 200x150 4g", 200, TIME(20000, gfx_line(&gray, 0, 0, 199, 150, 0)), 0);
+    report("circle r=80 4g", 8*57, TIME(20000, gfx_circle(&gray, 100, 100, 80, 3)), 0);  /* 8 octants of r/sqrt(2) */
+    report("fill_circle r=80 4g", 355*80*80/113, TIME(2000, gfx_fill_circle(&gray, 100, 100, 80, 1)), 0);
+    us = TIME(20000, gfx_blit(&gray, 48, 50, &img));
+    report("blit 72x61 4g", IMG_W*IMG_H, us, TIME(500, naive_blit(&gray, 48, 50, &img, -1)));
+    us = TIME(20000, gfx_blit(&gray, 51, 50, &img));
+    report("blit 72x61 4g x=51", IMG_W*IMG_H, us, TIME(500, naive_blit(&gray, 51, 50, &img, -1)));
+    us = TIME(20000, gfx_blit(&gray, -13, 50, &img));
+    report("blit 72x61 4g x=-13", IMG_W*IMG_H, us, TIME(500, naive_blit(&gray, -13, 50, &img, -1)));
+    us = TIME(20000, gfx_blit(&gray, 51, 50, &masked));
+    report("masked blit 72x61 4g x=51", IMG_W*IMG_H, us, TIME(500, naive_blit(&gray, 51, 50, &masked, -1)));
+    us = TIME(20000, gfx_stencil(&gray, 51, 50, &masked, 2));
+    report("stencil 72x61 4g x=51", IMG_W*IMG_H, us, TIME(500, naive_blit(&gray, 51, 50, &masked, 2)));
+    report("pixel 4g", 1, TIME(2000000, gfx_pixel(&gray, _i%SIZE, (_i/SIZE)%SIZE, 2)), 0);
+}
+
+
+int main(void) {
+    srand(1);
+    for(size_t i=0; i<sizeof(img_lsb); ++i) {
+        img_lsb[i] = rand();
+        img_msb[i] = rand();
+        img_mask[i] = rand();
+    }
+
+    check_shapes();
+    bench();
+
+    return bench_end();
+}
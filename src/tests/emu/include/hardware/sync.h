@@ -0,0 +1,15 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+#ifndef _EMU_HARDWARE_SYNC_H
+#define _EMU_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+/* The emulated interrupts only run from the calls that make time pass (SPI transfers, sleeps, tight loops) */
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+#endif /* _EMU_HARDWARE_SYNC_H */
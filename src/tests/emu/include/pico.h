@@ -0,0 +1,25 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Host shims of the pico SDK used by the screen library, see sdk.c.
+ * Only what the emulated libraries need, with the same names and prototypes. */
+
+#ifndef _EMU_PICO_H
+#define _EMU_PICO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+/* Waits for the next emulated event (alarm, end of DMA, BUSY edge) */
+void tight_loop_contents(void);
+
+/* 0 in the thread, 16 + the IRQ number in the handlers (the IPSR of the M0+) */
+uint __get_current_exception(void);
+
+#endif /* _EMU_PICO_H */
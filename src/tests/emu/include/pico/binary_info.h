@@ -0,0 +1,13 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+#ifndef _EMU_PICO_BINARY_INFO_H
+#define _EMU_PICO_BINARY_INFO_H
+
+/* No binary info on the host */
+#define bi_decl(...)
+#define bi_decl_if_func_used(...)
+
+#endif /* _EMU_PICO_BINARY_INFO_H */
@@ -0,0 +1,18 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+#ifndef _EMU_PICO_STDLIB_H
+#define _EMU_PICO_STDLIB_H
+
+#include <stdio.h>
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+bool stdio_init_all(void);
+bool stdio_usb_init(void);
+
+#endif /* _EMU_PICO_STDLIB_H */
@@ -0,0 +1,288 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* radio_config.c on the host, against an emulated register file of the CC1101 behind radio_send() and
+ * radio_burst_read(): the presets of tests/radio.c and random configurations are applied, the registers of the chip
+ * must match, with less bytes than sending the presets after a reset, and nothing when nothing changed.
+ * Then the presets are switched: the calibration of the synthesizer (SCAL) must only happen at the first switch to
+ * each preset, and its results must be written back at the next ones.
+ *
+ * Returns non-zero when a check fails. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "radio.h"
+#include "radio_config.h"
+
+
+/* The emulated chip */
+static uint8_t chip_regs[RADIO_CONFIG_REGS];
+static uint8_t chip_patable[RADIO_PATABLE_LEN];
+static size_t spi_bytes = 0, spi_transactions = 0, calibrations = 0;
+static int failures = 0;
+
+
+static void chip_reset(void) {
+    radio_config_t cfg;
+    radio_config_defaults(&cfg);
+    memcpy(chip_regs, cfg.regs, sizeof(chip_regs));
+    memcpy(chip_patable, cfg.patable, sizeof(chip_patable));
+}
+
+/* SLEEP loses the test registers and the PATABLE but its first byte (datasheet, section 29.3) */
+static void chip_sleep(void) {
+    for(int reg=CC1101_FSTEST; reg<=CC1101_TEST0; ++reg)
+        chip_regs[reg] = rand();
+    for(int i=1; i<RADIO_PATABLE_LEN; ++i)
+        chip_patable[i] = rand();
+}
+
+/* The results of a calibration depend on the frequency */
+static void chip_calibrate(void) {
+    uint8_t f = chip_regs[CC1101_FREQ2] ^ chip_regs[CC1101_FREQ1] ^ chip_regs[CC1101_FREQ0];
+    chip_regs[CC1101_FSCAL3] = (chip_regs[CC1101_FSCAL3] & 0xF0) | (f & 0x0F);
+    chip_regs[CC1101_FSCAL2] = (chip_regs[CC1101_FSCAL2] & 0x20) | (f & 0x1F);
+    chip_regs[CC1101_FSCAL1] = f;
+    ++calibrations;
+}
+
+static uint8_t *chip_reg(uint8_t reg, size_t *pa) {
+    static uint8_t none;
+    if (reg == CC1101_PATABLE)
+        return &chip_patable[(*pa)++ % RADIO_PATABLE_LEN];
+    return reg < RADIO_CONFIG_REGS ? &chip_regs[reg] : &none;
+}
+
+/* Decodes the accesses of a transaction, as the CC1101 does (datasheet, section 10) */
+static void chip_transaction(const uint8_t *data, uint8_t *response, size_t len) {
+    size_t pa = 0;
+    ++spi_transactions;
+    spi_bytes += len;
+    for(size_t i=0; i<len; ) {
+        uint8_t header = data[i], reg = header & 0x3F;
+        bool burst = header & 0x40, read = header & 0x80;
+        if (response)
+            response[i] = 0x0F;  /* Status byte */
+        ++i;
+        if (! burst && reg >= CC1101_SRES && reg < CC1101_PATABLE) {
+            if (reg == CC1101_SRES)
+                chip_reset();
+            else if (reg == CC1101_SPWD)
+                chip_sleep();
+            else if (reg == CC1101_SCAL)
+                chip_calibrate();
+            continue;
+        }
+        if (burst && read && reg >= CC1101_PARTNUM && reg < CC1101_PATABLE) {
+            /* Status register, the chip is always in IDLE */
+            if (response && i < len)
+                response[i] = reg == CC1101_MARCSTATE ? 0x01 : 0x00;
+            ++i;
+            continue;
+        }
+        do {
+            if (i >= len)
+                return;
+            uint8_t *r = chip_reg(reg, &pa);
+            if (read && response)
+                response[i] = *r;
+            else if (! read)
+                *r = data[i];
+            ++i;
+            if (reg != CC1101_PATABLE)
+                ++reg;
+        } while(burst);
+    }
+}
+
+
+uint32_t time_us_32(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+
+/* The transport of radio.c, without SPI */
+void radio_send(const uint8_t *data, uint8_t *response, size_t len) {
+    radio_config_track(data[0], data+1, len-1);
+    chip_transaction(data, response, len);
+}
+
+void radio_burst_read(uint8_t reg, uint8_t *response, size_t len) {
+    uint8_t cmd[1+64] = {CC1101_BURST(CC1101_READ(reg))}, resp[1+64];
+    chip_transaction(cmd, resp, 1+len);
+    memcpy(response, resp+1, len);
+}
+
+
+/* Presets of tests/radio.c */
+static const uint8_t conf_am270_async[] = {
+    0x02, 0x0D, 0x00, 0x0E, 0x03, 0x47, 0x08, 0x32, 0x0B, 0x06, 0x14, 0x00, 0x13, 0x00, 0x12, 0x30,
+    0x11, 0x32, 0x10, 0x67, 0x18, 0x18, 0x19, 0x18, 0x1D, 0x40, 0x1C, 0x38, 0x1B, 0x03, 0x20, 0xFB,
+    0x22, 0x11, 0x21, 0xB6,
+};
+static const uint8_t conf_gfsk999[] = {
+    0x02, 0x06, 0x03, 0x47, 0x04, 0x46, 0x05, 0x4C, 0x08, 0x05, 0x09, 0x00, 0x0B, 0x06, 0x10, 0xC8,
+    0x11, 0x93, 0x12, 0x12, 0x15, 0x34, 0x18, 0x18, 0x19, 0x16, 0x1B, 0x43, 0x1C, 0x40, 0x1D, 0x91,
+    0x20, 0xFB,
+};
+
+
+/* The writable registers of the chip are the ones of cfg */
+static bool chip_matches(const radio_config_t *cfg) {
+    for(int reg=0; reg<RADIO_CONFIG_REGS; ++reg)
+        if (reg != CC1101_FSTEST && reg != CC1101_AGCTEST && chip_regs[reg] != cfg->regs[reg])
+            return false;
+    return memcmp(chip_patable, cfg->patable, RADIO_PATABLE_LEN) == 0;
+}
+
+static void check(bool ok, const char *what) {
+    printf("- %s: %s\n", what, ok ? "ok" : "FAILED");
+    if (! ok)
+        ++failures;
+}
+
+static size_t apply(const radio_config_t *cfg, size_t *transactions) {
+    size_t t0 = spi_transactions;
+    size_t sent = radio_config_apply(cfg);
+    *transactions = spi_transactions - t0;
+    return sent;
+}
+
+
+static void test_presets(void) {
+    radio_config_t am, gfsk, read;
+    size_t sent, transactions;
+    radio_config_defaults(&am);
+    radio_config_defaults(&gfsk);
+    check(radio_config_compile(&am, conf_am270_async, sizeof(conf_am270_async))
+          && radio_config_compile(&gfsk, conf_gfsk999, sizeof(conf_gfsk999)), "compile the presets");
+    radio_config_set_frequency(&am, 433920000);
+    radio_config_set_frequency(&gfsk, 433920000);
+
+    /* The chip is not reset, the shadow is unknown: everything is written */
+    for(int reg=0; reg<RADIO_CONFIG_REGS; ++reg)
+        chip_regs[reg] = rand();
+    sent = apply(&am, &transactions);
+    printf("first apply, unknown shadow: %zu bytes in %zu transactions\n", sent, transactions);
+    check(chip_matches(&am), "first apply");
+    check(apply(&am, &transactions) == 0 && transactions == 0, "apply again sends nothing");
+
+    /* Switches, against a reset and the preset (the frequency is set after the preset) */
+    size_t naive = 1 + sizeof(conf_gfsk999) + 4;
+    for(int i=0; i<4; ++i) {
+        const radio_config_t *cfg = i % 2 ? &am : &gfsk;
+        sent = apply(cfg, &transactions);
+        printf("switch to %s: %zu bytes in %zu transactions, %zu with a reset\n", i % 2 ? "am270" : "gfsk999",
+               sent, transactions, i % 2 ? 1 + sizeof(conf_am270_async) + 4 : naive);
+        check(chip_matches(cfg), "switch");
+    }
+    check(sent < 1 + sizeof(conf_am270_async) + 4, "less bytes than a reset");
+
+    /* The calibration changes FSCAL1: read from the chip, not written again */
+    chip_regs[CC1101_FSCAL1] = 0x17;
+    check(radio_config_get(CC1101_FSCAL1) == 0x17, "calibrated registers read from the chip");
+    check(apply(&am, &transactions) == 0, "calibration kept");
+    radio_config_read(&read);
+    check(memcmp(read.regs, chip_regs, RADIO_CONFIG_REGS) == 0, "read the configuration");
+
+    /* Reads are served from the shadow */
+    size_t t0 = spi_transactions;
+    for(int reg=0; reg<RADIO_CONFIG_REGS; ++reg)
+        if (reg < CC1101_FSCAL3 || reg > CC1101_FSCAL1)
+            radio_config_get(reg);
+    check(spi_transactions == t0, "reads from the shadow");
+
+    /* SLEEP through the transport: the lost registers are written again, the others are kept */
+    radio_config_t ramp = am;
+    for(int i=0; i<RADIO_PATABLE_LEN; ++i)
+        ramp.patable[i] = 0x10*(i+1);
+    apply(&ramp, &transactions);
+    radio_send((const uint8_t []){CC1101_SPWD}, NULL, 1);
+    sent = apply(&ramp, &transactions);
+    check(chip_matches(&ramp) && sent < 1 + sizeof(conf_am270_async), "apply after a sleep");
+
+    /* A reset through the transport resets the shadow */
+    radio_send((const uint8_t []){CC1101_SRES}, NULL, 1);
+    radio_config_t def;
+    radio_config_defaults(&def);
+    check(apply(&def, &transactions) == 0, "reset followed");
+    sent = apply(&gfsk, &transactions);
+    check(chip_matches(&gfsk) && sent <= naive, "apply after a reset");
+}
+
+
+/* Random changes of random configurations */
+static void test_random(void) {
+    radio_config_t cfg;
+    radio_config_defaults(&cfg);
+    radio_config_invalidate();
+    bool ok = true;
+    size_t sent = 0, changed = 0;
+    for(int i=0; i<10000; ++i) {
+        int n = rand() % 8;
+        for(int k=0; k<n; ++k) {
+            int reg = rand() % RADIO_CONFIG_REGS;
+            cfg.regs[reg] = rand();
+            changed += reg != CC1101_FSTEST && reg != CC1101_AGCTEST;
+        }
+        if (rand() % 16 == 0)
+            cfg.patable[rand() % RADIO_PATABLE_LEN] = rand();
+        sent += radio_config_apply(&cfg);
+        ok &= chip_matches(&cfg);
+    }
+    printf("random changes: %zu registers changed, %zu bytes sent\n", changed, sent);
+    check(ok, "random changes");
+}
+
+
+/* Switches between presets at two frequencies */
+static void test_switch(void) {
+    radio_preset_t am, gfsk;
+    radio_preset_init(&am, "am270 433.92MHz", conf_am270_async, sizeof(conf_am270_async), 433920000);
+    radio_preset_init(&gfsk, "gfsk999 868.3MHz", conf_gfsk999, sizeof(conf_gfsk999), 868300000);
+
+    bool ok = true, cal_ok = true, kept = true;
+    uint8_t fscal[2][3];
+    for(int i=0; i<6; ++i) {
+        radio_preset_t *p = i % 2 ? &gfsk : &am;
+        size_t cal0 = calibrations;
+        ok &= radio_preset_switch(p);
+        printf("switch to %s: %" PRIu32 "µs, %zu bytes%s\n", p->name, p->switch_us, p->switch_bytes,
+               p->switch_calibrated ? ", calibrated" : "");
+
+        /* Calibrated once, then the same values written back */
+        cal_ok &= (calibrations - cal0 == 1) == (i < 2) && p->switch_calibrated == (i < 2);
+        if (i < 2)
+            memcpy(fscal[i % 2], chip_regs + CC1101_FSCAL3, 3);
+        else
+            kept &= memcmp(fscal[i % 2], chip_regs + CC1101_FSCAL3, 3) == 0;
+
+        radio_config_t expected = p->config;
+        memcpy(expected.regs + CC1101_FSCAL3, chip_regs + CC1101_FSCAL3, 3);
+        expected.regs[CC1101_MCSM0] &= ~0x30;
+        ok &= chip_matches(&expected);
+    }
+    check(ok, "switches");
+    check(cal_ok, "calibration at the first switch only");
+    check(kept && memcmp(fscal[0], fscal[1], 3) != 0, "calibrations written back");
+}
+
+
+int main(void) {
+    srand(1);
+    chip_reset();
+    test_presets();
+    test_random();
+    test_switch();
+
+    printf("%s, %d failures\n", failures ? "FAILED" : "ok", failures);
+    return failures != 0;
+}
@@ -0,0 +1,521 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Screen scenarios on the host: the screen library talks to the emulated SSD1681 (ssd1681.c)
+ * through the emulated SDK (sdk.c). Each operation reports what went through the SPI and the modeled time,
+ * the panel is dumped to PNG in the directory given as first argument (none when omitted).
+ *
+ * Returns non-zero when a check fails. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/irq.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+
+#include "log.h"
+#include "screen.h"
+#include "screen_fb.h"
+#include "screen_layers.h"
+#include "ssd1681.h"
+
+#include "hip_bw.h"
+#include "hip_bw_z.h"
+#include "text_bw.h"
+#include "text_bw_z.h"
+#include "hip_4g.h"
+#include "hip_4g_z.h"
+#include "notif_4g.h"
+#include "notif_4g_z.h"
+#include "companion.h"
+#include "companion_z.h"
+
+
+static const char *png_dir = NULL;
+static int failures = 0;
+
+#define check(cond, what) do { \
+    if (! (cond)) { \
+        printf("  FAILED: %s\n", what); \
+        ++failures; \
+    } \
+} while(0)
+
+/* Runs op until the screen is not busy anymore, and reports what it cost */
+#define measure(name, op) do { \
+    ssd1681_stats_reset(); \
+    absolute_time_t t0 = get_absolute_time(); \
+    op; \
+    while(screen_busy()) \
+        tight_loop_contents(); \
+    const ssd1681_stats_t *st = ssd1681_stats(); \
+    printf("%-24s %6" PRIu32 " bytes %4" PRIu32 " commands %2" PRIu32 " refreshes %8.1f ms\n", name, \
+           st->bytes, st->commands, st->refreshes, absolute_time_diff_us(t0, get_absolute_time())/1000.); \
+    check(st->violations == 0, "commands sent while busy"); \
+} while(0)
+
+
+static void dump(const char *name) {
+    if (! png_dir)
+        return;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.png", png_dir, name);
+    if (! ssd1681_dump_png(path))
+        printf("  cannot write %s\n", path);
+}
+
+/* The driver writes with decreasing X and Y: the first byte of an image is the last one of the RAM */
+static bool ram_matches(int bank, const uint8_t *img) {
+    const uint8_t *ram = ssd1681_ram(bank);
+    for(size_t iy=0; iy<SCREEN_HEIGHT; ++iy)
+        for(size_t ix=0; ix<SCREEN_WIDTH/8; ++ix)
+            if (ram[(SCREEN_HEIGHT-1-iy)*SCREEN_WIDTH/8 + SCREEN_WIDTH/8-1-ix] != img[iy*SCREEN_WIDTH/8 + ix])
+                return false;
+    return true;
+}
+
+/* Whether the panel shows the black and white image */
+static bool panel_matches(const uint8_t *img) {
+    for(size_t y=0; y<SCREEN_HEIGHT; ++y)
+        for(size_t x=0; x<SCREEN_WIDTH; ++x) {
+            bool white = img[y*SCREEN_WIDTH/8 + x/8] & (0x80 >> (x%8));
+            if (white != (ssd1681_pixel(x, y) < 128))
+                return false;
+        }
+    return true;
+}
+
+/* Whether the whole panel is black (or white), a refresh does not saturate the pixels */
+static bool panel_uniform(bool black) {
+    for(size_t y=0; y<SCREEN_HEIGHT; ++y)
+        for(size_t x=0; x<SCREEN_WIDTH; ++x)
+            if (black ? ssd1681_pixel(x, y) < 224 : ssd1681_pixel(x, y) > 31)
+                return false;
+    return true;
+}
+
+
+static void test_boot(void) {
+    measure("boot", screen_boot());
+    check(screen_temperature() == 20, "temperature not read");
+}
+
+static void test_clear(void) {
+    measure("clear black", screen_clear(0));
+    check(panel_uniform(true), "panel not black");
+    measure("clear white", screen_clear(1));
+    check(panel_uniform(false), "panel not white");
+    dump("clear");
+}
+
+static void test_show_bw(void) {
+    measure("show_bw hip", screen_show_image_bw(hip_bw));
+    check(ram_matches(0, hip_bw), "B/W RAM differs from the image");
+    check(panel_matches(hip_bw), "panel differs from the image");
+    dump("hip_bw");
+
+    screen_ws_stats_t before = screen_ws_stats();
+    measure("show_bw text", screen_show_image_bw(text_bw));
+    check(panel_matches(text_bw), "panel differs from the image");
+    check(screen_ws_stats().skipped > before.skipped, "waveform settings uploaded again");
+    dump("text_bw");
+}
+
+static void test_show_4g(void) {
+    measure("show_4g hip", screen_show_image_4g(hip_4g_lsb, hip_4g_msb));
+    check(ram_matches(0, hip_4g_lsb) && ram_matches(1, hip_4g_msb), "RAMs differ from the planes");
+    dump("hip_4g");
+
+    /* The 4 colors must give 4 distinct grays, from black (0) to white (3) */
+    uint32_t sum[4] = {0}, n[4] = {0};
+    for(size_t y=0; y<SCREEN_HEIGHT; ++y)
+        for(size_t x=0; x<SCREEN_WIDTH; ++x) {
+            size_t i = y*SCREEN_WIDTH/8 + x/8;
+            uint8_t mask = 0x80 >> (x%8);
+            int color = !!(hip_4g_msb[i] & mask) << 1 | !!(hip_4g_lsb[i] & mask);
+            sum[color] += ssd1681_pixel(x, y);
+            ++n[color];
+        }
+    for(int c=1; c<4; ++c)
+        if (n[c] && n[c-1])
+            check(sum[c]/n[c] < sum[c-1]/n[c-1], "grays are not ordered");
+
+    measure("show_z hip_4g", screen_show_image_z(hip_4g_lsb_z, hip_4g_msb_z));
+    check(ram_matches(0, hip_4g_lsb) && ram_matches(1, hip_4g_msb), "decompressed RAMs differ from the planes");
+}
+
+static void test_readback(void) {
+    static uint8_t lsb[SCREEN_PLANE_SIZE], msb[SCREEN_PLANE_SIZE];
+    bool ok = false;
+    uint32_t lsb_sum = 0, msb_sum = 0;
+
+    measure("read back 4g", ok = screen_read_rams_window(lsb, msb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT));
+    check(ok, "not read");
+    check(memcmp(lsb, hip_4g_lsb, SCREEN_PLANE_SIZE) == 0 && memcmp(msb, hip_4g_msb, SCREEN_PLANE_SIZE) == 0,
+          "read back planes differ");
+    measure("checksum 4g", ok = screen_checksum_rams_window(&lsb_sum, &msb_sum, SCREEN_WIDTH/8, SCREEN_HEIGHT));
+    check(ok, "not read");
+    check(lsb_sum == screen_checksum(hip_4g_lsb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT)
+          && msb_sum == screen_checksum(hip_4g_msb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT),
+          "checksums differ");
+    check(screen_checksum(hip_4g_lsb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT) != msb_sum, "weak checksum");
+
+    /* Not while busy */
+    screen_show_rams();
+    check(! screen_read_rams_window(lsb, NULL, SCREEN_WIDTH/8, SCREEN_WIDTH/8, 1), "read while busy");
+    while(screen_busy())
+        tight_loop_contents();
+}
+
+static void test_window(void) {
+    static uint8_t black[SCREEN_PLANE_SIZE];
+
+    screen_set_image_position(80, 80, 120, 120);
+    measure("push 40x40 window", screen_push_rams(black, NULL, 5*40));
+    /* x 80..119 are the bytes 10..14 of the RAM */
+    const uint8_t *ram = ssd1681_ram(0);
+    bool inside = true, outside = true;
+    for(size_t y=0; y<SCREEN_HEIGHT; ++y)
+        for(size_t x=0; x<SCREEN_WIDTH/8; ++x) {
+            bool in = y >= 80 && y < 120 && x >= 10 && x < 15;
+            uint8_t expected = hip_4g_lsb[(SCREEN_HEIGHT-1-y)*SCREEN_WIDTH/8 + SCREEN_WIDTH/8-1-x];
+            if (in)
+                inside &= ram[y*SCREEN_WIDTH/8 + x] == 0;
+            else
+                outside &= ram[y*SCREEN_WIDTH/8 + x] == expected;
+        }
+    check(inside, "window not written");
+    check(outside, "RAM written outside of the window");
+
+    /* Read back, then pushed again: the counters are back at the start of the window */
+    uint8_t win[5*40];
+    memset(win, 0xAA, sizeof(win));
+    check(screen_read_rams_window(win, NULL, 5, 5, 40), "window not read");
+    check(win[0] == 0 && win[5*40-1] == 0 && memcmp(win, win+1, 5*40-1) == 0, "window read back differs");
+    screen_push_rams(black, NULL, 5*40);
+    check(ram[79*SCREEN_WIDTH/8 + 10] == hip_4g_lsb[(SCREEN_HEIGHT-80)*SCREEN_WIDTH/8 + SCREEN_WIDTH/8-11],
+          "pushed after a read at the wrong place");
+    screen_clear_image_position();
+}
+
+/* Run length encoding of image2epaper.py: c < 128 is followed by c+1 literal bytes,
+ * c >= 128 by a byte repeated c-125 times. Returns the length of the compressed plane, header included. */
+static size_t rle(const uint8_t *src, size_t len, uint8_t *dst) {
+    uint8_t *out = dst;
+    *out++ = SCREEN_Z_RLE;
+    *out++ = len & 0xFF;
+    *out++ = len >> 8;
+    size_t lits = 0;  /* Literal bytes before i, not written yet */
+    for(size_t i=0; i<=len; ) {
+        size_t n = 1;
+        while(i+n < len && n < 130 && src[i+n] == src[i])
+            ++n;
+        if (i == len || n >= 3) {
+            for(size_t k=0; k<lits; k+=128) {
+                size_t chunk = lits-k < 128 ? lits-k : 128;
+                *out++ = chunk-1;
+                memcpy(out, src+i-lits+k, chunk);
+                out += chunk;
+            }
+            lits = 0;
+            if (i == len)
+                break;
+            *out++ = n+125;
+            *out++ = src[i];
+        } else {
+            lits += n;
+        }
+        i += n;
+    }
+    return out - dst;
+}
+
+/* Pushes the stripes then the planes to the window, returns whether both RAM banks are the reference afterwards */
+static bool push_z_matches(const char *name, const uint8_t *lsb_z, const uint8_t *msb_z, size_t len,
+                           const uint8_t *ref) {
+    static uint8_t stripes[SCREEN_PLANE_SIZE];
+    memset(stripes, 0x5A, sizeof(stripes));
+    screen_push_rams(stripes, msb_z ? stripes : NULL, len);
+    measure(name, screen_push_rams_z(lsb_z, msb_z));
+    return memcmp(ssd1681_ram(0), ref, SSD1681_RAM_SIZE) == 0
+        && memcmp(ssd1681_ram(1), ref + SSD1681_RAM_SIZE, SSD1681_RAM_SIZE) == 0;
+}
+
+static void test_compressed(void) {
+    /* The images are all smaller in LZSS, the run length planes are encoded here */
+    static const struct {
+        const char *name;
+        const uint8_t *lsb, *msb, *lsb_z, *msb_z;
+        size_t width, height;  /* In bytes and rows */
+    } imgs[] = {
+        {"hip_bw", hip_bw, NULL, hip_bw_z, NULL, hip_bw_width, hip_bw_height},
+        {"text_bw", text_bw, NULL, text_bw_z, NULL, text_bw_width, text_bw_height},
+        {"hip_4g", hip_4g_lsb, hip_4g_msb, hip_4g_lsb_z, hip_4g_msb_z, hip_4g_width, hip_4g_height},
+        {"notif_4g", notif_4g_lsb, notif_4g_msb, notif_4g_lsb_z, notif_4g_msb_z, notif_4g_width, notif_4g_height},
+        {"companion", companion_lsb, companion_msb, companion_lsb_z, companion_msb_z, companion_width,
+         companion_height},
+    };
+    static uint8_t lsb_rle[3 + SCREEN_PLANE_SIZE + SCREEN_PLANE_SIZE/128 + 1];
+    static uint8_t msb_rle[3 + SCREEN_PLANE_SIZE + SCREEN_PLANE_SIZE/128 + 1];
+    static uint8_t ref[2*SSD1681_RAM_SIZE];  /* Both banks after the push of the raw planes */
+
+    for(size_t i=0; i<sizeof(imgs)/sizeof(imgs[0]); ++i) {
+        size_t len = imgs[i].width*imgs[i].height;
+        char name[48];
+        screen_set_image_position(0, 0, imgs[i].width*8, imgs[i].height);
+        screen_push_rams(imgs[i].lsb, imgs[i].msb, len);
+        memcpy(ref, ssd1681_ram(0), SSD1681_RAM_SIZE);
+        memcpy(ref + SSD1681_RAM_SIZE, ssd1681_ram(1), SSD1681_RAM_SIZE);
+
+        check(imgs[i].lsb_z[0] == SCREEN_Z_LZ && (! imgs[i].msb_z || imgs[i].msb_z[0] == SCREEN_Z_LZ),
+              "test image not in LZSS");
+        snprintf(name, sizeof(name), "push_z lz %s", imgs[i].name);
+        check(push_z_matches(name, imgs[i].lsb_z, imgs[i].msb_z, len, ref), "LZSS planes differ from the raw ones");
+
+        size_t lsb_len = rle(imgs[i].lsb, len, lsb_rle);
+        size_t msb_len = imgs[i].msb ? rle(imgs[i].msb, len, msb_rle) : 0;
+        check(lsb_len <= sizeof(lsb_rle) && msb_len <= sizeof(msb_rle), "run length planes overflow");
+        snprintf(name, sizeof(name), "push_z rle %s", imgs[i].name);
+        check(push_z_matches(name, lsb_rle, imgs[i].msb ? msb_rle : NULL, len, ref),
+              "run length planes differ from the raw ones");
+    }
+    screen_clear_image_position();
+}
+
+/* The callbacks run from the spare IRQ of the library, not from the GPIO and DMA handlers */
+static volatile int callbacks_elsewhere = 0;
+static void callback_context(void) {
+    if (__get_current_exception() < 16 + FIRST_USER_IRQ)
+        ++callbacks_elsewhere;
+}
+
+static volatile bool async_done = false;
+static void on_async_done(void) {
+    callback_context();
+    async_done = true;
+}
+
+static void test_async(void) {
+    measure("push_async hip", screen_push_rams_async(hip_bw, NULL, SCREEN_PLANE_SIZE, on_async_done));
+    check(async_done, "DMA callback not called");
+    check(callbacks_elsewhere == 0, "DMA callback not called from the spare IRQ");
+    check(ram_matches(0, hip_bw), "B/W RAM differs from the image");
+}
+
+static void test_queue(void) {
+    /* The second image supersedes the first one while the screen refreshes for the 4 grays */
+    measure("queue 4g+bw+bw", {
+        screen_show_image_4g(hip_4g_lsb, hip_4g_msb);
+        screen_show_image_bw(hip_bw);
+        screen_show_image_bw(text_bw);
+    });
+    check(ssd1681_stats()->refreshes == 2, "superseded image not dropped");
+    check(panel_matches(text_bw), "panel differs from the last image");
+}
+
+static void test_fb(void) {
+    static screen_fb_t fb;
+
+    screen_fb_init(&fb, false, 1);
+    memcpy(fb.lsb, hip_bw, SCREEN_PLANE_SIZE);
+    screen_push_ws(screen_ws_1681_bw);
+    measure("fb first frame", {
+        screen_fb_push(&fb);
+        screen_show_rams();
+    });
+    check(panel_matches(hip_bw), "panel differs from the framebuffer");
+
+    for(size_t j=68; j<168; ++j)
+        memset(fb.lsb + j*SCREEN_WIDTH/8 + 48/8, 0x00, 120/8);
+    screen_fb_damage(&fb, 50, 68, 166, 168);
+    size_t pushed = 0;
+    measure("fb notification", {
+        pushed = screen_fb_push(&fb);
+        screen_show_rams();
+    });
+    check(pushed < SCREEN_PLANE_SIZE/2, "too many bytes for a small zone");
+    check(panel_matches(fb.lsb), "panel differs from the framebuffer");
+    dump("fb");
+}
+
+/* Reference composition of the layers, drawn over the whole screen */
+static void draw_layers(uint8_t *lsb, uint8_t *msb, const gfx_image_t *content, const gfx_image_t *overlay) {
+    gfx_planes_t dst = GFX_SCREEN_PLANES(lsb, msb);
+    gfx_image_t bg = GFX_IMAGE_4G(hip_4g);
+    gfx_blit(&dst, 0, 0, &bg);
+    gfx_blit(&dst, 32, 18, content);
+    if (overlay)
+        gfx_blit(&dst, 51, 68, overlay);
+}
+
+static void test_layers(void) {
+    static screen_fb_t fb;
+    static screen_layers_t layers;
+    static uint8_t lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4))), msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    gfx_image_t bg = GFX_IMAGE_4G(hip_4g);
+    gfx_image_t content = GFX_IMAGE_4G(companion);
+    gfx_image_t notif = GFX_IMAGE_4G(notif_4g);
+    content.mask = companion_lsb;
+
+    screen_fb_init(&fb, true, 3);
+    memset(&layers, 0xFF, sizeof(layers));  /* As on the stack: init must not keep anything */
+    screen_layers_init(&layers, &fb, 3);
+    screen_layers_show(&layers, SCREEN_LAYER_BACKGROUND, &bg, 0, 0);
+    screen_layers_show(&layers, SCREEN_LAYER_CONTENT, &content, 32, 18);
+    screen_layers_compose(&layers);
+    measure("layers first frame", {
+        screen_fb_push(&fb);
+        screen_show_rams();
+    });
+    draw_layers(lsb, msb, &content, NULL);
+    check(memcmp(fb.lsb, lsb, SCREEN_PLANE_SIZE) == 0 && memcmp(fb.msb, msb, SCREEN_PLANE_SIZE) == 0,
+          "composition differs from the layers");
+
+    /* The notification is not aligned on the tiles: 16x13 tiles at most */
+    size_t tiles = 0, pushed = 0;
+    screen_layers_show(&layers, SCREEN_LAYER_OVERLAY, &notif, 51, 68);
+    measure("layers notification", {
+        tiles = screen_layers_compose(&layers);
+        pushed = screen_fb_push(&fb);
+        screen_show_rams();
+    });
+    draw_layers(lsb, msb, &content, &notif);
+    check(tiles > 0 && tiles <= 16*13, "too many tiles for the notification");
+    check(memcmp(fb.lsb, lsb, SCREEN_PLANE_SIZE) == 0 && memcmp(fb.msb, msb, SCREEN_PLANE_SIZE) == 0,
+          "notification not composed");
+    check(ram_matches(0, lsb) && ram_matches(1, msb), "RAMs differ from the composition");
+    dump("layers_notif");
+
+    /* Removing it gives back exactly what was beneath, with the same tiles */
+    size_t restored = 0;
+    screen_layers_hide(&layers, SCREEN_LAYER_OVERLAY);
+    measure("layers notification pop", {
+        restored = screen_layers_compose(&layers);
+        check(screen_fb_push(&fb) == pushed, "not the same windows as the notification");
+        screen_show_rams();
+    });
+    draw_layers(lsb, msb, &content, NULL);
+    check(restored == tiles, "not the tiles of the notification");
+    check(ram_matches(0, lsb) && ram_matches(1, msb), "RAMs differ from the layers beneath the notification");
+    check(screen_layers_compose(&layers) == 0, "tiles composed twice");
+    dump("layers_pop");
+}
+
+static void test_diff(void) {
+    static uint8_t frame[SCREEN_PLANE_SIZE];
+
+    measure("diff text (full)", screen_show_image_diff(text_bw));
+    memcpy(frame, text_bw, SCREEN_PLANE_SIZE);
+    memset(frame + 40*SCREEN_WIDTH/8, 0x00, 10*SCREEN_WIDTH/8);
+    measure("diff bar", screen_show_image_diff(frame));
+    check(panel_matches(frame), "panel differs from the frame");
+    dump("diff");
+    measure("diff same", screen_show_image_diff(frame));
+    check(ssd1681_stats()->refreshes == 0, "unchanged frame refreshed");
+}
+
+static void test_fast(void) {
+    static uint8_t frame[SCREEN_PLANE_SIZE];
+
+    /* A full refresh starts the rolling frame, then every 3 fast updates */
+    screen_set_fast_full_period(3);
+    measure("show_bw hip", screen_show_image_bw(hip_bw));
+    memcpy(frame, text_bw, SCREEN_PLANE_SIZE);
+    for(size_t t=0; t<5; ++t) {
+        memset(frame + 40*t*SCREEN_WIDTH/8, 0x00, 10*SCREEN_WIDTH/8);
+        measure(t == 0 || t == 4 ? "fast bar (full)" : "fast bar", screen_show_image_fast(frame));
+        check(panel_matches(frame), "panel differs from the frame");
+        uint64_t us = ssd1681_stats()->busy_us;
+        if (t == 0 || t == 4)
+            check(us > 1000000, "no full refresh");
+        else
+            check(us < 500000, "fast update longer than 500ms");
+    }
+    dump("fast");
+    screen_set_fast_full_period(SCREEN_FAST_FULL_PERIOD);
+}
+
+static volatile int n_ready = 0, n_refreshed = 0;
+static void on_ready(void) {
+    callback_context();
+    ++n_ready;
+}
+static void on_refresh_done(void) {
+    callback_context();
+    ++n_refreshed;
+    screen_deep_sleep();
+}
+
+static void test_callbacks(void) {
+    /* The screen stays busy once asleep: wait for the callback instead */
+    screen_set_callbacks(on_ready, on_refresh_done);
+    ssd1681_stats_reset();
+    screen_show_image_bw(hip_bw);
+    while(! n_refreshed)
+        tight_loop_contents();
+    check(n_refreshed == 1, "refresh callback not called once");
+    check(ssd1681_busy_until() == UINT64_MAX, "screen not asleep");
+    check(ssd1681_stats()->violations == 0, "commands sent while busy");
+
+    /* Waking up skips the power wait and the software reset, and keeps the temperature */
+    ssd1681_set_temperature(32.5f);
+    screen_boot_timings_t cold = screen_boot_timings();
+    measure("wake up", screen_boot());
+    screen_boot_timings_t wake = screen_boot_timings();
+    check(n_ready == 1, "ready callback not called");
+    check(callbacks_elsewhere == 0, "callbacks not called from the spare IRQ");
+    check(wake.wake && ! cold.wake, "not a wake up");
+    check(wake.swreset_us == 0 && wake.total_us < cold.total_us/2, "wake up not shorter");
+    check(screen_temperature() == 20, "temperature measured again");
+    screen_set_callbacks(NULL, NULL);
+    measure("show_bw after wake up", screen_show_image_bw(text_bw));
+    check(panel_matches(text_bw), "panel differs from the image");
+}
+
+static void test_temperature(void) {
+    /* The temperature is measured again when it is old: warmer, shorter refreshes */
+    screen_deep_sleep();
+    sleep_ms(11*60*1000);
+    measure("wake up after 11min", screen_boot());
+    check(screen_temperature() == 32, "temperature not measured");
+    measure("show_bw at 32°C", screen_show_image_bw(hip_bw));
+    check(panel_matches(hip_bw), "panel differs from the image");
+    check(ssd1681_stats()->busy_us < 1100000, "refresh not shortened");
+}
+
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        png_dir = argv[1];
+
+    setvbuf(stdout, NULL, _IOLBF, 0);  /* Interleaved with the errors of the emulator */
+    ssd1681_power_on(0);
+    stdio_init_all();
+    log_set_level(LOG_LEVEL_INFO);
+    screen_init();
+    screen_init();  /* Again: the DMA channel and the handlers are only added once */
+
+    ssd1681_stats_reset();
+    test_boot();
+    test_clear();
+    test_show_bw();
+    test_show_4g();
+    test_readback();
+    test_window();
+    test_compressed();
+    test_async();
+    test_queue();
+    test_fb();
+    test_layers();
+    test_diff();
+    test_fast();
+    test_callbacks();
+    test_temperature();
+
+    printf("%s, %d failures\n", failures ? "FAILED" : "ok", failures);
+    return failures != 0;
+}
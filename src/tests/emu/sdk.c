@@ -0,0 +1,561 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/* Host implementation of the pico SDK shims (see include/), on a virtual clock.
+ *
+ * Time only passes in the calls that take time on the badge: SPI transfers (at the configured baudrate),
+ * sleeps and tight_loop_contents(), which jumps to the next event.
+ * The events are the interrupts that the screen library uses: alarms, end of the DMA transfers,
+ * falling edges of the BUSY pin of the emulated SSD1681. They run between these calls, unless interrupts are disabled,
+ * and not inside another interrupt. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+
+#include "badge_pinout.h"
+#include "ssd1681.h"
+
+
+#define N_GPIOS 30
+#define N_ALARMS 8
+#define N_HANDLERS 4
+#define TIMEOUT_US (3600ull*1000000)  /* Stops the tests that wait forever (e.g. for a screen in deep sleep) */
+
+
+struct spi_inst {
+    spi_hw_t hw;
+    uint baudrate;
+};
+spi_inst_t emu_spi0, emu_spi1;
+
+static uint64_t now_us = 0;
+static uint64_t spi_ns = 0;  /* Below the µs, so that byte transfers add up */
+static bool irq_on = true, in_irq = false;
+static uint exception = 0;  /* Of the running handler, see __get_current_exception */
+
+static struct {
+    alarm_id_t id;  /* 0 when free */
+    uint64_t at;
+    alarm_callback_t callback;
+    void *user_data;
+} alarms[N_ALARMS];
+static alarm_id_t next_alarm_id = 1;
+
+static struct {
+    bool claimed, active;
+    uint64_t done_at;
+    bool irq0_enabled, irq0_status;
+} dma;
+
+static irq_handler_t irq_handlers[32][N_HANDLERS];
+static bool irq_enabled[32];
+static bool irq_pending[32];  /* Raised by irq_set_pending, run once the interrupts are possible */
+static uint32_t user_irqs_claimed = 0;
+
+static bool gpio_out[N_GPIOS];
+static uint32_t gpio_irq_mask[N_GPIOS], gpio_irq_events[N_GPIOS];
+static irq_handler_t gpio_raw[N_GPIOS];
+static gpio_irq_callback_t gpio_callback = NULL;
+static uint64_t busy_fall_seen = 0;  /* Last falling edge of BUSY that was delivered */
+
+
+static void call_irq(uint num) {
+    if (! irq_enabled[num])
+        return;
+    for(size_t i=0; i<N_HANDLERS; ++i)
+        if (irq_handlers[num][i])
+            irq_handlers[num][i]();
+}
+
+
+/* The pending interrupts run after the current handler, like the lower priorities of the NVIC */
+static void run_pending(void) {
+    if (! irq_on || in_irq)
+        return;
+    uint num = 0;
+    while(num < 32) {
+        if (! irq_pending[num] || ! irq_enabled[num]) {
+            ++num;
+            continue;
+        }
+        irq_pending[num] = false;
+        in_irq = true;
+        exception = 16 + num;
+        call_irq(num);
+        exception = 0;
+        in_irq = false;
+        num = 0;  /* Handlers may raise other ones */
+    }
+}
+
+
+static alarm_id_t set_alarm(alarm_id_t id, uint64_t at, alarm_callback_t callback, void *user_data) {
+    for(size_t i=0; i<N_ALARMS; ++i)
+        if (! alarms[i].id) {
+            alarms[i].id = id;
+            alarms[i].at = at;
+            alarms[i].callback = callback;
+            alarms[i].user_data = user_data;
+            return id;
+        }
+    fprintf(stderr, "emu: no more alarms\n");
+    return -1;
+}
+
+
+/* Next event, UINT64_MAX if none, and its kind: 0 alarm (index in *alarm), 1 DMA, 2 BUSY */
+static uint64_t next_event(int *kind, size_t *alarm) {
+    uint64_t t = UINT64_MAX;
+    for(size_t i=0; i<N_ALARMS; ++i)
+        if (alarms[i].id && alarms[i].at < t) {
+            t = alarms[i].at;
+            *kind = 0;
+            *alarm = i;
+        }
+    if (dma.active && dma.done_at < t) {
+        t = dma.done_at;
+        *kind = 1;
+    }
+    uint64_t fall = ssd1681_busy_until();
+    if (fall != UINT64_MAX && fall > busy_fall_seen && fall < t) {
+        t = fall;
+        *kind = 2;
+    }
+    return t;
+}
+
+static void fire(int kind, size_t a, uint64_t t) {
+    in_irq = true;
+    exception = 16 + (kind == 0 ? 0 : kind == 1 ? DMA_IRQ_0 : IO_IRQ_BANK0);  /* TIMER_IRQ_0 for the alarms */
+    if (kind == 0) {
+        alarm_id_t id = alarms[a].id;
+        alarm_callback_t cb = alarms[a].callback;
+        void *user_data = alarms[a].user_data;
+        alarms[a].id = 0;
+        int64_t again = cb(id, user_data);
+        if (again)
+            set_alarm(id, again < 0 ? now_us - again : t + again, cb, user_data);
+    } else if (kind == 1) {
+        dma.active = false;
+        if (dma.irq0_enabled) {
+            dma.irq0_status = true;
+            call_irq(DMA_IRQ_0);
+        }
+    } else {
+        busy_fall_seen = t;
+        uint pin = BADGE_SCREEN_BUSY;
+        if (! ssd1681_busy(now_us) && (gpio_irq_mask[pin] & GPIO_IRQ_EDGE_FALL)) {
+            gpio_irq_events[pin] |= GPIO_IRQ_EDGE_FALL;
+            if (irq_enabled[IO_IRQ_BANK0]) {
+                if (gpio_raw[pin])
+                    gpio_raw[pin]();
+                if (gpio_callback && (gpio_irq_events[pin] & GPIO_IRQ_EDGE_FALL)) {
+                    gpio_irq_events[pin] &= ~GPIO_IRQ_EDGE_FALL;
+                    gpio_callback(pin, GPIO_IRQ_EDGE_FALL);
+                }
+            }
+        }
+    }
+    exception = 0;
+    in_irq = false;
+    run_pending();
+}
+
+/* Lets the time pass until target, running the events on the way when interrupts are possible */
+static void run_until(uint64_t target) {
+    while(irq_on && ! in_irq) {
+        int kind = 0;
+        size_t a = 0;
+        uint64_t t = next_event(&kind, &a);
+        if (t > target)
+            break;
+        if (t > now_us)
+            now_us = t;
+        fire(kind, a, t);
+    }
+    if (target > now_us)
+        now_us = target;
+    if (now_us > TIMEOUT_US) {
+        fprintf(stderr, "emu: more than %llus of virtual time, something waits forever\n", TIMEOUT_US/1000000);
+        exit(2);
+    }
+}
+
+/* Time of len bytes on the SPI */
+static void spi_time(const spi_inst_t *spi, size_t len) {
+    spi_ns += (uint64_t)len * 8 * 1000000000ull / (spi->baudrate ? spi->baudrate : 1000000);
+    uint64_t us = spi_ns / 1000;
+    spi_ns %= 1000;
+    run_until(now_us + us);
+}
+
+
+/* Busy loops wait for an event: go straight to it, or let 1ms pass when there is none (it may never come) */
+uint __get_current_exception(void) {
+    return exception;
+}
+
+void tight_loop_contents(void) {
+    int kind;
+    size_t a;
+    uint64_t t = irq_on && ! in_irq ? next_event(&kind, &a) : UINT64_MAX;
+    if (t == UINT64_MAX)
+        t = now_us + 1000;
+    run_until(t <= now_us ? now_us + 1 : t);
+}
+
+
+/* pico/time.h */
+
+absolute_time_t get_absolute_time(void) {
+    return now_us;
+}
+
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+uint64_t time_us_64(void) {
+    return now_us;
+}
+
+uint32_t time_us_32(void) {
+    return now_us;
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+    return now_us + us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return now_us + 1000ull*ms;
+}
+
+bool time_reached(absolute_time_t t) {
+    return now_us >= t;
+}
+
+void sleep_us(uint64_t us) {
+    run_until(now_us + us);
+}
+
+void sleep_ms(uint32_t ms) {
+    run_until(now_us + 1000ull*ms);
+}
+
+void busy_wait_us(uint64_t us) {
+    run_until(now_us + us);
+}
+
+void busy_wait_us_32(uint32_t us) {
+    run_until(now_us + us);
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    alarm_id_t id = next_alarm_id++;
+    uint64_t at = now_us + us;
+    /* Like the SDK, an alarm that is already due is called from this call */
+    while(us == 0 && fire_if_past) {
+        int64_t again = callback(id, user_data);
+        if (! again)
+            return 0;
+        at = again < 0 ? now_us - again : at + again;
+        if (at > now_us)
+            break;
+    }
+    return set_alarm(id, at, callback, user_data);
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_in_us(1000ull*ms, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) {
+    for(size_t i=0; i<N_ALARMS; ++i)
+        if (alarm_id && alarms[i].id == alarm_id) {
+            alarms[i].id = 0;
+            return true;
+        }
+    return false;
+}
+
+
+/* pico/stdlib.h */
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+bool stdio_usb_init(void) {
+    return true;
+}
+
+
+/* hardware/sync.h */
+
+uint32_t save_and_disable_interrupts(void) {
+    uint32_t status = irq_on;
+    irq_on = false;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    irq_on = status;
+    if (irq_on) {
+        run_until(now_us);  /* The pending interrupts */
+        run_pending();
+    }
+}
+
+
+/* hardware/irq.h */
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    (void)order_priority;
+    for(size_t i=0; i<N_HANDLERS; ++i)
+        if (irq_handlers[num][i] == handler) {
+            fprintf(stderr, "emu: handler added twice to IRQ %u\n", num);
+            exit(2);
+        }
+    for(size_t i=0; i<N_HANDLERS; ++i)
+        if (! irq_handlers[num][i]) {
+            irq_handlers[num][i] = handler;
+            return;
+        }
+    fprintf(stderr, "emu: no more handlers for IRQ %u\n", num);
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    irq_handlers[num][0] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    irq_enabled[num] = enabled;
+    if (enabled)
+        run_pending();
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority) {
+    (void)num;
+    (void)hardware_priority;
+}
+
+void irq_set_pending(uint num) {
+    irq_pending[num] = true;
+    run_pending();
+}
+
+int user_irq_claim_unused(bool required) {
+    for(uint i=0; i<NUM_USER_IRQS; ++i)
+        if (! (user_irqs_claimed & (1u << i))) {
+            user_irqs_claimed |= 1u << i;
+            return FIRST_USER_IRQ + i;
+        }
+    if (required) {
+        fprintf(stderr, "emu: no more user IRQs\n");
+        exit(2);
+    }
+    return -1;
+}
+
+
+/* hardware/gpio.h */
+
+void gpio_init(uint gpio) {
+    gpio_out[gpio] = false;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    (void)gpio;
+    (void)fn;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_pull_up(uint gpio) {
+    (void)gpio;
+}
+
+void gpio_pull_down(uint gpio) {
+    (void)gpio;
+}
+
+void gpio_disable_pulls(uint gpio) {
+    (void)gpio;
+}
+
+void gpio_put(uint gpio, bool value) {
+    gpio_out[gpio] = value;
+    if (gpio == BADGE_SCREEN_RST)
+        ssd1681_set_rst(value, now_us);
+}
+
+bool gpio_get(uint gpio) {
+    if (gpio == BADGE_SCREEN_BUSY)
+        return ssd1681_busy(now_us);
+    return gpio_out[gpio];
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled) {
+    if (enabled)
+        gpio_irq_mask[gpio] |= event_mask;
+    else
+        gpio_irq_mask[gpio] &= ~event_mask;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback) {
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+    gpio_callback = callback;
+    irq_enabled[IO_IRQ_BANK0] = true;
+}
+
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler) {
+    gpio_raw[gpio] = handler;
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio) {
+    return gpio_irq_events[gpio];
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t event_mask) {
+    gpio_irq_events[gpio] &= ~event_mask;
+}
+
+
+/* hardware/spi.h, spi0 is wired to the screen */
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    return spi_set_baudrate(spi, baudrate);
+}
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    spi->baudrate = baudrate;
+    return baudrate;
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    return &spi->hw;
+}
+
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx) {
+    return 2*(spi == spi1) + !is_tx;
+}
+
+bool spi_is_busy(const spi_inst_t *spi) {
+    (void)spi;
+    return false;  /* The transfers are done when the blocking calls return */
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    if (spi == spi0)
+        ssd1681_write(gpio_out[BADGE_SCREEN_DC], src, len, now_us);
+    spi_time(spi, len);
+    return len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len) {
+    (void)repeated_tx_data;
+    if (spi == spi0)
+        ssd1681_read(dst, len, now_us);
+    spi_time(spi, len);
+    return len;
+}
+
+
+/* hardware/dma.h, the transfers go to spi0 */
+
+int dma_claim_unused_channel(bool required) {
+    if (dma.claimed) {
+        if (required) {
+            fprintf(stderr, "emu: only one DMA channel\n");
+            exit(2);
+        }
+        return -1;
+    }
+    dma.claimed = true;
+    return 0;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel;
+    return (dma_channel_config){0};
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    (void)c;
+    (void)size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    (void)c;
+    (void)incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    (void)c;
+    (void)incr;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    (void)channel;
+    (void)config;
+    (void)write_addr;
+    if (trigger)
+        dma_channel_transfer_from_buffer_now(channel, read_addr, transfer_count);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    (void)channel;
+    /* The bytes reach the controller at once, the end of the transfer is an event */
+    ssd1681_write(gpio_out[BADGE_SCREEN_DC], (const uint8_t *)read_addr, transfer_count, now_us);
+    dma.active = true;
+    dma.done_at = now_us + (uint64_t)transfer_count * 8 * 1000000 / spi0->baudrate + 1;
+}
+
+bool dma_channel_is_busy(uint channel) {
+    (void)channel;
+    return dma.active;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    while(dma_channel_is_busy(channel))
+        tight_loop_contents();
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    (void)channel;
+    dma.irq0_enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+    (void)channel;
+    return dma.irq0_status;
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+    (void)channel;
+    dma.irq0_status = false;
+}
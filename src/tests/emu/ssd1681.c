@@ -0,0 +1,521 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ssd1681.h"
+
+
+#define STRIDE (SSD1681_WIDTH/8)
+#define LUT_SIZE 153
+#define BORDER 4  /* Pixels of border around the panel in the PNG */
+
+/* Timings, measured on the badge (see tests/screen.c) or guessed from the boot logs */
+#define RESET_US 1200         /* BUSY after the rising edge of RST */
+#define BUSY_RISE_US 5        /* BUSY rises a little after the activation (0x20) */
+#define SWRESET_US 2000
+#define ANALOG_ON_US 90000    /* 0x22 0xC0 */
+#define ANALOG_OFF_US 140000  /* 0x22 0x03 */
+#define TEMP_LOAD_US 1500
+#define LUT_LOAD_US 1500
+#define FR_STEP_HZ 25         /* 1 TP with FR=2 lasts 20ms */
+
+/* The waveform in OTP is not known, this one is a full refresh in black and white (same as screen_ws_1681_bw) */
+static const uint8_t otp_lut[LUT_SIZE] =
+    "\x80\x48\x40\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+    "\x40\x48\x80\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+    "\x80\x48\x40\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+    "\x40\x48\x80\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+    "\x0A\x00\x00\x00\x00\x00\x00"
+    "\x08\x01\x00\x08\x01\x00\x02"
+    "\x0A\x00\x00\x00\x00\x00\x00"
+    "\x00\x00\x00\x00\x00\x00\x00" "\x00\x00\x00\x00\x00\x00\x00" "\x00\x00\x00\x00\x00\x00\x00"
+    "\x00\x00\x00\x00\x00\x00\x00" "\x00\x00\x00\x00\x00\x00\x00" "\x00\x00\x00\x00\x00\x00\x00"
+    "\x00\x00\x00\x00\x00\x00\x00" "\x00\x00\x00\x00\x00\x00\x00" "\x00\x00\x00\x00\x00\x00\x00"
+    "\x22\x22\x22\x22\x22\x22" "\x00\x00\x00";
+
+
+static struct {
+    uint8_t ram[2][SSD1681_RAM_SIZE];
+    uint8_t panel[SSD1681_HEIGHT][SSD1681_WIDTH];  /* In the orientation of the images */
+    uint8_t border;
+
+    /* Registers */
+    uint8_t entry;              /* 0x11 */
+    uint8_t xs, xe, xc;         /* 0x44, 0x4E */
+    uint16_t ys, ye, yc;        /* 0x45, 0x4F */
+    uint8_t ctrl1[2], ctrl2;    /* 0x21, 0x22 */
+    uint8_t lut[LUT_SIZE];      /* 0x32 */
+    uint8_t border_ctrl;        /* 0x3C */
+    uint8_t temp_sel;           /* 0x18 */
+    uint8_t temp_param[2];      /* 0x1A */
+    uint16_t temp_reg;          /* 12 bits, 1/16 °C */
+    uint8_t read_bank;          /* 0x41 */
+
+    bool clock_on, analog_on;
+    bool rst_low, sleeping;
+    uint64_t busy_from, busy_until;  /* The BUSY pin, the controller is busy from the command */
+
+    /* Decoder */
+    int cmd;                    /* Last command, -1 when ignored */
+    size_t n_param;             /* Parameters (or read bytes) since the command */
+    float ambient;
+    ssd1681_stats_t stats;
+} dev;
+
+
+/* Registers after a reset, the RAM is kept */
+static void por(void) {
+    dev.entry = 0x03;
+    dev.xs = 0;
+    dev.xe = 0x15;  /* 176 columns... */
+    dev.ys = 0;
+    dev.ye = 0x127;  /* ... and 296 lines */
+    dev.xc = 0;
+    dev.yc = 0;
+    dev.ctrl1[0] = dev.ctrl1[1] = 0;
+    dev.ctrl2 = 0xFF;
+    memset(dev.lut, 0, LUT_SIZE);
+    dev.border_ctrl = 0xC0;
+    dev.temp_sel = 0x48;
+    dev.read_bank = 0;
+    dev.clock_on = dev.analog_on = false;
+    dev.cmd = -1;
+}
+
+
+void ssd1681_power_on(uint64_t now_us) {
+    memset(&dev, 0, sizeof(dev));
+    /* The RAM is not cleared at power on, make it visible when it is shown */
+    uint32_t seed = 0x1681;
+    for(size_t b=0; b<2; ++b)
+        for(size_t i=0; i<SSD1681_RAM_SIZE; ++i) {
+            seed = seed*1103515245u + 12345u;
+            dev.ram[b][i] = seed >> 24;
+        }
+    dev.ambient = 20.f;
+    por();
+    dev.busy_from = now_us;
+    dev.busy_until = now_us + RESET_US;
+}
+
+
+bool ssd1681_busy(uint64_t now_us) {
+    return dev.rst_low || (now_us >= dev.busy_from && now_us < dev.busy_until);
+}
+
+/* Busy from the command, before the pin rises */
+static bool working(uint64_t now_us) {
+    return dev.rst_low || now_us < dev.busy_until;
+}
+
+uint64_t ssd1681_busy_until(void) {
+    return dev.busy_until;
+}
+
+
+void ssd1681_set_rst(bool level, uint64_t now_us) {
+    if (level && dev.rst_low) {
+        /* Hardware reset, also the only way out of deep sleep */
+        por();
+        dev.sleeping = false;
+        dev.busy_from = now_us;
+        dev.busy_until = now_us + RESET_US;
+        dev.stats.busy_us += RESET_US;
+    }
+    dev.rst_low = ! level;
+}
+
+
+void ssd1681_set_temperature(float celsius) {
+    dev.ambient = celsius;
+}
+
+
+/* Moves the address counters after a RAM access, following the data entry mode */
+static void advance(void) {
+    int dx = (dev.entry & 1) ? 1 : -1, dy = (dev.entry & 2) ? 1 : -1;
+    if (! (dev.entry & 4)) {
+        if (dev.xc != dev.xe) {
+            dev.xc += dx;
+            return;
+        }
+        dev.xc = dev.xs;
+        dev.yc = dev.yc == dev.ye ? dev.ys : dev.yc + dy;
+    } else {
+        if (dev.yc != dev.ye) {
+            dev.yc += dy;
+            return;
+        }
+        dev.yc = dev.ys;
+        dev.xc = dev.xc == dev.xe ? dev.xs : dev.xc + dx;
+    }
+}
+
+static uint8_t *ram_at(int bank) {
+    if (dev.xc >= STRIDE || dev.yc >= SSD1681_HEIGHT)
+        return NULL;
+    return &dev.ram[bank][dev.yc*STRIDE + dev.xc];
+}
+
+
+/* Applies a VS code for a frame: 01 (VSH1) and 11 (VSH2) darken, 10 (VSL) lightens, 00 (VSS) does nothing */
+static uint8_t drive(uint8_t level, unsigned vs) {
+    if (vs == 1 || vs == 3)
+        return level + (255-level+3)/4;
+    if (vs == 2)
+        return level - (level+3)/4;
+    return level;
+}
+
+/* Runs the LUT: the level of the 4 kinds of pixels (RED<<1 | BW) from each level, returns its length */
+static uint64_t run_lut(uint8_t map[4][256], uint32_t *frames) {
+    uint64_t us = 0;
+    for(int k=0; k<4; ++k)
+        for(int l=0; l<256; ++l)
+            map[k][l] = l;
+    *frames = 0;
+
+    for(int g=0; g<12; ++g) {
+        const uint8_t *tp = &dev.lut[60 + 7*g];  /* TP[nA], TP[nB], SR[nAB], TP[nC], TP[nD], SR[nCD], RP[n] */
+        unsigned fr = (dev.lut[144 + g/2] >> (g%2 ? 0 : 4)) & 0xF;
+        uint32_t n = ((tp[0]+tp[1])*(tp[2]+1) + (tp[3]+tp[4])*(tp[5]+1)) * (tp[6]+1);
+        if (! n)
+            continue;
+        *frames += n;
+        us += (uint64_t)n * 1000000 / (FR_STEP_HZ * (fr ? fr : 1));
+
+        for(int k=0; k<4; ++k) {
+            uint8_t vs = dev.lut[12*k + g];
+            for(int l=0; l<256; ++l) {
+                uint8_t v = map[k][l];
+                for(unsigned rp=0; rp<=tp[6]; ++rp) {
+                    for(unsigned sr=0; sr<=tp[2]; ++sr) {
+                        for(unsigned f=0; f<tp[0]; ++f) v = drive(v, (vs >> 6) & 3);
+                        for(unsigned f=0; f<tp[1]; ++f) v = drive(v, (vs >> 4) & 3);
+                    }
+                    for(unsigned sr=0; sr<=tp[5]; ++sr) {
+                        for(unsigned f=0; f<tp[3]; ++f) v = drive(v, (vs >> 2) & 3);
+                        for(unsigned f=0; f<tp[4]; ++f) v = drive(v, vs & 3);
+                    }
+                }
+                map[k][l] = v;
+            }
+        }
+    }
+    return us;
+}
+
+/* Bit read by the display from a RAM bank, with the bypass/inverse option of 0x21 */
+static unsigned ram_bit(int bank, size_t i, unsigned b) {
+    uint8_t opt = bank ? dev.ctrl1[0] >> 4 : dev.ctrl1[0] & 0xF;
+    if (opt & 4)
+        return opt & 1;  /* Bypassed, read as 0 (0x4) or 1 (0x5, see screen_clear) */
+    unsigned v = (dev.ram[bank][i] >> b) & 1;
+    return (opt & 8) ? !v : v;
+}
+
+static uint64_t display(void) {
+    uint8_t map[4][256];
+    uint32_t frames;
+    uint64_t us = run_lut(map, &frames);
+    if (! dev.analog_on)
+        return us;  /* The panel is not driven without the analog part */
+
+    for(int y=0; y<SSD1681_HEIGHT; ++y)
+        for(int xa=0; xa<STRIDE; ++xa) {
+            size_t i = y*STRIDE + xa;
+            for(unsigned b=0; b<8; ++b) {
+                unsigned k = (ram_bit(1, i, b) << 1) | ram_bit(0, i, b);
+                uint8_t *p = &dev.panel[SSD1681_HEIGHT-1-y][8*(STRIDE-1-xa) + 7-b];
+                *p = map[k][*p];
+            }
+        }
+    /* Border follows a LUT (VBD = GS transition) */
+    if ((dev.border_ctrl & 0xC4) == 0x04)
+        dev.border = map[dev.border_ctrl & 3][dev.border];
+
+    ++dev.stats.refreshes;
+    dev.stats.frames += frames;
+    return us;
+}
+
+
+/* Runs the sequence of 0x22 */
+static void activate(uint64_t now_us) {
+    uint8_t c = dev.ctrl2;
+    uint64_t us = 0;
+    if (c & 0x80)
+        dev.clock_on = true;
+    if ((c & 0x40) && ! dev.analog_on) {
+        dev.analog_on = true;
+        us += ANALOG_ON_US;
+    }
+    if (c & 0x20) {
+        if (dev.temp_sel == 0x80)
+            dev.temp_reg = (uint16_t)(int16_t)(dev.ambient*16) & 0xFFF;
+        us += TEMP_LOAD_US;
+    }
+    if (c & 0x10) {
+        memcpy(dev.lut, otp_lut, LUT_SIZE);
+        us += LUT_LOAD_US;
+    }
+    if (c & 0x04)
+        us += display();  /* Mode 2 (0x08) uses the same LUT here */
+    if ((c & 0x02) && dev.analog_on) {
+        dev.analog_on = false;
+        us += ANALOG_OFF_US;
+    }
+    if (c & 0x01)
+        dev.clock_on = false;
+
+    dev.busy_from = now_us + BUSY_RISE_US;
+    dev.busy_until = now_us + us;
+    dev.stats.busy_us += us;
+}
+
+
+static void command(uint8_t c, uint64_t now_us) {
+    ++dev.stats.commands;
+    dev.n_param = 0;
+    if (working(now_us)) {
+        ++dev.stats.violations;
+        fprintf(stderr, "ssd1681: command 0x%02X while busy, ignored\n", c);
+        dev.cmd = -1;
+        return;
+    }
+    dev.cmd = c;
+
+    switch(c) {
+    case 0x12:
+        por();
+        dev.busy_from = now_us;
+        dev.busy_until = now_us + SWRESET_US;
+        dev.stats.busy_us += SWRESET_US;
+        break;
+    case 0x20:
+        activate(now_us);
+        break;
+    default:
+        break;
+    }
+}
+
+static void param(uint8_t v) {
+    size_t i = dev.n_param++;
+    uint8_t *p;
+
+    switch(dev.cmd) {
+    case 0x03: /* VGH */
+    case 0x04: /* VSH1, VSH2, VSL */
+    case 0x2C: /* VCOM */
+    case 0x3F: /* EOPT */
+        break;  /* The voltages are not modeled */
+    case 0x10:
+        if (i == 0 && (v & 3)) {
+            dev.sleeping = true;
+            dev.busy_from = 0;
+            dev.busy_until = UINT64_MAX;
+        }
+        break;
+    case 0x11:
+        dev.entry = v & 7;
+        break;
+    case 0x18:
+        dev.temp_sel = v;
+        break;
+    case 0x1A:
+        if (i < 2)
+            dev.temp_param[i] = v;
+        dev.temp_reg = ((dev.temp_param[0] << 4) | (dev.temp_param[1] >> 4)) & 0xFFF;
+        break;
+    case 0x21:
+        if (i < 2)
+            dev.ctrl1[i] = v;
+        break;
+    case 0x22:
+        dev.ctrl2 = v;
+        break;
+    case 0x24:
+    case 0x26:
+        if ((p = ram_at(dev.cmd == 0x26)))
+            *p = v;
+        advance();
+        break;
+    case 0x32:
+        if (i < LUT_SIZE)
+            dev.lut[i] = v;
+        break;
+    case 0x3C:
+        dev.border_ctrl = v;
+        break;
+    case 0x41:
+        dev.read_bank = v & 1;
+        break;
+    case 0x44:
+        if (i == 0)
+            dev.xs = v & 0x3F;
+        else if (i == 1)
+            dev.xe = v & 0x3F;
+        break;
+    case 0x45:
+        if (i == 0)
+            dev.ys = (dev.ys & 0x100) | v;
+        else if (i == 1)
+            dev.ys = (dev.ys & 0xFF) | ((v & 1) << 8);
+        else if (i == 2)
+            dev.ye = (dev.ye & 0x100) | v;
+        else if (i == 3)
+            dev.ye = (dev.ye & 0xFF) | ((v & 1) << 8);
+        break;
+    case 0x4E:
+        dev.xc = v & 0x3F;
+        break;
+    case 0x4F:
+        if (i == 0)
+            dev.yc = (dev.yc & 0x100) | v;
+        else if (i == 1)
+            dev.yc = (dev.yc & 0xFF) | ((v & 1) << 8);
+        break;
+    default:
+        break;  /* Commands that do not change what is modeled, or ignored while busy */
+    }
+}
+
+
+void ssd1681_write(bool dc, const uint8_t *data, size_t len, uint64_t now_us) {
+    dev.stats.bytes += len;
+    for(size_t i=0; i<len; ++i) {
+        if (! dc)
+            command(data[i], now_us);
+        else if (dev.cmd >= 0)
+            param(data[i]);
+    }
+}
+
+
+void ssd1681_read(uint8_t *dst, size_t len, uint64_t now_us) {
+    (void)now_us;
+    for(size_t i=0; i<len; ++i, ++dev.n_param) {
+        uint8_t v = 0;
+        const uint8_t *p;
+        switch(dev.cmd) {
+        case 0x1B:
+            v = dev.n_param == 0 ? dev.temp_reg >> 4 : (dev.temp_reg & 0xF) << 4;
+            break;
+        case 0x27:
+            /* The first byte is a dummy one */
+            if (dev.n_param > 0) {
+                if ((p = ram_at(dev.read_bank)))
+                    v = *p;
+                advance();
+            }
+            break;
+        case 0x2F:
+            v = (dev.analog_on ? 0x20 : 0) | (dev.clock_on ? 0x10 : 0);  /* Not exactly the status bits */
+            break;
+        default:
+            break;
+        }
+        dst[i] = v;
+    }
+}
+
+
+const uint8_t *ssd1681_ram(int bank) {
+    return dev.ram[bank & 1];
+}
+
+uint8_t ssd1681_pixel(int x, int y) {
+    return dev.panel[y][x];
+}
+
+const ssd1681_stats_t *ssd1681_stats(void) {
+    return &dev.stats;
+}
+
+void ssd1681_stats_reset(void) {
+    memset(&dev.stats, 0, sizeof(dev.stats));
+}
+
+
+/* PNG with stored (not compressed) deflate blocks, to avoid a dependency on zlib */
+static uint32_t crc_update(uint32_t crc, const uint8_t *p, size_t len) {
+    crc = ~crc;
+    while(len--) {
+        crc ^= *p++;
+        for(int k=0; k<8; ++k)
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static bool write_chunk(FILE *f, const char *type, const uint8_t *data, size_t len) {
+    uint8_t hdr[8], crc[4];
+    put_be32(hdr, len);
+    memcpy(hdr+4, type, 4);
+    put_be32(crc, crc_update(crc_update(0, hdr+4, 4), data, len));
+    return fwrite(hdr, 1, 8, f) == 8 && fwrite(data, 1, len, f) == len && fwrite(crc, 1, 4, f) == 4;
+}
+
+bool ssd1681_dump_png(const char *path) {
+    enum { W = SSD1681_WIDTH + 2*BORDER, H = SSD1681_HEIGHT + 2*BORDER, ROW = W+1, RAW = ROW*H };
+    static uint8_t raw[RAW];
+    static uint8_t z[2 + RAW + 5*(RAW/65535+1) + 4];
+
+    for(int y=0; y<H; ++y) {
+        uint8_t *row = &raw[y*ROW];
+        row[0] = 0;  /* No filter */
+        for(int x=0; x<W; ++x) {
+            bool in = x >= BORDER && x < W-BORDER && y >= BORDER && y < H-BORDER;
+            row[1+x] = 255 - (in ? dev.panel[y-BORDER][x-BORDER] : dev.border);
+        }
+    }
+
+    size_t n = 0;
+    z[n++] = 0x78;
+    z[n++] = 0x01;
+    uint32_t a = 1, b = 0;
+    for(size_t i=0; i<RAW; i+=65535) {
+        size_t len = RAW-i < 65535 ? RAW-i : 65535;
+        z[n++] = i+len == RAW;  /* Last block, stored */
+        z[n++] = len;
+        z[n++] = len >> 8;
+        z[n++] = ~len;
+        z[n++] = ~len >> 8;
+        memcpy(&z[n], &raw[i], len);
+        n += len;
+    }
+    for(size_t i=0; i<RAW; ++i) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(&z[n], (b << 16) | a);
+    n += 4;
+
+    uint8_t ihdr[13] = {0};
+    put_be32(ihdr, W);
+    put_be32(ihdr+4, H);
+    ihdr[8] = 8;  /* Bit depth, color type 0 (gray) */
+
+    FILE *f = fopen(path, "wb");
+    if (! f)
+        return false;
+    bool ok = fwrite("\x89PNG\r\n\x1A\n", 1, 8, f) == 8
+        && write_chunk(f, "IHDR", ihdr, sizeof(ihdr))
+        && write_chunk(f, "IDAT", z, n)
+        && write_chunk(f, "IEND", NULL, 0);
+    return fclose(f) == 0 && ok;
+}
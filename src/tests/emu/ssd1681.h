@@ -0,0 +1,76 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file ssd1681.h
+ *
+ * \brief Host emulator of the SSD1681, the controller of the e-Paper screen.
+ *
+ * It decodes the command stream that the screen library sends through the emulated SPI (see sdk.c):
+ * - RAM windows (0x44/0x45), address counters (0x4E/0x4F) and data entry mode (0x11),
+ * - writes (0x24/0x26) and reads (0x27, bank chosen with 0x41) of both RAM banks,
+ * - display update controls (0x21 RAM bypass/inverse, 0x22 sequence) and activation (0x20),
+ * - waveform settings (0x32, 0x3F, 0x03, 0x04, 0x2C), border (0x3C), temperature (0x18, 0x1A, 0x1B),
+ * - resets (RST pin, 0x12) and deep sleep (0x10).
+ *
+ * The BUSY pin is modeled from the sequence of 0x22: the clock and analog enable/disable times measured on the badge,
+ * the frames of the LUT (TP, SR, RP) at their frame rate (FR, 25Hz per step), the OTP loads.
+ * The refresh applies the LUT to the panel: each frame of VSH moves a pixel a quarter of the way to black,
+ * each frame of VSL a quarter of the way to white, which gives the 4 grays of screen_ws_1681_4grays.
+ *
+ * The panel is dumped to PNG in the orientation of the images (the driver writes with decreasing X and Y).
+ * Commands sent while BUSY is high are counted as violations (the real controller ignores them).
+ * */
+
+#ifndef _SSD1681_H
+#define _SSD1681_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SSD1681_WIDTH 200
+#define SSD1681_HEIGHT 200
+#define SSD1681_RAM_SIZE (SSD1681_WIDTH/8*SSD1681_HEIGHT)
+
+/** \brief What went through the SPI and what the controller did, since the last \ref ssd1681_stats_reset. */
+typedef struct {
+    uint32_t bytes;        /**< Command and data bytes written */
+    uint32_t commands;     /**< Command bytes (D/C low) */
+    uint32_t refreshes;    /**< Activations that drove the panel */
+    uint32_t frames;       /**< LUT frames of these refreshes */
+    uint64_t busy_us;      /**< Modeled time with BUSY high after the activations and resets */
+    uint32_t violations;   /**< Commands sent while BUSY was high */
+} ssd1681_stats_t;
+
+/** \brief Power on, with white panel and random RAM. */
+void ssd1681_power_on(uint64_t now_us);
+
+/** \brief Bytes on the SPI, \p dc low for a command byte (only the first byte of \p data). */
+void ssd1681_write(bool dc, const uint8_t *data, size_t len, uint64_t now_us);
+/** \brief Bytes read on the SPI (the answer to the last command, e.g. 0x27, 0x1B, 0x2F). */
+void ssd1681_read(uint8_t *dst, size_t len, uint64_t now_us);
+/** \brief Level of the RST pin, the controller resets on the rising edge. */
+void ssd1681_set_rst(bool level, uint64_t now_us);
+
+/** \brief Level of the BUSY pin. */
+bool ssd1681_busy(uint64_t now_us);
+/** \brief When BUSY falls, UINT64_MAX when it stays high (deep sleep) and 0 when it is low. */
+uint64_t ssd1681_busy_until(void);
+
+/** \brief Temperature of the internal sensor, in °C. */
+void ssd1681_set_temperature(float celsius);
+
+/** \brief RAM bank, 0 for B/W (lsb) or 1 for RED (msb), SSD1681_RAM_SIZE bytes indexed by y*25 + x. */
+const uint8_t *ssd1681_ram(int bank);
+/** \brief Pixel of the panel in the orientation of the images, 0 is white and 255 is black. */
+uint8_t ssd1681_pixel(int x, int y);
+
+const ssd1681_stats_t *ssd1681_stats(void);
+void ssd1681_stats_reset(void);
+
+/** \brief Writes the panel (and its border) to a grayscale PNG, returns false on IO errors. */
+bool ssd1681_dump_png(const char *path);
+
+#endif /* _SSD1681_H */
@@ -0,0 +1,355 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+// Include sys/types.h before inttypes.h to work around issue with
+// certain versions of GCC and newlib which causes omission of PRIu64
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/clocks.h"
+#include "pico/stdlib.h"
+#include "pico/time.h"
+
+#include "gfx.h"
+#include "gfx_chunky.h"
+#include "gfx_dither.h"
+#include "log.h"
+#include "screen.h"
+
+#include "companion.h"
+
+
+static uint8_t lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+static uint8_t msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+/* 8 bits grayscale image, for the dithering, also used as a chunky buffer (aligned for the 32 bits accesses) */
+static uint8_t gray8[SCREEN_WIDTH*SCREEN_HEIGHT] __attribute__((aligned(4)));
+
+
+/* Horizontal gradient, with a disc of the opposite gradient */
+void make_gray8(void) {
+    for(int y=0; y<SCREEN_HEIGHT; ++y)
+        for(int x=0; x<SCREEN_WIDTH; ++x) {
+            int dx = x-100, dy = y-100;
+            gray8[y*SCREEN_WIDTH + x] = dx*dx + dy*dy < 50*50 ? 255 - x*255/199 : x*255/199;
+        }
+}
+
+
+void bench_report(const char *name, uint64_t pixels, uint64_t us) {
+    printf("- %-32s %8" PRIu64 "µs, %8" PRIu64 " kpixels/s\n", name, us, us ? pixels*1000/us : 0);
+}
+
+/* Runs code reps times and reports the pixels/s, given that one run draws pixels pixels */
+#define BENCH(name, pixels, reps, code) { \
+    uint64_t _t0 = time_us_64(); \
+    for(size_t _i=0; _i<(reps); ++_i) { code; } \
+    bench_report(name, (uint64_t)(pixels)*(reps), time_us_64()-_t0); \
+}
+
+/* Same as BENCH, and also reports the bytes per cycle, given that one run converts bytes bytes */
+#define BENCH_BYTES(name, pixels, bytes, reps, code) { \
+    uint64_t _t0 = time_us_64(); \
+    for(size_t _i=0; _i<(reps); ++_i) { code; } \
+    uint64_t _us = time_us_64()-_t0; \
+    bench_report(name, (uint64_t)(pixels)*(reps), _us); \
+    printf("  %32s %8.2f bytes/cycle\n", "", (double)(bytes)*(reps) / ((double)_us*clock_get_hz(clk_sys)/1e6)); \
+}
+
+
+/* Reference blit, pixel by pixel, to compare with gfx_blit */
+void naive_blit(const gfx_planes_t *dst, int x, int y, const gfx_image_t *src) {
+    for(int j=0; j<src->height; ++j)
+        for(int i=0; i<src->width; ++i) {
+            size_t k = j*src->stride + i/8;
+            uint8_t m = 0x80 >> (i & 7);
+            if (src->mask && !(src->mask[k] & m))
+                continue;
+            uint8_t color = (src->lsb[k] & m) ? 1 : 0;
+            if (src->msb ? (src->msb[k] & m) : color)
+                color |= 2;
+            gfx_pixel(dst, x+i, y+j, color);
+        }
+}
+
+
+/* Color of a pixel of an image */
+uint8_t image_color(const gfx_image_t *src, int x, int y) {
+    size_t k = y*src->stride + x/8;
+    uint8_t m = 0x80 >> (x & 7);
+    uint8_t color = (src->lsb[k] & m) ? 1 : 0;
+    if (src->msb ? (src->msb[k] & m) : color)
+        color |= 2;
+    return color;
+}
+
+/* Reference rotation, pixel by pixel, to compare with gfx_rotate */
+void naive_rotate(const gfx_planes_t *dst, const gfx_image_t *src, gfx_rotation_t rotation) {
+    int w = src->width, h = src->height;
+    for(int y=0; y<h; ++y)
+        for(int x=0; x<w; ++x) {
+            uint8_t color = image_color(src, x, y);
+            switch(rotation) {
+                case GFX_ROTATE_0:   gfx_pixel(dst, x, y, color); break;
+                case GFX_ROTATE_90:  gfx_pixel(dst, h-1-y, x, color); break;
+                case GFX_ROTATE_180: gfx_pixel(dst, w-1-x, h-1-y, color); break;
+                case GFX_ROTATE_270: gfx_pixel(dst, y, w-1-x, color); break;
+            }
+        }
+}
+
+
+/* Micro-benchmarks of the inner loops, so that regressions are caught (also on the host: gfx_draw_bench.c in tests/emu) */
+void test_bench(void) {
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    gfx_planes_t bw = GFX_SCREEN_PLANES(lsb, NULL);
+    gfx_image_t comp = GFX_IMAGE_4G(companion);
+
+    printf("gfx benchmarks:\n");
+    BENCH("fill 4g", 200*200, 100, gfx_fill(&gray, 1))
+    BENCH("fill_rect fullscreen 4g", 200*200, 100, gfx_fill_rect(&gray, 0, 0, 200, 200, 2))
+    BENCH("fill_rect fullscreen bw", 200*200, 100, gfx_fill_rect(&bw, 0, 0, 200, 200, 0))
+    BENCH("fill_rect 37x53 4g", 37*53, 1000, gfx_fill_rect(&gray, 13+_i%50, 7, 37, 53, 1))
+    BENCH("hline 150 4g", 150, 10000, gfx_hline(&gray, 3+_i%40, _i%200, 150, 2))
+    BENCH("hline 7 4g", 7, 10000, gfx_hline(&gray, 3+_i%40, _i%200, 7, 2))
+    BENCH("vline 150 4g", 150, 10000, gfx_vline(&gray, _i%200, 20, 150, 1))
+    BENCH("line 200x150 4g", 200, 1000, gfx_line(&gray, 0, 0, 199, 150, 0))
+    BENCH("circle r=80 4g", 8*57, 1000, gfx_circle(&gray, 100, 100, 80, 3))  /* 8 octants of r/sqrt(2) pixels */
+    BENCH("fill_circle r=80 4g", 355*80*80/113, 100, gfx_fill_circle(&gray, 100, 100, 80, 1))
+    BENCH("blit companion 4g", companion_width*8*companion_height, 1000, gfx_blit(&gray, 48, 50, &comp))
+    BENCH("blit companion 4g x=51", companion_width*8*companion_height, 1000, gfx_blit(&gray, 51, 50, &comp))
+    BENCH("blit companion 4g x=-13", companion_width*8*companion_height, 1000, gfx_blit(&gray, -13, 50, &comp))
+    BENCH("naive blit companion 4g x=51", companion_width*8*companion_height, 100, naive_blit(&gray, 51, 50, &comp))
+    BENCH("pixel 4g", 1, 100000, gfx_pixel(&gray, _i%200, (_i/200)%200, 2))
+    make_gray8();
+    BENCH("dither ordered 4g", 200*200, 10, gfx_dither(&gray, gray8, 200, GFX_DITHER_ORDERED))
+    BENCH("dither ordered bw", 200*200, 10, gfx_dither(&bw, gray8, 200, GFX_DITHER_ORDERED))
+    BENCH("dither diffusion 4g", 200*200, 10, gfx_dither(&gray, gray8, 200, GFX_DITHER_DIFFUSION))
+    BENCH("dither diffusion bw", 200*200, 10, gfx_dither(&bw, gray8, 200, GFX_DITHER_DIFFUSION))
+    {
+        static uint8_t rot_lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+        static uint8_t rot_msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+        gfx_planes_t rot = GFX_SCREEN_PLANES(rot_lsb, rot_msb);
+        gfx_image_t img = {lsb, msb, NULL, 200, 200, 200/8};
+        BENCH("rotate 90 4g", 200*200, 10, gfx_rotate(&rot, &img, GFX_ROTATE_90))
+        BENCH("rotate 270 4g", 200*200, 10, gfx_rotate(&rot, &img, GFX_ROTATE_270))
+        BENCH("rotate 180 4g", 200*200, 10, gfx_rotate(&rot, &img, GFX_ROTATE_180))
+        BENCH("mirror x in place 4g", 200*200, 10, gfx_mirror(&gray, &img, true, false))
+        BENCH("naive rotate 90 4g", 200*200, 1, naive_rotate(&rot, &img, GFX_ROTATE_90))
+    }
+    {
+        /* The chunky buffer is the grayscale image, its values do not matter */
+        gfx_image_t img = {lsb, msb, NULL, 200, 200, 200/8};
+        BENCH_BYTES("chunky8 to planes 4g", 200*200, 200*200, 10, gfx_chunky8_to_planes(&gray, gray8, 200))
+        BENCH_BYTES("chunky2 to planes 4g", 200*200, 200*200/4, 10, gfx_chunky2_to_planes(&gray, gray8, 200/4+2))
+        BENCH_BYTES("planes to chunky8 4g", 200*200, 200*200, 10, gfx_planes_to_chunky8(gray8, 200, &img))
+        BENCH_BYTES("planes to chunky2 4g", 200*200, 200*200/4, 10, gfx_planes_to_chunky2(gray8, 200/4+2, &img))
+    }
+}
+
+
+/* gfx_blit must give the same result as the pixel by pixel blit, at any X */
+void test_blit(void) {
+    static uint8_t ref_lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    static uint8_t ref_msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    gfx_planes_t ref = GFX_SCREEN_PLANES(ref_lsb, ref_msb);
+    gfx_image_t comp = GFX_IMAGE_4G(companion);
+    comp.mask = companion_lsb;  /* Any plane makes a good mask */
+
+    size_t n_errors = 0;
+    for(int x=-40; x<200; x+=3) {
+        gfx_fill(&gray, 2);
+        gfx_fill(&ref, 2);
+        gfx_blit(&gray, x, x/2, &comp);
+        naive_blit(&ref, x, x/2, &comp);
+        if (memcmp(lsb, ref_lsb, SCREEN_PLANE_SIZE) || memcmp(msb, ref_msb, SCREEN_PLANE_SIZE)) {
+            printf("blit at x=%d differs\n", x);
+            ++n_errors;
+        }
+    }
+    printf("blit at any X: %s\n", n_errors ? "FAILED" : "ok");
+}
+
+
+/* The dithered planes must keep the mean gray of the image, on 20x20 blocks */
+void test_dither(void) {
+    static const char *names[2] = {"ordered", "diffusion"};
+    make_gray8();
+
+    for(int gray=0; gray<2; ++gray)
+        for(int method=0; method<2; ++method) {
+            gfx_planes_t dst = GFX_SCREEN_PLANES(lsb, gray ? msb : NULL);
+            gfx_dither(&dst, gray8, SCREEN_WIDTH, method);
+
+            /* Mean error of the worst block, compared with the 85 steps of the grays */
+            int worst = 0;
+            for(int by=0; by<SCREEN_HEIGHT; by+=20)
+                for(int bx=0; bx<SCREEN_WIDTH; bx+=20) {
+                    int sum = 0;
+                    for(int y=by; y<by+20; ++y)
+                        for(int x=bx; x<bx+20; ++x) {
+                            size_t k = y*SCREEN_WIDTH/8 + x/8;
+                            uint8_t m = 0x80 >> (x & 7);
+                            int c = gray ? ((msb[k] & m) ? 2 : 0) | ((lsb[k] & m) ? 1 : 0) : ((lsb[k] & m) ? 3 : 0);
+                            sum += 85*c - gray8[y*SCREEN_WIDTH + x];
+                        }
+                    sum = (sum < 0 ? -sum : sum) / 400;
+                    if (sum > worst)
+                        worst = sum;
+                }
+            printf("dither %s %s: worst block off by %d/255 %s\n", names[method], gray ? "4g" : "bw", worst,
+                   worst <= 16 ? "ok" : "FAILED");
+        }
+}
+
+
+/* gfx_rotate and gfx_mirror must give the same result as the pixel by pixel rotation,
+ * for a fullscreen image and for an image whose height is not a multiple of 8 */
+void test_rotate(void) {
+    static uint8_t dst_lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    static uint8_t dst_msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    static uint8_t ref_lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    static uint8_t ref_msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    gfx_image_t comp = GFX_IMAGE_4G(companion);
+    gfx_fill(&gray, 2);
+    gfx_blit(&gray, 51, 13, &comp);
+    make_gray8();
+    gfx_dither(&gray, gray8, SCREEN_WIDTH, GFX_DITHER_DIFFUSION);
+    gfx_image_t images[] = {
+        {lsb, msb, NULL, 200, 200, 200/8},
+        {lsb, NULL, NULL, 200, 200, 200/8},
+        {lsb, msb, NULL, 96, 75, 200/8},  /* Top left corner */
+    };
+
+    size_t n_errors = 0;
+    for(size_t i=0; i<sizeof(images)/sizeof(images[0]); ++i)
+        for(int r=GFX_ROTATE_0; r<=GFX_ROTATE_270; ++r) {
+            const gfx_image_t *img = &images[i];
+            uint16_t w = r & 1 ? img->height : img->width, h = r & 1 ? img->width : img->height;
+            gfx_planes_t dst = {dst_lsb, dst_msb, w, h, (w+7)/8};
+            gfx_planes_t ref = {ref_lsb, ref_msb, w, h, (w+7)/8};
+            memset(dst_lsb, 0, SCREEN_PLANE_SIZE);
+            memset(dst_msb, 0, SCREEN_PLANE_SIZE);
+            memset(ref_lsb, 0, SCREEN_PLANE_SIZE);
+            memset(ref_msb, 0, SCREEN_PLANE_SIZE);
+            gfx_rotate(&dst, img, r);
+            naive_rotate(&ref, img, r);
+            if (memcmp(dst_lsb, ref_lsb, SCREEN_PLANE_SIZE) || memcmp(dst_msb, ref_msb, SCREEN_PLANE_SIZE)) {
+                printf("rotate %d of image %d differs\n", 90*r, (int)i);
+                ++n_errors;
+            }
+        }
+
+    /* In place, two half turns give the image back */
+    memcpy(ref_lsb, lsb, SCREEN_PLANE_SIZE);
+    memcpy(ref_msb, msb, SCREEN_PLANE_SIZE);
+    for(int i=0; i<2; ++i)
+        gfx_mirror(&gray, &images[0], true, true);
+    if (memcmp(lsb, ref_lsb, SCREEN_PLANE_SIZE) || memcmp(msb, ref_msb, SCREEN_PLANE_SIZE)) {
+        printf("mirror in place differs\n");
+        ++n_errors;
+    }
+    printf("rotate and mirror: %s\n", n_errors ? "FAILED" : "ok");
+}
+
+
+/* The planes must survive a round trip through the chunky buffers, and the colors must be the ones of the pixels */
+void test_chunky(void) {
+    static uint8_t ref_lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    static uint8_t ref_msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    gfx_image_t comp = GFX_IMAGE_4G(companion);
+    gfx_fill(&gray, 2);
+    gfx_blit(&gray, 51, 13, &comp);
+    memcpy(ref_lsb, lsb, SCREEN_PLANE_SIZE);
+    memcpy(ref_msb, msb, SCREEN_PLANE_SIZE);
+    gfx_image_t img = {ref_lsb, ref_msb, NULL, 200, 200, 200/8};
+
+    size_t n_errors = 0;
+    gfx_planes_to_chunky8(gray8, SCREEN_WIDTH, &img);
+    for(int y=0; y<SCREEN_HEIGHT; ++y)
+        for(int x=0; x<SCREEN_WIDTH; ++x)
+            n_errors += gray8[y*SCREEN_WIDTH + x] != image_color(&img, x, y);
+    gfx_fill(&gray, 0);
+    gfx_chunky8_to_planes(&gray, gray8, SCREEN_WIDTH);
+    n_errors += memcmp(lsb, ref_lsb, SCREEN_PLANE_SIZE) != 0 || memcmp(msb, ref_msb, SCREEN_PLANE_SIZE) != 0;
+
+    /* 50 bytes per row, the stride is rounded to 4 bytes */
+    gfx_planes_to_chunky2(gray8, SCREEN_WIDTH/4+2, &img);
+    for(int y=0; y<SCREEN_HEIGHT; ++y)
+        for(int x=0; x<SCREEN_WIDTH; ++x)
+            n_errors += ((gray8[y*(SCREEN_WIDTH/4+2) + x/4] >> (6 - 2*(x & 3))) & 3) != image_color(&img, x, y);
+    gfx_fill(&gray, 0);
+    gfx_chunky2_to_planes(&gray, gray8, SCREEN_WIDTH/4+2);
+    n_errors += memcmp(lsb, ref_lsb, SCREEN_PLANE_SIZE) != 0 || memcmp(msb, ref_msb, SCREEN_PLANE_SIZE) != 0;
+
+    printf("chunky conversions: %s\n", n_errors ? "FAILED" : "ok");
+}
+
+
+/* Show the dithered image, with both methods */
+void test_show_dither(void) {
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    make_gray8();
+
+    for(int method=0; method<2; ++method) {
+        printf("show dither %d:", method);
+        gfx_dither(&gray, gray8, SCREEN_WIDTH, method);
+        screen_show_image_4g(lsb, msb);
+        absolute_time_t t0 = get_absolute_time();
+        while(screen_busy())
+            tight_loop_contents();
+        printf(" done, took %" PRIu64 "µs\n", absolute_time_diff_us(t0, get_absolute_time()));
+        sleep_ms(2000);
+    }
+}
+
+
+/* Show a few shapes */
+void test_draw(void) {
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    gfx_image_t comp = GFX_IMAGE_4G(companion);
+
+    printf("draw shapes:");
+    gfx_fill(&gray, 3);
+    gfx_fill_rect(&gray, 10, 10, 80, 30, 0);
+    gfx_fill_rect(&gray, 10, 45, 80, 30, 1);
+    gfx_fill_rect(&gray, 10, 80, 80, 30, 2);
+    gfx_circle(&gray, 150, 45, 35, 0);
+    gfx_fill_circle(&gray, 150, 45, 20, 1);
+    for(int i=0; i<10; ++i)
+        gfx_line(&gray, 10, 120, 10+i*20, 190, 0);
+    gfx_hline(&gray, 0, 199, 200, 0);
+    gfx_vline(&gray, 199, 0, 200, 0);
+    gfx_blit(&gray, 93, 95, &comp);
+
+    screen_show_image_4g(lsb, msb);
+    absolute_time_t t0 = get_absolute_time();
+    while(screen_busy())
+        tight_loop_contents();
+    printf(" done, took %" PRIu64 "µs\n", absolute_time_diff_us(t0, get_absolute_time()));
+}
+
+
+int main() {
+    stdio_usb_init();
+    log_set_level(LOG_LEVEL_INFO);
+
+    test_blit();
+    test_dither();
+    test_rotate();
+    test_chunky();
+    test_bench();
+
+    screen_init();
+    while(! screen_boot())
+        tight_loop_contents();
+    test_draw();
+    //test_show_dither();
+    screen_deep_sleep();
+}
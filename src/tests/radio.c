@@ -15,11 +15,7 @@
 #include "pico/time.h"
 
 #include "radio.h"
-
-
-/* TODO: when it is decided whether radio_send functions are static or not, change that (non static -> in .h, static -> find another solution...) */
-void radio_send(const uint8_t *data, uint8_t *response, size_t len);
-void radio_burst_read(uint8_t reg, uint8_t *response, size_t len);
+#include "radio_config.h"
 
 
 #define status_nrdy(status) (status >> 7)
@@ -104,12 +100,12 @@ void wait_state(uint8_t tgt) {
 
 
 void print_configuration(void) {
-    uint8_t cfg[0x30];
+    radio_config_t cfg;
     size_t i,j;
 
     //print_status();
     printf("current configuration:\n");
-    radio_burst_read(0x00, cfg, 0x30);
+    radio_config_read(&cfg);  /* From the shadow, only FSCAL3 to FSCAL1 are read */
 
     /* Print table header */
     printf("    ");
@@ -120,28 +116,38 @@ void print_configuration(void) {
     /* Print memory content with first column for current line */
     for (j=0; j<3; ++j) {
         printf("%02x: ", j*16);
-        for(size_t i=0; i<16; ++i)
-            printf("%02x ", cfg[j*16+i]);
+        for(size_t i=0; i<16 && j*16+i<RADIO_CONFIG_REGS; ++i)
+            printf("%02x ", cfg.regs[j*16+i]);
         printf("\n");
     }
 
     printf("PATABLE:\n    ");
-    radio_burst_read(0x3E, cfg, 8);  /* PATABLE */
-    for(size_t i=0; i<8; ++i)
-        printf("%02x ", cfg[i]);
+    for(size_t i=0; i<RADIO_PATABLE_LEN; ++i)
+        printf("%02x ", cfg.patable[i]);
     printf("\n");
 
     print_status();
 }
 
 
+/* The presets of this test at 433.92MHz, see init_presets() */
+radio_preset_t preset_am270_async, preset_gfsk999;
+
+/** Switch to a preset: only the registers which differ from the current configuration are written,
+ * and the synthesizer is only calibrated at the first switch (see radio_config.h) */
+void switch_preset(radio_preset_t *preset) {
+    bool ok = radio_preset_switch(preset);
+    printf("switch to %s: %" PRIu32 "µs, %d bytes%s %s\n", preset->name, preset->switch_us, preset->switch_bytes,
+           preset->switch_calibrated ? ", calibrated" : "", ok ? "ok" : "FAILED");
+}
+
+
 /** Pulses a TX on 933.92 with OOK (PWM 5% duty on 100ms cycle)
  * Uses the asynch serial mode, which is the usual mode for the Sub-GHz apps on the flipper (RAW read, RAW send) */
 void tx_pulses(void) {
-    radio_send(conf_am270_async, NULL, sizeof(conf_am270_async));
+    switch_preset(&preset_am270_async);
     //radio_send("\x00\x00\xC0\x00\x00\x00\x00\x00\x00\x00", NULL, 10);  /* Done by flipper but does not work */
     //radio_send("\x3E\x50", NULL 2);  /* PATABLE: PWR 0db (C0 for maximal power, C6 by default, which is less power) */
-    radio_set_frequency(433920000);
     print_configuration();
 
     // Put the CC1101 in TX mode (asynch serial) then emit 5ms pulses 10 times per sec
@@ -171,7 +177,7 @@ void tx_pulses(void) {
 /** Put the CC1101 in RX mode and print the first bits received with high enough RSSI.
  * Uses the asynch serial mode, which is the usual mode for the Sub-GHz apps on the flipper (RAW read, RAW send) */
 void rx_times(void) {
-    radio_send(conf_am270_async, NULL, sizeof(conf_am270_async));
+    switch_preset(&preset_am270_async);
     print_configuration();
 
     gpio_init(BADGE_RADIO_GDO0);
@@ -245,14 +251,19 @@ const uint8_t conf_gfsk999[] = {
 };
 
 
+void init_presets(void) {
+    radio_preset_init(&preset_am270_async, "am270_async", conf_am270_async, sizeof(conf_am270_async), 433920000);
+    radio_preset_init(&preset_gfsk999, "gfsk999", conf_gfsk999, sizeof(conf_gfsk999), 433920000);
+}
+
+
 /** \brief msg must be \0 terminated */
 void tx_chat_flipper(const uint8_t *msg) {
     /* Maybe someone else, like rx_pulses did not reset the direction of this pin... */
     gpio_set_dir(BADGE_RADIO_GDO0, GPIO_IN);
 
     /* 800µs per byte */
-    radio_send(conf_gfsk999, NULL, sizeof(conf_gfsk999));
-    radio_set_frequency(433920000);
+    switch_preset(&preset_gfsk999);
     print_configuration();
 
     /* We send data in 63 bytes blocks to simplify the transmission (no interrupt, use GD0 to follow the current packet status) */
@@ -290,6 +301,147 @@ void tx_chat_flipper(const uint8_t *msg) {
 }
 
 
+/* Air time of the packets of conf_gfsk999, in bits: 4 bytes of preamble (MDMCFG1 default), 2 of sync word, the length
+ * byte (variable length) and 2 of CRC */
+#define GFSK999_BPS 9992
+#define GFSK999_PACKET_BITS(len, len_byte) (8*(4 + 2 + (len_byte) + (len) + 2))
+
+static volatile uint32_t tx_done_us = 0;
+static void on_frame_sent(void) {
+    tx_done_us = time_us_32();
+}
+
+/** Send a queue of frames with the transmitter, which refills the FIFO while sending,
+ * and compare the goodput (payload bits per second) with the air rate of conf_gfsk999 */
+void tx_stream(void) {
+    static uint8_t frame[1000];
+    for(size_t i=0; i<sizeof(frame); ++i)
+        frame[i] = 'a' + i%26;
+
+    gpio_set_dir(BADGE_RADIO_GDO0, GPIO_IN);
+    switch_preset(&preset_gfsk999);
+
+    static const size_t lens[] = {63, 255, 1000};
+    for(size_t i=0; i<sizeof(lens)/sizeof(lens[0]); ++i) {
+        size_t len = lens[i], n = 6;
+        bool len_byte = len <= 255;
+        uint32_t t0 = time_us_32();
+        for(size_t k=0; k<n; ++k)
+            if (! radio_tx_send(frame, len, on_frame_sent))
+                printf("queue full\n");
+        while(radio_tx_busy())
+            tight_loop_contents();
+
+        uint32_t us = tx_done_us - t0;
+        uint32_t goodput = (uint64_t)8*len*n * 1000000 / us;
+        uint32_t air_us = (uint64_t)GFSK999_PACKET_BITS(len, len_byte)*n * 1000000 / GFSK999_BPS;
+        printf("- %d frames of %d bytes: %" PRIu32 "µs (%" PRIu32 "µs on air), goodput %" PRIu32 " bps, "
+               "%" PRIu32 "%% of the %d bps air rate\n",
+               n, len, us, air_us, goodput, goodput*100/GFSK999_BPS, GFSK999_BPS);
+    }
+
+    radio_tx_stats_t stats = radio_tx_stats();
+    printf("sent %" PRIu32 " frames, %" PRIu32 " bytes, %" PRIu32 " underflows %s\n", stats.frames, stats.bytes,
+           stats.underflows, stats.underflows ? "FAILED" : "ok");
+}
+
+
+/** Receive packets with the flipper chat configuration for \p seconds, e.g. sent by a flipper in the chat.
+ * The packets are taken from the ring of the receiver every \p read_every_ms, without blocking:
+ * with a long period under sustained traffic, the ring is full and the packets are dropped. */
+void rx_packets(uint32_t seconds, uint32_t read_every_ms) {
+    radio_packet_t pkt;
+    gpio_set_dir(BADGE_RADIO_GDO0, GPIO_IN);
+    switch_preset(&preset_gfsk999);
+    radio_rx_start();
+    print_status();
+
+    printf("receive for %" PRIu32 "s\n", seconds);
+    absolute_time_t end = make_timeout_time_ms(seconds*1000);
+    while(absolute_time_diff_us(get_absolute_time(), end) > 0) {
+        while(radio_rx_get(&pkt))
+            printf("- %d bytes, %d dBm, LQI %d, CRC %s: %.*s\n", pkt.len, pkt.rssi, pkt.lqi,
+                   pkt.crc_ok ? "ok" : "FAILED", pkt.len, pkt.data);
+        sleep_ms(read_every_ms);
+    }
+    radio_rx_stop();
+
+    radio_rx_stats_t stats = radio_rx_stats();
+    printf("received %" PRIu32 " packets (%" PRIu32 " bad CRC), dropped %" PRIu32 ", overflows %" PRIu32 "\n",
+           stats.packets, stats.crc_errors, stats.dropped, stats.overflows);
+}
+
+/* Latency of the transport, in ns per transaction, averaged over reps */
+#define BENCH_REPS 1000
+#define BENCH_NS(code) ({ \
+    uint64_t _t0 = time_us_64(); \
+    for(int _i=0; _i<BENCH_REPS; ++_i) { code; } \
+    (uint32_t)((time_us_64() - _t0) * 1000 / BENCH_REPS); \
+})
+
+static volatile uint32_t async_done = 0;
+static void on_async_done(void) {
+    ++async_done;
+}
+
+/** Measure the latency of a register write and of a 64 bytes burst in the TX FIFO at several SPI clocks,
+ * blocking and asynchronous (the time to queue it, then until it is clocked).
+ * The register writes are read back, and TXBYTES is checked after each burst: above RADIO_SPI_SINGLE_HZ
+ * and RADIO_SPI_BURST_HZ, the CC1101 needs delays that the transport does not insert, and they may fail. */
+void bench_spi(void) {
+    static const uint32_t clocks[] = {1000000, 2000000, 4000000, RADIO_SPI_BURST_HZ, RADIO_SPI_SINGLE_HZ};
+    static uint8_t burst[1+64];
+    burst[0] = CC1101_BURST(CC1101_TXFIFO);
+    for(size_t i=1; i<sizeof(burst); ++i)
+        burst[i] = i;
+    uint8_t reg[2] = {CC1101_CHANNR, 0}, n;
+
+    radio_send("\x36", NULL, 1);  /* IDLE, the TX FIFO can be flushed */
+    printf("clock (Hz)  register write (ns)  64 bytes burst (ns)  async queued (ns)  async clocked (ns)\n");
+    for(size_t i=0; i<sizeof(clocks)/sizeof(clocks[0]); ++i) {
+        uint32_t hz = clocks[i];
+        radio_set_spi_clocks(hz, hz);
+
+        uint32_t write_ns = BENCH_NS(reg[1] = _i; radio_send(reg, NULL, 2));
+        bool write_ok = true;
+        for(uint8_t v=0; v<16; ++v) {
+            uint8_t rd[2] = {CC1101_READ(CC1101_CHANNR), 0}, resp[2];
+            reg[1] = v;
+            radio_send(reg, NULL, 2);
+            radio_send(rd, resp, 2);
+            write_ok &= resp[1] == v;
+        }
+
+        uint32_t burst_ns = BENCH_NS(radio_send("\x3B", NULL, 1); radio_send(burst, NULL, sizeof(burst)))
+                            - BENCH_NS(radio_send("\x3B", NULL, 1));
+        radio_burst_read(CC1101_TXBYTES, &n, 1);
+        bool burst_ok = n == 64;
+
+        uint32_t queued_ns = 0;
+        uint64_t t0 = time_us_64();
+        for(int k=0; k<BENCH_REPS; ++k) {
+            radio_send("\x3B", NULL, 1);
+            uint64_t q0 = time_us_64();
+            radio_send_async(burst, NULL, sizeof(burst), on_async_done);
+            queued_ns += (time_us_64() - q0) * 1000;
+            while(radio_spi_busy())
+                tight_loop_contents();
+        }
+        uint32_t async_ns = (time_us_64() - t0) * 1000 / BENCH_REPS;
+        radio_burst_read(CC1101_TXBYTES, &n, 1);
+        burst_ok &= n == 64 && async_done == BENCH_REPS;
+        async_done = 0;
+
+        printf("%9" PRIu32 "  %19" PRIu32 "  %19" PRIu32 "  %17" PRIu32 "  %18" PRIu32 "  register %s, burst %s%s\n",
+               hz, write_ns, burst_ns, queued_ns / BENCH_REPS, async_ns, write_ok ? "ok" : "FAILED",
+               burst_ok ? "ok" : "FAILED", hz > RADIO_SPI_BURST_HZ ? " (burst out of spec)" : "");
+    }
+
+    radio_send("\x3B", NULL, 1);
+    radio_set_spi_clocks(RADIO_SPI_SINGLE_HZ, RADIO_SPI_BURST_HZ);
+}
+
+
 int main() {
     uint8_t cmd[2];
     stdio_usb_init();
@@ -303,14 +455,12 @@ int main() {
 
     print_status();
 
+    init_presets();
     tx_pulses();
     //rx_times();
 
-    /* We need a reset between changing modes, otherwise some of the conf makes it never go out of calibrating */
-    cmd[0] = CC1101_SRES;
-    printf("reset\n");
-    radio_send(cmd, NULL, 1);
-    wait_state(0);
+    /* No reset between the modes: tx_chat_flipper() switches to its preset, which writes back all the registers that
+     * tx_pulses() changed (they used to keep it calibrating forever), and the calibration is done once */
 
     tx_chat_flipper("Badge SecSea joined chat.\n");
     sleep_ms(3000);
@@ -333,6 +483,9 @@ int main() {
     tx_chat_flipper("Badge SecSea: doooown!\n");
     sleep_ms(3000);
     tx_chat_flipper("Badge SecSea left chat.\n");
+    //rx_packets(60, 10);
+    //tx_stream();
+    //bench_spi();
 
     /* Shutdown */
     printf("wait\n");
@@ -21,10 +21,6 @@
 
 #include "radio.h"
 
-/* TODO: when it is decided whether radio_send functions are static or not, change that (non static -> in .h, static -> find another solution...) */
-void radio_send(const uint8_t *data, uint8_t *response, size_t len);
-
-
 static uint64_t rises = 0;
 static absolute_time_t t0 = 0;
 
@@ -18,6 +18,8 @@
 #include "badge_pinout.h"
 #include "log.h"
 #include "screen.h"
+#include "screen_fb.h"
+#include "screen_layers.h"
 
 
 // Waveform settings, showing grays
@@ -56,13 +58,38 @@ const uint8_t ws_1681_times[159] = \
 #include "text_bw.h"
 #include "grad_4g.h"
 #include "secsea_4g.h"
+#include "hip_4g.h"
 #include "notif_4g.h"
 #include "companion.h"
 
+#include "hip_bw_z.h"
+#include "text_bw_z.h"
+#include "grad_4g_z.h"
+#include "secsea_4g_z.h"
+#include "hip_4g_z.h"
 
 
+
+/* Push the 4 grays planes, then read them back and compare, and compare their checksums */
 void test_read_all(void) {
-    /* TODO: read everything that can be read from the screen memory */
+    static uint8_t lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    static uint8_t msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+    uint32_t lsb_sum, msb_sum;
+
+    printf("read back the RAM banks:");
+    screen_clear_image_position();
+    screen_push_rams(hip_4g_lsb, hip_4g_msb, SCREEN_PLANE_SIZE);
+    absolute_time_t t0 = get_absolute_time();
+    bool ok = screen_read_rams_window(lsb, msb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT);
+    absolute_time_t t1 = get_absolute_time();
+    ok = ok && memcmp(lsb, hip_4g_lsb, SCREEN_PLANE_SIZE) == 0 && memcmp(msb, hip_4g_msb, SCREEN_PLANE_SIZE) == 0;
+    printf(" %s, took %" PRIu64 "µs\n", ok ? "ok" : "FAILED", absolute_time_diff_us(t0, t1));
+
+    printf("checksums of the RAM banks:");
+    ok = screen_checksum_rams_window(&lsb_sum, &msb_sum, SCREEN_WIDTH/8, SCREEN_HEIGHT);
+    ok = ok && lsb_sum == screen_checksum(hip_4g_lsb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT)
+            && msb_sum == screen_checksum(hip_4g_msb, SCREEN_WIDTH/8, SCREEN_WIDTH/8, SCREEN_HEIGHT);
+    printf(" %s (%08" PRIx32 " %08" PRIx32 ")\n", ok ? "ok" : "FAILED", lsb_sum, msb_sum);
 }
 
 
@@ -122,6 +149,342 @@ void test_subimage(void) {
 }
 
 
+/* Spins for us µs and returns the number of loop iterations, to estimate how much CPU is left while pushing */
+uint32_t spin_for(uint64_t us) {
+    uint32_t n = 0;
+    absolute_time_t t0 = get_absolute_time();
+    while(absolute_time_diff_us(t0, get_absolute_time()) < us)
+        ++n;
+    return n;
+}
+
+/* Compare the CPU time spent to push a full 4 grays frame with the blocking and the DMA paths */
+void test_push_timings(void) {
+    absolute_time_t t0, t1;
+    uint64_t blocking_us, start_us;
+    uint32_t spins, spins_ref;
+
+    printf("push timings for a full 4 grays frame:\n");
+    size_t len = screen_clear_image_position();
+
+    t0 = get_absolute_time();
+    screen_push_rams(secsea_4g_lsb, secsea_4g_msb, len);
+    t1 = get_absolute_time();
+    blocking_us = absolute_time_diff_us(t0, t1);
+    printf("- blocking: CPU busy for %" PRIu64 "µs\n", blocking_us);
+
+    /* Spin for twice the blocking time while the DMA works, and compare to the same spin without DMA */
+    spins_ref = spin_for(2*blocking_us);
+    t0 = get_absolute_time();
+    screen_push_rams_async(secsea_4g_lsb, secsea_4g_msb, len, NULL);
+    t1 = get_absolute_time();
+    spins = spin_for(2*blocking_us);
+    start_us = absolute_time_diff_us(t0, t1);
+    if(spins > spins_ref)  /* Measurement noise */
+        spins = spins_ref;
+    if(screen_pushing())
+        printf("- async: FAILED, transfer took more than %" PRIu64 "µs\n", 2*blocking_us);
+    printf("- async: CPU busy for %" PRIu64 "µs to start, then ~%" PRIu64 "µs in interrupts (%" PRIu32 "/%" PRIu32 " loops left)\n",
+           start_us, (2*blocking_us*(spins_ref-spins))/spins_ref, spins, spins_ref);
+}
+
+
+/* Simulates the screen RAM address counters for a window set by screen_set_image_position()
+ * (X and Y decrement from the end of the window, see setup())
+ * and checks that each byte of the zone lands on the RAM byte where it is in a fullscreen push */
+bool check_fb_window(const screen_fb_t *fb, const screen_rect_t *zone) {
+    screen_rect_t win = screen_fb_window(zone);
+    /* Window in RAM bytes, same as screen_set_image_position() */
+    size_t xs = win.x0/8, xe = win.x1/8-1, ys = win.y0, ye = win.y1-1;
+    size_t row_len = (zone->x1-zone->x0)/8, rows = zone->y1-zone->y0;
+    if ((xe-xs+1)*(ye-ys+1) != row_len*rows)
+        return false;
+
+    for(size_t k=0; k<row_len*rows; ++k) {
+        /* k-th byte pushed by screen_fb_push */
+        uint8_t pushed = fb->lsb[(zone->y0 + k/row_len)*SCREEN_WIDTH/8 + zone->x0/8 + k%row_len];
+        /* Where the counters put it */
+        size_t ram_x = xe - k%row_len, ram_y = ye - k/row_len;
+        /* Which byte of a fullscreen push lands there */
+        size_t k_full = (SCREEN_HEIGHT-1-ram_y)*SCREEN_WIDTH/8 + (SCREEN_WIDTH/8-1-ram_x);
+        if (pushed != fb->lsb[k_full])
+            return false;
+    }
+    return true;
+}
+
+/* Screen independent test of the framebuffer zones */
+void test_fb_windows(void) {
+    static screen_fb_t fb;
+    bool ok = true;
+
+    printf("framebuffer windows:\n");
+    screen_fb_init(&fb, false, 3);
+    for(size_t i=0; i<SCREEN_PLANE_SIZE; ++i)
+        fb.lsb[i] = i*7 + i/25;  /* Different bytes on each line and column */
+
+    const screen_rect_t zones[] = {
+        {0, 0, 200, 200},
+        {0, 0, 8, 1},
+        {192, 199, 200, 200},
+        {48, 68, 168, 168},
+        {8, 10, 16, 190},
+    };
+    for(size_t i=0; i<sizeof(zones)/sizeof(zones[0]); ++i) {
+        bool res = check_fb_window(&fb, &zones[i]);
+        printf("- zone (%d,%d)-(%d,%d): %s\n", zones[i].x0, zones[i].y0, zones[i].x1, zones[i].y1, res ? "ok" : "FAILED");
+        ok &= res;
+    }
+
+    /* Snapping and merging */
+    fb.n_damage = 0;
+    screen_fb_damage(&fb, 3, 3, 10, 10);
+    screen_fb_damage(&fb, 9, 9, 20, 20);
+    ok &= fb.n_damage == 1 && fb.damage[0].x0 == 0 && fb.damage[0].x1 == 24 && fb.damage[0].y0 == 3 && fb.damage[0].y1 == 20;
+    screen_fb_damage(&fb, 100, 100, 101, 101);
+    ok &= fb.n_damage == 2 && fb.damage[1].x0 == 96 && fb.damage[1].x1 == 104;
+    for(size_t i=0; i<20; ++i)
+        screen_fb_damage(&fb, 10*i, 10*i, 10*i+2, 10*i+2);
+    ok &= fb.n_damage <= SCREEN_FB_MAX_DAMAGE;
+    for(size_t i=0; i<fb.n_damage; ++i)
+        ok &= check_fb_window(&fb, &fb.damage[i]);
+    printf("framebuffer windows %s\n", ok ? "ok" : "FAILED");
+    fb.n_damage = 0;
+}
+
+/* Update a small zone of a framebuffer and show it, compared to a fullscreen push */
+void test_fb_push(void) {
+    static screen_fb_t fb;
+
+    printf("push framebuffer:");
+    screen_fb_init(&fb, true, 3);
+    memcpy(fb.lsb, secsea_4g_lsb, SCREEN_PLANE_SIZE);
+    memcpy(fb.msb, secsea_4g_msb, SCREEN_PLANE_SIZE);
+    screen_push_ws(screen_ws_1681_4grays);
+    printf(" %d bytes for the first frame,", screen_fb_push(&fb));
+    screen_show_rams();
+    time_busy("");
+
+    /* Blank a notification sized zone */
+    for(size_t j=68; j<168; ++j)
+        memset(fb.lsb + j*SCREEN_WIDTH/8 + 48/8, 0x00, 120/8);
+    screen_fb_damage(&fb, 50, 68, 166, 168);
+    printf("update:");
+    printf(" %d bytes for the notification,", screen_fb_push(&fb));
+    screen_show_rams();
+    time_busy("");
+}
+
+
+/* Same screen as test_subimage(), but the notification can be removed */
+void test_layers(void) {
+    static screen_fb_t fb;
+    static screen_layers_t layers;
+    gfx_image_t bg = GFX_IMAGE_4G(secsea_4g);
+    gfx_image_t comp = GFX_IMAGE_4G(companion);
+    gfx_image_t notif = GFX_IMAGE_4G(notif_4g);
+
+    printf("layers:");
+    screen_fb_init(&fb, true, 3);
+    screen_layers_init(&layers, &fb, 3);
+    screen_layers_show(&layers, SCREEN_LAYER_BACKGROUND, &bg, 0, 0);
+    screen_layers_show(&layers, SCREEN_LAYER_CONTENT, &comp, 32, 18);
+    screen_layers_compose(&layers);
+    screen_push_ws(screen_ws_1681_4grays);
+    printf(" %d bytes for the first frame,", screen_fb_push(&fb));
+    screen_show_rams();
+    time_busy("");
+
+    screen_layers_show(&layers, SCREEN_LAYER_OVERLAY, &notif, 48, 68);
+    printf("- notification: %d tiles,", screen_layers_compose(&layers));
+    printf(" %d bytes,", screen_fb_push(&fb));
+    screen_show_rams();
+    time_busy("");
+    sleep_ms(2000);
+
+    screen_layers_hide(&layers, SCREEN_LAYER_OVERLAY);
+    printf("- pop: %d tiles,", screen_layers_compose(&layers));
+    printf(" %d bytes,", screen_fb_push(&fb));
+    screen_show_rams();
+    time_busy("");
+}
+
+
+/* Rolling frame: only the changed pixels are driven */
+void test_diff(void) {
+    static uint8_t frame[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+
+    printf("diff images\n");
+    printf("- text_bw (full refresh):");
+    screen_show_image_diff(text_bw);
+    time_busy("");
+    printf("- hip_bw:");
+    screen_show_image_diff(hip_bw);
+    time_busy("");
+    printf("- hip_bw again (skipped):");
+    screen_show_image_diff(hip_bw);
+    time_busy("");
+
+    /* Move a black bar down the screen, only a few rows change each time */
+    memcpy(frame, hip_bw, SCREEN_PLANE_SIZE);
+    for(size_t t=0; t<5; ++t) {
+        memset(frame + 40*t*SCREEN_WIDTH/8, 0x00, 10*SCREEN_WIDTH/8);
+        printf("- bar %d:", t);
+        screen_show_image_diff(frame);
+        time_busy("");
+    }
+}
+
+
+/* Same rolling frame, with the fast updates: a full refresh, 4 fast ones, then a full one again */
+void test_fast(void) {
+    static uint8_t frame[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+
+    printf("fast updates, full refresh every 4\n");
+    screen_set_fast_full_period(4);
+    memcpy(frame, hip_bw, SCREEN_PLANE_SIZE);
+    for(size_t t=0; t<6; ++t) {
+        memset(frame + 30*t*SCREEN_WIDTH/8, 0x00, 10*SCREEN_WIDTH/8);
+        printf("- bar %d%s:", t, t == 0 || t == 5 ? " (full)" : "");
+        screen_show_image_fast(frame);
+        time_busy("");
+    }
+    screen_set_fast_full_period(SCREEN_FAST_FULL_PERIOD);
+
+    /* Against the slower diff waveform */
+    printf("- diff:");
+    memset(frame + 190*SCREEN_WIDTH/8, 0x00, 10*SCREEN_WIDTH/8);
+    screen_show_image_diff(frame);
+    time_busy("");
+}
+
+
+/* Compression ratio of the compressed images, and decode+push time against the raw push.
+ * The decoded planes are checked against the raw ones on the host (tests/emu/screen_emu.c). */
+void test_compressed(void) {
+    printf("compressed images (size, ratio, raw push, decode+push):\n");
+    screen_clear_image_position();
+
+#define _push_z(name, planes, raw_lsb, raw_msb, z_lsb, z_msb, z_size) { \
+    absolute_time_t t0 = get_absolute_time(); \
+    screen_push_rams(raw_lsb, raw_msb, SCREEN_PLANE_SIZE); \
+    absolute_time_t t1 = get_absolute_time(); \
+    screen_push_rams_z(z_lsb, z_msb); \
+    absolute_time_t t2 = get_absolute_time(); \
+    printf("- %-10s %5d -> %5d bytes (%3d%%), %6" PRIu64 "µs, %6" PRIu64 "µs\n", name, \
+           planes*SCREEN_PLANE_SIZE, z_size, z_size*100/(planes*SCREEN_PLANE_SIZE), \
+           absolute_time_diff_us(t0, t1), absolute_time_diff_us(t1, t2)); \
+}
+    _push_z("hip_bw", 1, hip_bw, NULL, hip_bw_z, NULL, hip_bw_z_size)
+    _push_z("text_bw", 1, text_bw, NULL, text_bw_z, NULL, text_bw_z_size)
+    _push_z("grad_4g", 2, grad_4g_lsb, grad_4g_msb, grad_4g_lsb_z, grad_4g_msb_z, grad_4g_lsb_z_size+grad_4g_msb_z_size)
+    _push_z("secsea_4g", 2, secsea_4g_lsb, secsea_4g_msb, secsea_4g_lsb_z, secsea_4g_msb_z,
+            secsea_4g_lsb_z_size+secsea_4g_msb_z_size)
+    _push_z("hip_4g", 2, hip_4g_lsb, hip_4g_msb, hip_4g_lsb_z, hip_4g_msb_z, hip_4g_lsb_z_size+hip_4g_msb_z_size)
+
+    printf("- show hip_4g_z:");
+    screen_show_image_z(hip_4g_lsb_z, hip_4g_msb_z);
+    time_busy("");
+}
+
+
+/* Commands given while busy are queued, and the redundant frames are dropped */
+void test_queue(void) {
+    printf("queue:\n");
+    screen_show_image_4g(secsea_4g_lsb, secsea_4g_msb);
+    absolute_time_t t0 = get_absolute_time();
+    screen_show_image_bw(hip_bw);
+    screen_show_image_bw(text_bw);  /* Supersedes hip_bw */
+    screen_border(0);
+    screen_show_image_4g(hip_4g_lsb, hip_4g_msb);  /* Supersedes text_bw, not the border */
+    absolute_time_t t1 = get_absolute_time();
+    printf("- 4 commands queued in %" PRIu64 "µs, %d waiting (2 expected)\n",
+           absolute_time_diff_us(t0, t1), screen_queued());
+
+    /* The queue is sent by screen_busy() */
+    time_busy("- drain");
+    printf("- %d waiting\n", screen_queued());
+    screen_border(3);
+}
+
+
+/* Boot and refresh callbacks: the screen sleeps as soon as the refresh is done, then wakes up */
+static volatile absolute_time_t cb_ready_ts = 0, cb_refresh_ts = 0;
+
+static void on_ready(void) {
+    cb_ready_ts = get_absolute_time();
+}
+
+static void on_refresh_done(void) {
+    cb_refresh_ts = get_absolute_time();
+    screen_deep_sleep();
+}
+
+void test_callbacks(void) {
+    printf("callbacks:\n");
+    screen_set_callbacks(on_ready, on_refresh_done);
+    cb_refresh_ts = 0;
+    absolute_time_t t0 = get_absolute_time();
+    screen_show_image_bw(hip_bw);
+    while(! cb_refresh_ts)
+        tight_loop_contents();
+    printf("- refresh done after %" PRIu64 "µs, asleep right away, BUSY = %d\n",
+           absolute_time_diff_us(t0, cb_refresh_ts), gpio_get(BADGE_SCREEN_BUSY));
+
+    /* Boot without polling */
+    cb_ready_ts = 0;
+    t0 = get_absolute_time();
+    screen_boot();
+    while(! cb_ready_ts)
+        tight_loop_contents();
+    printf("- ready after %" PRIu64 "µs\n", absolute_time_diff_us(t0, cb_ready_ts));
+    screen_boot();  /* Logs the steps */
+    screen_set_callbacks(NULL, NULL);
+}
+
+
+/* The same LUT is not pushed again between the frames of a slideshow */
+void test_ws_cache(void) {
+    printf("waveform settings cache:\n");
+    screen_ws_stats_t st0 = screen_ws_stats();
+    const uint8_t *imgs[] = {hip_bw, text_bw, squares_bw};
+    for(size_t i=0; i<3; ++i) {
+        screen_show_image_bw(imgs[i]);
+        time_busy("- frame");
+    }
+    screen_ws_stats_t st1 = screen_ws_stats();
+    printf("- %" PRIu32 " uploads, %" PRIu32 " skipped (2 expected), %" PRIu32 " bytes and %" PRIu32 " commands saved\n",
+           st1.uploaded-st0.uploaded, st1.skipped-st0.skipped,
+           st1.bytes_saved-st0.bytes_saved, st1.commands_saved-st0.commands_saved);
+}
+
+
+/* Cold boot against a wake up from deep sleep */
+void test_wake(void) {
+    screen_boot_timings_t t = screen_boot_timings();
+    printf("boot %" PRIu32 "µs (SLEEP %" PRIu32 ", SWRESET %" PRIu32 ", SETUP %" PRIu32 ")\n",
+           t.total_us, t.sleep_us, t.swreset_us, t.setup_us);
+    screen_deep_sleep();
+    while(! screen_boot())
+        tight_loop_contents();
+    t = screen_boot_timings();
+    printf("wake up %" PRIu32 "µs (SLEEP %" PRIu32 ", SWRESET %" PRIu32 ", SETUP %" PRIu32 ")%s\n",
+           t.total_us, t.sleep_us, t.swreset_us, t.setup_us, t.wake ? "" : " NOT A WAKE UP");
+}
+
+
+/* The full refreshes are shorter when warm */
+void test_temperature(void) {
+    printf("temperature %d°C\n", screen_temperature());
+    printf("- show_bw:");
+    screen_show_image_bw(hip_bw);
+    time_busy("");
+    printf("- show_4g:");
+    screen_show_image_4g(hip_4g_lsb, hip_4g_msb);
+    time_busy("");
+}
+
+
 void test_clear(void) {
     printf("clear to white\n");
     screen_clear(1);  /* Tests showed that normal draws can occur after this one */
@@ -283,6 +646,18 @@ int main() {
     //test_show_4g_images();
     //test_subimage();
     //test_enable_once();
+    //test_push_timings();
+    //test_fb_windows();
+    //test_fb_push();
+    //test_layers();
+    //test_diff();
+    //test_fast();
+    //test_compressed();
+    //test_queue();
+    //test_callbacks();
+    //test_ws_cache();
+    //test_temperature();
+    //test_wake();
 
     test_clear(); sleep_ms(1000);
     //uint8_t buf[5000];
@@ -0,0 +1,139 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+// Include sys/types.h before inttypes.h to work around issue with
+// certain versions of GCC and newlib which causes omission of PRIu64
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+
+#include "gfx.h"
+#include "log.h"
+#include "screen.h"
+#include "text.h"
+
+#include "font_sans_12.h"
+#include "font_sans_16_gray.h"
+
+
+static uint8_t lsb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+static uint8_t msb[SCREEN_PLANE_SIZE] __attribute__((aligned(4)));
+
+static const char *lorem = "Le badge affiche du texte avec retour à la ligne automatique entre les mots, "
+    "et coupe les motsbeaucouptroplongspourtenirsurunelignecomplète. "
+    "Ça marche aussi avec des accents: àâçéèêëîïôöùûü, et même l'€ et les ° du café à 60°.";
+
+
+/* The characters must be decoded, found in the atlas, kerned, and not drawn when missing */
+void test_layout(void) {
+    int w = text_width(&font_sans_12, "Hello");
+    int w_nl = text_width(&font_sans_12, "Hello\nWorld");
+    int w_missing = text_width(&font_sans_12, "a\xe2\x86\x92""b"), w_invalid = text_width(&font_sans_12, "a\xff""b");
+    int w_ref = text_width(&font_sans_12, "a?b");
+    printf("layout:\n");
+    printf("- width of \"Hello\" is %d, with a '\\n' after %d: %s\n", w, w_nl, w > 0 && w_nl == w ? "ok" : "FAILED");
+    printf("- missing characters are '?': width %d = %d: %s\n", w_missing, w_ref, w_missing == w_ref ? "ok" : "FAILED");
+    printf("- invalid UTF-8 is '?': width %d = %d: %s\n", w_invalid, w_ref, w_invalid == w_ref ? "ok" : "FAILED");
+
+    /* The box stops after 3 lines, between two words */
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    const char *rest = text_draw_box(&gray, &font_sans_12, 0, 0, 200, 3*font_sans_12.line_height, lorem, 0);
+    bool box_ok = rest > lorem && rest < lorem + strlen(lorem) && rest[-1] == ' ' && rest[0] != ' ';
+    printf("- 3 lines of the box end at \"%.16s...\": %s\n", rest, box_ok ? "ok" : "FAILED");
+
+    /* Drawn pixels, and only around the text (a couple of pixels for the glyphs that overhang their advance) */
+    gfx_fill(&gray, 3);
+    int x0 = 20, y0 = 30, end = text_draw(&gray, &font_sans_12, x0, y0, "Hello", 0);
+    int inside = 0, outside = 0;
+    for(int y=0; y<SCREEN_HEIGHT; ++y)
+        for(int x=0; x<SCREEN_WIDTH; ++x) {
+            size_t k = y*SCREEN_WIDTH/8 + x/8;
+            uint8_t m = 0x80 >> (x & 7);
+            if ((lsb[k] & m) && (msb[k] & m))
+                continue;
+            if (x >= x0-2 && x < x0+w+2 && y >= y0 && y < y0+font_sans_12.line_height)
+                ++inside;
+            else
+                ++outside;
+        }
+    printf("- \"Hello\" drawn with %d pixels, %d outside of its box, pen at %d: %s\n", inside, outside, end,
+           inside > 0 && outside == 0 && end == x0+w ? "ok" : "FAILED");
+}
+
+
+/* A full screen of text must be drawn much faster than it is pushed to the screen */
+void test_bench(void) {
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+    const char *line = "The quick brown fox jumps over the lazy dog 0123";
+    size_t glyphs = 0;
+
+    printf("full screen of text:\n");
+    absolute_time_t t0 = get_absolute_time();
+    for(int y=0; y<SCREEN_HEIGHT; y+=font_sans_12.line_height) {
+        text_draw(&gray, &font_sans_12, 0, y, line, 0);
+        glyphs += strlen(line);  /* Glyphs outside of the screen are clipped but still count */
+    }
+    absolute_time_t t1 = get_absolute_time();
+    int64_t draw_us = absolute_time_diff_us(t0, t1);
+    printf("- 1 bit font:  %6" PRIu64 "µs for %d glyphs\n", draw_us, glyphs);
+
+    t0 = get_absolute_time();
+    for(int y=0; y<SCREEN_HEIGHT; y+=font_sans_16_gray.line_height)
+        text_draw(&gray, &font_sans_16_gray, 0, y, line, 0);
+    t1 = get_absolute_time();
+    printf("- 2 bits font: %6" PRIu64 "µs\n", absolute_time_diff_us(t0, t1));
+
+    t0 = get_absolute_time();
+    text_draw_box(&gray, &font_sans_12, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, lorem, 0);
+    t1 = get_absolute_time();
+    printf("- word wrap:   %6" PRIu64 "µs\n", absolute_time_diff_us(t0, t1));
+
+    t0 = get_absolute_time();
+    screen_push_rams(lsb, msb, SCREEN_PLANE_SIZE);
+    t1 = get_absolute_time();
+    int64_t push_us = absolute_time_diff_us(t0, t1);
+    printf("- push of both planes to compare: %" PRIu64 "µs\n", push_us);
+    printf("- 1 bit font faster than the push: %s\n", draw_us < push_us ? "ok" : "FAILED");
+}
+
+
+/* Show a page of text */
+void test_draw(void) {
+    gfx_planes_t gray = GFX_SCREEN_PLANES(lsb, msb);
+
+    printf("draw text:");
+    gfx_fill(&gray, 3);
+    text_draw(&gray, &font_sans_16_gray, 4, 2, "Hack In Provence\nÉté 2025: 4 gris", 0);
+    text_draw_box(&gray, &font_sans_12, 4, 44, 192, 120, lorem, 0);
+    gfx_fill_rect(&gray, 0, 170, 200, 30, 0);
+    const char *label = "Blanc sur noir";
+    text_draw(&gray, &font_sans_12, (SCREEN_WIDTH-text_width(&font_sans_12, label))/2, 177, label, 3);
+
+    screen_show_image_4g(lsb, msb);
+    absolute_time_t t0 = get_absolute_time();
+    while(screen_busy())
+        tight_loop_contents();
+    printf(" done, took %" PRIu64 "µs\n", absolute_time_diff_us(t0, get_absolute_time()));
+}
+
+
+int main() {
+    stdio_usb_init();
+    log_set_level(LOG_LEVEL_INFO);
+
+    test_layout();
+
+    screen_init();
+    while(! screen_boot())
+        tight_loop_contents();
+    screen_clear_image_position();
+    test_bench();
+    test_draw();
+    screen_deep_sleep();
+}
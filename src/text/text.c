@@ -0,0 +1,208 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+
+#include <stddef.h>
+
+#include "badge_defs.h"
+#include "text.h"
+
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+
+/* Decodes the next UTF-8 character and moves *s after it (*s must not be the terminating '\0').
+ * Invalid sequences give the replacement character, without skipping the byte that made them invalid. */
+STATIC uint32_t utf8_next(const char **s) {
+    const uint8_t *p = (const uint8_t *)*s;
+    uint32_t c = *p++;
+    int n;
+    if (c < 0x80)
+        n = 0;
+    else if ((c & 0xE0) == 0xC0) {
+        c &= 0x1F;
+        n = 1;
+    } else if ((c & 0xF0) == 0xE0) {
+        c &= 0x0F;
+        n = 2;
+    } else if ((c & 0xF8) == 0xF0) {
+        c &= 0x07;
+        n = 3;
+    } else {
+        *s = (const char *)p;
+        return REPLACEMENT_CHAR;
+    }
+
+    for(; n; --n) {
+        if ((*p & 0xC0) != 0x80) {
+            c = REPLACEMENT_CHAR;
+            break;
+        }
+        c = (c << 6) | (*p++ & 0x3F);
+    }
+    *s = (const char *)p;
+    return c;
+}
+
+
+/* Binary search of a glyph, NULL if the font does not have it */
+STATIC const text_glyph_t *find_glyph(const text_font_t *font, uint32_t c) {
+    size_t lo = 0, hi = font->n_glyphs;
+    while(lo < hi) {
+        size_t mid = (lo+hi)/2;
+        uint16_t cp = font->glyphs[mid].codepoint;
+        if (cp == c)
+            return &font->glyphs[mid];
+        if (cp < c)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+/* The glyph of a character, or of '?' when it is missing */
+static inline const text_glyph_t *glyph(const text_font_t *font, uint32_t c) {
+    const text_glyph_t *g = find_glyph(font, c);
+    return g ? g : find_glyph(font, '?');
+}
+
+
+/* Binary search of the kerning of a pair, 0 when not in the table */
+STATIC int kern(const text_font_t *font, uint16_t left, uint16_t right) {
+    uint32_t key = ((uint32_t)left << 16) | right;
+    size_t lo = 0, hi = font->n_kerning;
+    while(lo < hi) {
+        size_t mid = (lo+hi)/2;
+        const text_kern_t *k = &font->kerning[mid];
+        uint32_t kk = ((uint32_t)k->left << 16) | k->right;
+        if (kk == key)
+            return k->adjust;
+        if (kk < key)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return 0;
+}
+
+
+STATIC void draw_glyph(const gfx_planes_t *dst, const text_font_t *font, const text_glyph_t *g, int x, int y,
+                       uint8_t color) {
+    if (! g->width)
+        return;
+
+    gfx_image_t img = {NULL, NULL, font->mask + g->offset, g->width, g->height, (g->width+7)/8};
+    if (font->bits == 2) {
+        img.lsb = font->lsb + g->offset;
+        img.msb = font->msb + g->offset;
+        gfx_blit(dst, x+g->x_off, y+g->y_off, &img);
+    } else
+        gfx_stencil(dst, x+g->x_off, y+g->y_off, &img, color);
+}
+
+
+/* Lays out the characters from *s until '\n', '\0' or end (NULL for no end), starting at pen x.
+ * Draws them when dst is not NULL. Moves *s after the last character and returns the pen. */
+STATIC int layout(const gfx_planes_t *dst, const text_font_t *font, int x, int y, const char **s, const char *end,
+                  uint8_t color) {
+    const char *p = *s;
+    uint16_t prev = 0;
+    while(*p && *p != '\n' && p != end) {
+        const text_glyph_t *g = glyph(font, utf8_next(&p));
+        if (! g)
+            continue;
+        if (prev)
+            x += kern(font, prev, g->codepoint);
+        if (dst)
+            draw_glyph(dst, font, g, x, y, color);
+        x += g->advance;
+        prev = g->codepoint;
+    }
+    *s = p;
+    return x;
+}
+
+
+/* Finds the characters of str that fit in w pixels, cutting between words when possible.
+ * Returns the end of the line, and sets next to the start of the next line (after the spaces or the '\n'). */
+STATIC const char *fit_line(const text_font_t *font, const char *str, int w, const char **next) {
+    const char *p = str;
+    const char *brk = NULL, *brk_next = NULL;  /* Last cut between words */
+    int x = 0;
+    uint16_t prev = 0;
+
+    while(*p && *p != '\n') {
+        if (*p == ' ') {
+            if (p == str) {
+                /* Leading spaces of the line are skipped */
+                while(*p == ' ')
+                    ++p;
+                str = p;
+                continue;
+            }
+            /* Cut before the spaces, the next line starts after them */
+            brk = p;
+            brk_next = p;
+            while(*brk_next == ' ')
+                ++brk_next;
+        }
+
+        const char *q = p;
+        const text_glyph_t *g = glyph(font, utf8_next(&q));
+        if (g) {
+            int nx = x + (prev ? kern(font, prev, g->codepoint) : 0) + g->advance;
+            if (nx > w) {
+                if (brk) {
+                    *next = brk_next;
+                    return brk;
+                }
+                /* A single word wider than the box: cut it, but keep at least 1 character */
+                if (p > str) {
+                    *next = p;
+                    return p;
+                }
+            }
+            x = nx;
+            prev = g->codepoint;
+        }
+        p = q;
+    }
+
+    *next = *p == '\n' ? p+1 : p;
+    return p;
+}
+
+
+int text_draw(const gfx_planes_t *dst, const text_font_t *font, int x, int y, const char *str, uint8_t color) {
+    int pen = x;
+    while(true) {
+        pen = layout(dst, font, x, y, &str, NULL, color);
+        if (*str != '\n')
+            return pen;
+        ++str;
+        y += font->line_height;
+    }
+}
+
+
+const char *text_draw_box(const gfx_planes_t *dst, const text_font_t *font, int x, int y, int w, int h,
+                          const char *str, uint8_t color) {
+    for(int line_y=y; *str && line_y+font->line_height <= y+h; line_y+=font->line_height) {
+        const char *next;
+        const char *end = fit_line(font, str, w, &next);
+        /* Skip the leading spaces, like fit_line */
+        while(*str == ' ' && str < end)
+            ++str;
+        layout(dst, font, x, line_y, &str, end, color);
+        str = next;
+    }
+    return str;
+}
+
+
+int text_width(const text_font_t *font, const char *str) {
+    return layout(NULL, font, 0, 0, &str, NULL, 0);
+}
@@ -0,0 +1,85 @@
+/* badge_secsea © 2025 by Hack In Provence is licensed under
+ * Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International.
+ * To view a copy of this license,
+ * visit https://creativecommons.org/licenses/by-nc-sa/4.0/ */
+
+/** \file text.h
+ *
+ * \brief Text API: draw UTF-8 strings in packed bitplanes (see gfx.h).
+ *
+ * Fonts are glyph atlases generated by font2epaper.py from TrueType fonts, see badge_font2epaper() in CMakeLists.txt:
+ * - 1 bit fonts only have a mask per glyph, and are drawn in any color (gfx_stencil()),
+ * - 2 bits fonts are antialiased with the 4 grays, they have the lsb and msb planes of black ink on white
+ *   and a mask of the pixels to draw (gfx_blit()), so the color of the text is not chosen.
+ *
+ * Each glyph is a small image, with rows aligned on bytes. It is blitted at any X with the 32 bits blits of gfx,
+ * so the cost of a glyph is a few words per row instead of a few operations per pixel.
+ *
+ * Coordinates are the top left of the line: a glyph is placed at its offset from the pen,
+ * and the pen moves by the advance of the glyph, corrected by the kerning of the pair.
+ * Characters missing from the font are drawn as '?'.
+ *
+ * The usual use is:
+ * - include the generated font header once (it defines the font, like the image headers),
+ * - text_draw() for labels, text_draw_box() for paragraphs (word wrap),
+ * - text_width() to align the labels.
+ * */
+
+#ifndef _TEXT_H
+#define _TEXT_H
+
+#include <stdint.h>
+
+#include "gfx.h"
+
+/** \brief A glyph of the atlas. */
+typedef struct {
+    uint16_t codepoint;
+    uint16_t offset;   /**< Of its first byte in the atlas planes, the rows are (width+7)/8 bytes */
+    uint8_t width;     /**< Of its bitmap, in pixels */
+    uint8_t height;
+    int8_t x_off;      /**< Of its bitmap from the pen */
+    int8_t y_off;      /**< Of its bitmap from the top of the line */
+    uint8_t advance;   /**< Moves the pen after the glyph */
+} text_glyph_t;
+
+/** \brief Adjustment of the advance between 2 glyphs. */
+typedef struct {
+    uint16_t left;
+    uint16_t right;
+    int8_t adjust;
+} text_kern_t;
+
+/** \brief A font, as generated by font2epaper.py. */
+typedef struct {
+    const uint8_t *lsb;   /**< NULL for 1 bit fonts */
+    const uint8_t *msb;   /**< NULL for 1 bit fonts */
+    const uint8_t *mask;
+    const text_glyph_t *glyphs;  /**< Sorted by codepoint */
+    uint16_t n_glyphs;
+    const text_kern_t *kerning;  /**< Sorted by left then right codepoint */
+    uint16_t n_kerning;
+    uint8_t line_height;
+    uint8_t bits;         /**< 1 or 2 bits per pixel */
+} text_font_t;
+
+
+/** \brief Draw a string, '\n' starts a new line at \p x.
+ *
+ * \param x, y  Top left of the first line.
+ * \param color The color of 1 bit fonts, 2 bits fonts use their own grays.
+ * \return The X of the pen after the last glyph. */
+int text_draw(const gfx_planes_t *dst, const text_font_t *font, int x, int y, const char *str, uint8_t color);
+
+/** \brief Draw a string in the box [x,x+w[ x [y,y+h[, wrapping the lines between words.
+ *
+ * Words wider than the box are cut. Only full lines are drawn.
+ *
+ * \return The first character that did not fit in the box (the terminating '\0' when everything was drawn). */
+const char *text_draw_box(const gfx_planes_t *dst, const text_font_t *font, int x, int y, int w, int h,
+                          const char *str, uint8_t color);
+
+/** \brief Width of the first line of a string, in pixels. */
+int text_width(const text_font_t *font, const char *str);
+
+#endif /* _TEXT_H */